@@ -0,0 +1,74 @@
+#pragma once
+
+#include "prefetch.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    /**
+     * @brief A linear allocator handing out the loopers' buffers from a
+     * block of memory, the budget they share. The block can be a static
+     * array in the SDRAM of the Daisy, declared once in the firmware:
+     *
+     * uint8_t DSY_SDRAM_BSS memory[kBytes];
+     * Arena arena{memory, kBytes};
+     *
+     * or one mapped by a HostArena on the host. The allocations last until
+     * the arena is reset, as the loopers keep their buffers until they're
+     * inited again.
+     */
+    class Arena
+    {
+    public:
+        Arena() {}
+        Arena(void *memory, size_t bytes) { Init(memory, bytes); }
+        ~Arena() {}
+
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        void Init(void *memory, size_t bytes)
+        {
+            memory_ = static_cast<uint8_t *>(memory);
+            bytes_ = memory ? bytes : 0;
+            used_ = 0;
+        }
+
+        /**
+         * @brief Takes the given number of bytes from the arena.
+         *
+         * @param bytes
+         * @param alignment a power of two, by default a cache line so that
+         * the buffers of different loopers never share one
+         * @return void* null if the budget is exhausted
+         */
+        void *Allocate(size_t bytes, size_t alignment = kCacheLineBytes)
+        {
+            uintptr_t base = reinterpret_cast<uintptr_t>(memory_);
+            size_t offset = ((base + used_ + alignment - 1) & ~(alignment - 1)) - base;
+            if (!memory_ || offset > bytes_ || bytes > bytes_ - offset)
+            {
+                return nullptr;
+            }
+            used_ = offset + bytes;
+
+            return memory_ + offset;
+        }
+
+        /**
+         * @brief Gives back all the allocations at once. The memory isn't
+         * cleared.
+         */
+        inline void Reset() { used_ = 0; }
+
+        inline size_t GetBytes() const { return bytes_; }
+        inline size_t GetUsedBytes() const { return used_; }
+        inline size_t GetFreeBytes() const { return bytes_ - used_; }
+
+    private:
+        uint8_t *memory_{};
+        size_t bytes_{};
+        size_t used_{};
+    };
+} // namespace wreath
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "storage.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace wreath
+{
+    /**
+     * @brief Clears a buffer a few chunks at a time, so that clearing it
+     * never takes more than a bounded number of bytes per audio callback.
+     *
+     * While a clear is in progress, the chunks not swept yet are pending:
+     * reading them must return silence and they must be touched before being
+     * written, which clears them right away.
+     *
+     * @tparam Storage the storage policy of the buffer
+     */
+    template <typename Storage = FloatStorage>
+    class BasicBufferClearer
+    {
+    public:
+        BasicBufferClearer() {}
+        ~BasicBufferClearer() {}
+
+        using Sample = typename Storage::Sample;
+
+        static constexpr int32_t kMaxChunks{4096};
+        static constexpr int32_t kMinChunkShift{10}; // 1024 samples
+
+        void Init(Sample *buffer, int32_t maxBufferSamples)
+        {
+            buffer_ = buffer;
+            maxBufferSamples_ = maxBufferSamples;
+            // Use bigger chunks when the buffer doesn't fit in the table.
+            chunkShift_ = kMinChunkShift;
+            while ((static_cast<int64_t>(kMaxChunks) << chunkShift_) < maxBufferSamples_)
+            {
+                chunkShift_++;
+            }
+            chunks_ = (maxBufferSamples_ + (1 << chunkShift_) - 1) >> chunkShift_;
+            std::fill(pending_, pending_ + kMaxChunks, false);
+            pendingChunks_ = 0;
+            sweepChunk_ = 0;
+            credit_ = 0;
+        }
+
+        /**
+         * @brief Starts clearing the buffer. All the chunks become pending
+         * until the sweep or a write reaches them.
+         */
+        void Start()
+        {
+            std::fill(pending_, pending_ + chunks_, true);
+            pendingChunks_ = chunks_;
+            sweepChunk_ = 0;
+            credit_ = 0;
+        }
+
+        /**
+         * @brief Clears the pending chunks for at most the given amount of
+         * bytes, plus whatever was left over from the previous calls.
+         *
+         * @param bytes
+         */
+        void Sweep(size_t bytes)
+        {
+            if (!pendingChunks_)
+            {
+                return;
+            }
+
+            credit_ += bytes;
+            size_t chunkBytes = Storage::kBytes * (static_cast<size_t>(1) << chunkShift_);
+            while (credit_ >= chunkBytes && pendingChunks_)
+            {
+                // Skip the chunks already cleared by a write.
+                while (!pending_[sweepChunk_])
+                {
+                    sweepChunk_++;
+                }
+                ClearChunk(sweepChunk_);
+                credit_ -= chunkBytes;
+            }
+            if (!pendingChunks_)
+            {
+                credit_ = 0;
+            }
+        }
+
+        /**
+         * @brief Clears the chunk of the given index right away, if it's
+         * pending. This must be called before writing in the buffer.
+         *
+         * @param index
+         */
+        inline void Touch(int32_t index)
+        {
+            if (pendingChunks_ && pending_[index >> chunkShift_])
+            {
+                ClearChunk(index >> chunkShift_);
+            }
+        }
+
+        inline bool IsActive() const { return pendingChunks_ > 0; }
+
+        /**
+         * @brief Whether the sample at the given index still has to be
+         * cleared, meaning that it should be read as silence.
+         *
+         * @param index
+         * @return true
+         * @return false
+         */
+        inline bool IsPending(int32_t index) const
+        {
+            return pending_[index >> chunkShift_];
+        }
+
+    private:
+        void ClearChunk(int32_t chunk)
+        {
+            int32_t start = chunk << chunkShift_;
+            int32_t samples = std::min(1 << chunkShift_, maxBufferSamples_ - start);
+            // All the storages represent silence with zeroed bytes.
+            std::memset(Storage::At(buffer_, start), 0, samples * Storage::kBytes);
+            pending_[chunk] = false;
+            pendingChunks_--;
+        }
+
+        Sample *buffer_{};
+        int32_t maxBufferSamples_{};
+        int32_t chunkShift_{kMinChunkShift};
+        int32_t chunks_{};
+        bool pending_[kMaxChunks]{};
+        int32_t pendingChunks_{};
+        int32_t sweepChunk_{};
+        size_t credit_{};
+    };
+
+    using BufferClearer = BasicBufferClearer<>;
+} // namespace wreath
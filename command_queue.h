@@ -0,0 +1,123 @@
+#pragma once
+
+#include "prefetch.h"
+#include <atomic>
+#include <cstddef>
+
+namespace wreath
+{
+    /**
+     * @brief A bounded single-producer/single-consumer queue. Pushing and
+     * popping are wait-free, so the control thread can send commands to the
+     * audio thread without locks and without ever blocking it.
+     *
+     * Only one thread may push and only one thread may pop. The items are
+     * copied in and out, keep them small and trivially copyable.
+     *
+     * @tparam T the type of the items
+     * @tparam kCapacity the maximum number of items, a power of two
+     */
+    template <typename T, size_t kCapacity>
+    class CommandQueue
+    {
+    public:
+        CommandQueue() {}
+        ~CommandQueue() {}
+
+        static_assert(kCapacity && !(kCapacity & (kCapacity - 1)), "The capacity must be a power of two");
+
+        /**
+         * @brief Adds an item at the back of the queue. Producer only.
+         *
+         * @param item
+         * @return true
+         * @return false if the queue is full, the item has not been added
+         */
+        bool Push(const T &item)
+        {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) == kCapacity)
+            {
+                return false;
+            }
+            items_[tail & kMask] = item;
+            tail_.store(tail + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        /**
+         * @brief Returns the item at the front of the queue without removing
+         * it. Consumer only.
+         *
+         * @return const T* null if the queue is empty
+         */
+        const T *Peek() const
+        {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire))
+            {
+                return nullptr;
+            }
+
+            return &items_[head & kMask];
+        }
+
+        /**
+         * @brief Removes the item at the front of the queue, which must have
+         * been peeked. Consumer only.
+         */
+        void Pop()
+        {
+            head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**
+         * @brief Moves the item at the front of the queue into the given one.
+         * Consumer only.
+         *
+         * @param item
+         * @return true
+         * @return false if the queue is empty
+         */
+        bool Pop(T &item)
+        {
+            const T *front = Peek();
+            if (!front)
+            {
+                return false;
+            }
+            item = *front;
+            Pop();
+
+            return true;
+        }
+
+        /**
+         * @brief The number of items in the queue. It's exact only when
+         * called from one of the two threads while the other is idle.
+         *
+         * @return size_t
+         */
+        inline size_t Size() const
+        {
+            return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+        }
+
+        inline bool IsEmpty() const { return !Size(); }
+
+    private:
+        static constexpr size_t kMask{kCapacity - 1};
+
+        // The indices only grow, the items are at their value modulo the
+        // capacity. Each one is written by a single thread, so they live on
+        // separate cache lines.
+        alignas(kCacheLineBytes) std::atomic<size_t> head_{};
+        alignas(kCacheLineBytes) std::atomic<size_t> tail_{};
+        T items_[kCapacity]{};
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <typename T, size_t kCapacity>
+    constexpr size_t CommandQueue<T, kCapacity>::kMask;
+} // namespace wreath
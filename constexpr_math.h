@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+namespace wreath
+{
+    constexpr double kPi{3.14159265358979323846};
+
+    /**
+     * @brief Compile time sine, used to generate the lookup tables. It reduces
+     * the argument to [-pi, pi] and then sums the Taylor series until the
+     * terms vanish, which is exact to double precision.
+     *
+     * @param x
+     * @return double
+     */
+    constexpr double ConstexprSin(double x)
+    {
+        int64_t turns = static_cast<int64_t>(x / (2 * kPi));
+        x -= turns * 2 * kPi;
+        if (x > kPi)
+        {
+            x -= 2 * kPi;
+        }
+        else if (x < -kPi)
+        {
+            x += 2 * kPi;
+        }
+
+        double term = x;
+        double sum = x;
+        for (int32_t n = 1; n < 20; n++)
+        {
+            term *= -x * x / ((2 * n) * (2 * n + 1));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    constexpr double ConstexprCos(double x)
+    {
+        return ConstexprSin(x + kPi / 2);
+    }
+} // namespace wreath
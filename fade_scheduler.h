@@ -0,0 +1,153 @@
+#pragma once
+
+#include "fader.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    /**
+     * @brief Owns the faders of a class and keeps track of the active ones,
+     * so that the common case of nothing fading takes a single check.
+     *
+     * The active fades are the bits of a mask: testing any subset of them is
+     * one comparison. When a fade ends, it's removed from the mask and then
+     * its callback, if any, is called on the owner, that can start other
+     * fades from there.
+     *
+     * @tparam Owner the class the callbacks belong to
+     * @tparam kFades the number of fades, at most 32
+     */
+    template <typename Owner, int32_t kFades>
+    class FadeScheduler
+    {
+    public:
+        FadeScheduler() {}
+        ~FadeScheduler() {}
+
+        static_assert(kFades <= 32, "The active fades must fit in the mask");
+
+        using Callback = void (Owner::*)();
+
+        void Init(Owner *owner)
+        {
+            owner_ = owner;
+            active_ = 0;
+        }
+
+        /**
+         * @brief Sets the method of the owner to call when the given fade
+         * ends.
+         *
+         * @param fade
+         * @param callback
+         */
+        void SetCallback(int32_t fade, Callback callback)
+        {
+            callbacks_[fade] = callback;
+        }
+
+        /**
+         * @brief Starts the given fade, unless it's already going.
+         *
+         * @param fade
+         * @param type
+         * @param samples
+         * @param rate
+         */
+        void Start(int32_t fade, Fader::FadeType type, float samples, float rate)
+        {
+            faders_[fade].Init(type, samples, rate);
+            if (faders_[fade].IsActive())
+            {
+                active_ |= Bit(fade);
+            }
+        }
+
+        inline bool IsIdle() const { return !active_; }
+        inline bool IsActive(int32_t fade) const { return active_ & Bit(fade); }
+
+        /**
+         * @brief Whether any of the given fades is active.
+         *
+         * @param fades the mask of the fades
+         * @return true
+         * @return false
+         */
+        inline bool IsAnyActive(uint32_t fades) const { return active_ & fades; }
+
+        static constexpr uint32_t Bit(int32_t fade) { return 1u << fade; }
+
+        /**
+         * @brief Returns how many more samples the given fade processes before
+         * ending, up to the given maximum.
+         * @see Fader::SamplesToEnd()
+         *
+         * @param fade
+         * @param max
+         * @return size_t
+         */
+        inline size_t SamplesToEnd(int32_t fade, size_t max) { return faders_[fade].SamplesToEnd(max); }
+
+        /**
+         * @brief Processes a sample of the given fade, which must be active.
+         *
+         * @tparam T float or Frame
+         * @param fade
+         * @param from
+         * @param to
+         * @return T the faded sample
+         */
+        template <typename T>
+        inline T Process(int32_t fade, T from, T to)
+        {
+            T output{};
+            if (Fader::FadeStatus::ENDED == faders_[fade].Process(from, to, output))
+            {
+                End(fade);
+            }
+
+            return output;
+        }
+
+        /**
+         * @brief Processes a block of the given fade, which must be active.
+         * @see Fader::ProcessBlock()
+         *
+         * @tparam T float or Frame
+         * @param fade
+         * @param from
+         * @param to
+         * @param out
+         * @param size
+         * @return size_t the number of samples processed
+         */
+        template <typename T>
+        size_t ProcessBlock(int32_t fade, const T *from, const T *to, T *out, size_t size)
+        {
+            Fader &fader = faders_[fade];
+            size_t done = fader.ProcessBlock(from, to, out, size);
+            if (!fader.IsActive())
+            {
+                End(fade);
+            }
+
+            return done;
+        }
+
+    private:
+        void End(int32_t fade)
+        {
+            active_ &= ~Bit(fade);
+            if (callbacks_[fade])
+            {
+                (owner_->*callbacks_[fade])();
+            }
+        }
+
+        Owner *owner_{};
+        Fader faders_[kFades]{};
+        Callback callbacks_[kFades]{};
+        uint32_t active_{};
+    };
+} // namespace wreath
@@ -1,12 +1,80 @@
 #pragma once
 
+#include "constexpr_math.h"
+#include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
 
 namespace wreath
 {
     constexpr float kSamplesToFade{48.f * 100};       // 100ms @ 48KHz
     constexpr float kSamplesToFadeTrigger{48.f * 10}; // 10ms @ 48KHz
     constexpr float kEqualCrossFadeP{1.25f};
+    constexpr int32_t kFadeTableSize{1024};
+
+    /**
+     * @brief The shapes of the crossfades. All of them are symmetrical, so
+     * the fading out gain at a position is the fading in gain at the mirrored
+     * position.
+     */
+    enum class FadeCurve
+    {
+        EQUAL_POWER,       // Sine and cosine
+        ENERGY_PRESERVING, // @see https://signalsmith-audio.co.uk/writing/2021/cheap-energy-crossfade/
+        LINEAR,
+        S_CURVE, // Raised cosine
+    };
+
+    /**
+     * @brief The fading in gains of a curve, sampled at compile time.
+     */
+    struct FadeTable
+    {
+        float gains[kFadeTableSize + 1]{};
+    };
+
+    constexpr double FadeGain(FadeCurve curve, double pos)
+    {
+        switch (curve)
+        {
+        case FadeCurve::EQUAL_POWER:
+            return ConstexprSin(pos * kPi / 2);
+        case FadeCurve::ENERGY_PRESERVING:
+        {
+            double k = -6.0026608 + kEqualCrossFadeP * (6.8773512 - 1.5838104 * kEqualCrossFadeP);
+            double a = pos * (1 - pos);
+            double c = a * (1 + k * a) + pos;
+
+            return c * c;
+        }
+        case FadeCurve::S_CURVE:
+            return 0.5 - 0.5 * ConstexprCos(pos * kPi);
+        default:
+            return pos;
+        }
+    }
+
+    constexpr FadeTable MakeFadeTable(FadeCurve curve)
+    {
+        FadeTable table{};
+        for (int32_t i = 0; i <= kFadeTableSize; i++)
+        {
+            table.gains[i] = static_cast<float>(FadeGain(curve, i / static_cast<double>(kFadeTableSize)));
+        }
+
+        return table;
+    }
+
+    template <FadeCurve kCurve>
+    struct FadeCurveTable
+    {
+        static constexpr FadeTable kTable{MakeFadeTable(kCurve)};
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <FadeCurve kCurve>
+    constexpr FadeTable FadeCurveTable<kCurve>::kTable;
 
     /**
      * @brief Handles different types of cross-fading between two sources.
@@ -65,6 +133,69 @@ namespace wreath
             }
         }
 
+        /**
+         * @brief Returns the gains table of the given curve.
+         *
+         * @param curve
+         * @return const float*
+         */
+        static const float *Gains(FadeCurve curve)
+        {
+            switch (curve)
+            {
+            case FadeCurve::EQUAL_POWER:
+                return FadeCurveTable<FadeCurve::EQUAL_POWER>::kTable.gains;
+            case FadeCurve::LINEAR:
+                return FadeCurveTable<FadeCurve::LINEAR>::kTable.gains;
+            case FadeCurve::S_CURVE:
+                return FadeCurveTable<FadeCurve::S_CURVE>::kTable.gains;
+            default:
+                return FadeCurveTable<FadeCurve::ENERGY_PRESERVING>::kTable.gains;
+            }
+        }
+
+        /**
+         * @brief Crossfades using the given gains table, interpolating
+         * between its entries.
+         *
+         * @tparam T float or Frame
+         * @param gains
+         * @param from
+         * @param to
+         * @param pos the position in the fade, between 0 and 1
+         * @return T
+         */
+        template <typename T>
+        static inline T CrossFade(const float *gains, T from, T to, float pos)
+        {
+            float position = pos * kFadeTableSize;
+            int32_t index = static_cast<int32_t>(position);
+            index = index < 0 ? 0 : (index > kFadeTableSize - 1 ? kFadeTableSize - 1 : index);
+            float t = position - index;
+            // The fading out gain is the fading in one, mirrored.
+            int32_t mirror = kFadeTableSize - index;
+            float in = gains[index] + (gains[index + 1] - gains[index]) * t;
+            float out = gains[mirror] + (gains[mirror - 1] - gains[mirror]) * t;
+
+            return from * out + to * in;
+        }
+
+        /**
+         * @brief Crossfades with the given curve.
+         *
+         * @tparam kCurve
+         * @tparam T float or Frame
+         * @param from
+         * @param to
+         * @param pos
+         * @return T
+         */
+        template <FadeCurve kCurve, typename T>
+        static inline T CrossFade(T from, T to, float pos)
+        {
+            return CrossFade(FadeCurveTable<kCurve>::kTable.gains, from, to, pos);
+        }
+
         /**
          * @brief Equal-power crossfade.
          *
@@ -75,10 +206,7 @@ namespace wreath
          */
         static float CrossFade(float from, float to, float pos)
         {
-            float in = std::sin(pos * 1.570796326794897);
-            float out = std::sin((1.f - pos) * 1.570796326794897);
-
-            return from * out + to * in;
+            return CrossFade<FadeCurve::EQUAL_POWER>(from, to, pos);
         }
 
         /**
@@ -98,21 +226,16 @@ namespace wreath
          * @brief Energy preserving crossfade
          * @see https://signalsmith-audio.co.uk/writing/2021/cheap-energy-crossfade/
          *
+         * @tparam T float or Frame
          * @param from
          * @param to
          * @param pos
-         * @return float
+         * @return T
          */
-        static float EqualCrossFade(float from, float to, float pos)
+        template <typename T>
+        static T EqualCrossFade(T from, T to, float pos)
         {
-            float invPos = 1.f - pos;
-            float k = -6.0026608f + kEqualCrossFadeP * (6.8773512f - 1.5838104f * kEqualCrossFadeP);
-            float a = pos * invPos;
-            float b = a * (1.f + k * a);
-            float c = (b + pos);
-            float d = (b + invPos);
-
-            return from * d * d + to * c * c;
+            return CrossFade<FadeCurve::ENERGY_PRESERVING>(from, to, pos);
         }
 
         /**
@@ -126,6 +249,22 @@ namespace wreath
         {
             input_ = fromInput;
 
+            return Process(fromInput, toInput, output_);
+        }
+
+        /**
+         * @brief Processes the crossfade of the provided inputs, samples or
+         * frames, into the given output.
+         *
+         * @tparam T float or Frame
+         * @param fromInput
+         * @param toInput
+         * @param output left untouched if the fade is not going
+         * @return FadeStatus
+         */
+        template <typename T>
+        FadeStatus Process(T fromInput, T toInput, T &output)
+        {
             if (FadeStatus::CREATED == status_)
             {
                 return status_;
@@ -137,32 +276,73 @@ namespace wreath
 
             status_ = FadeStatus::FADING;
 
-            float from = fromInput;
-            float to = toInput;
+            T from = fromInput;
+            T to = toInput;
             if (toggle_)
             {
                 from = toInput;
                 to = fromInput;
             }
-            output_ = EqualCrossFade(from, to, index_ * freq_);
+            output = CrossFade(gains_, from, to, index_ * freq_);
             index_ += rate_;
-            if (index_ >= samples_)
+            EndSegment();
+
+            return status_;
+        }
+
+        /**
+         * @brief Processes the crossfade of the provided blocks, until the
+         * fade ends or the block does. The samples after the end of the fade
+         * are left untouched.
+         *
+         * @tparam T float or Frame
+         * @param from the block fading out, silence if null
+         * @param to the block fading in, silence if null
+         * @param out the output, it can be one of the inputs
+         * @param size
+         * @return size_t the number of samples processed
+         */
+        template <typename T>
+        size_t ProcessBlock(const T *from, const T *to, T *out, size_t size)
+        {
+            size_t done{};
+            while (done < size && IsActive())
             {
-                if (FadeType::FADE_OUT_IN == type_)
+                status_ = FadeStatus::FADING;
+
+                // The samples left in the current segment of the fade.
+                size_t span = size - done;
+                if (rate_ > 0.f)
                 {
-                    index_ = 0;
-                    toggle_ = true;
-                    type_ = FadeType::FADE_SINGLE;
+                    float left = std::ceil((samples_ - index_) / rate_);
+                    span = left < span ? std::max(static_cast<size_t>(left), static_cast<size_t>(1)) : span;
                 }
-                else
+
+                const T *a = toggle_ ? to : from;
+                const T *b = toggle_ ? from : to;
+                float pos = index_ * freq_;
+                float step = rate_ * freq_;
+                for (size_t i = 0; i < span; i++)
                 {
-                    status_ = FadeStatus::ENDED;
+                    out[done + i] = CrossFade(gains_, a ? a[done + i] : T{}, b ? b[done + i] : T{}, pos + i * step);
                 }
-
-                return status_;
+                SetOutput(out[done + span - 1]);
+                index_ += span * rate_;
+                done += span;
+                EndSegment();
             }
 
-            return status_;
+            return done;
+        }
+
+        /**
+         * @brief Sets the shape of the crossfade.
+         *
+         * @param curve
+         */
+        void SetCurve(FadeCurve curve)
+        {
+            gains_ = Gains(curve);
         }
 
         float GetIndex()
@@ -185,7 +365,55 @@ namespace wreath
             return FadeStatus::PENDING == status_ || FadeStatus::FADING == status_;
         }
 
+        /**
+         * @brief Returns how many more samples are processed before the fade
+         * ends, counting the one it ends at, up to the given maximum.
+         *
+         * @param max
+         * @return size_t
+         */
+        size_t SamplesToEnd(size_t max)
+        {
+            if (!IsActive() || rate_ <= 0.f)
+            {
+                return max;
+            }
+
+            float left = std::max(std::ceil((samples_ - index_) / rate_), 1.f);
+            if (FadeType::FADE_OUT_IN == type_)
+            {
+                left += std::ceil(samples_ / rate_);
+            }
+
+            return left < max ? static_cast<size_t>(left) : max;
+        }
+
     private:
+        inline void SetOutput(float output) { output_ = output; }
+
+        // Only the samples are kept as the output.
+        template <typename T>
+        inline void SetOutput(const T &) {}
+
+        void EndSegment()
+        {
+            if (index_ < samples_)
+            {
+                return;
+            }
+            if (FadeType::FADE_OUT_IN == type_)
+            {
+                index_ = 0;
+                toggle_ = true;
+                type_ = FadeType::FADE_SINGLE;
+            }
+            else
+            {
+                status_ = FadeStatus::ENDED;
+            }
+        }
+
+        const float *gains_{Gains(FadeCurve::ENERGY_PRESERVING)};
         FadeType type_{FadeType::FADE_SINGLE};
         FadeStatus status_{FadeStatus::CREATED};
         float index_{};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+namespace wreath
+{
+    /**
+     * @brief The samples of all the channels at the same position, the value
+     * read and written by the heads of a linked looper. It has the arithmetic
+     * of a float, applied channel by channel, so the interpolators, the fades
+     * and the heads process frames with the very same code as the samples.
+     *
+     * @tparam kChannels
+     */
+    template <int32_t kChannels>
+    struct Frame
+    {
+        float channels[kChannels]{};
+
+        inline float &operator[](int32_t channel) { return channels[channel]; }
+        inline const float &operator[](int32_t channel) const { return channels[channel]; }
+
+        inline Frame &operator+=(const Frame &other)
+        {
+            for (int32_t channel = 0; channel < kChannels; channel++)
+            {
+                channels[channel] += other.channels[channel];
+            }
+
+            return *this;
+        }
+
+        inline Frame &operator-=(const Frame &other)
+        {
+            for (int32_t channel = 0; channel < kChannels; channel++)
+            {
+                channels[channel] -= other.channels[channel];
+            }
+
+            return *this;
+        }
+
+        inline Frame &operator*=(float gain)
+        {
+            for (int32_t channel = 0; channel < kChannels; channel++)
+            {
+                channels[channel] *= gain;
+            }
+
+            return *this;
+        }
+    };
+
+    template <int32_t kChannels>
+    inline Frame<kChannels> operator+(Frame<kChannels> a, const Frame<kChannels> &b)
+    {
+        return a += b;
+    }
+
+    template <int32_t kChannels>
+    inline Frame<kChannels> operator-(Frame<kChannels> a, const Frame<kChannels> &b)
+    {
+        return a -= b;
+    }
+
+    template <int32_t kChannels>
+    inline Frame<kChannels> operator*(Frame<kChannels> a, float gain)
+    {
+        return a *= gain;
+    }
+
+    template <int32_t kChannels>
+    inline Frame<kChannels> operator*(float gain, Frame<kChannels> a)
+    {
+        return a *= gain;
+    }
+
+    using StereoFrame = Frame<2>;
+} // namespace wreath
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "buffer_clearer.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace wreath
+{
+    /**
+     * @brief Takes a copy-on-write snapshot of a loop region of the main
+     * buffer in the freeze buffer, when freezing starts.
+     *
+     * The region is copied a few chunks at a time, starting from the reading
+     * position and moving in the reading direction. Until a chunk is copied,
+     * its frozen samples are read straight from the main buffer, and writing
+     * in the main buffer copies the chunk first, so the snapshot is always
+     * the content of the region at the moment freezing started.
+     *
+     * The region is stored from the start of the freeze buffer, so the
+     * freeze buffer only needs to be as long as the longest frozen loop.
+     *
+     * @tparam Storage the storage policy of the buffers
+     */
+    template <typename Storage = FloatStorage>
+    class BasicFreezeSnapshot
+    {
+    public:
+        BasicFreezeSnapshot() {}
+        ~BasicFreezeSnapshot() {}
+
+        using Sample = typename Storage::Sample;
+        using Value = typename Storage::Value;
+        using Clearer = BasicBufferClearer<Storage>;
+
+        static constexpr int32_t kMaxChunks{4096};
+        static constexpr int32_t kMinChunkShift{10}; // 1024 samples
+
+        /**
+         * @brief Initializes the snapshot.
+         *
+         * @param buffer the main buffer
+         * @param freezeBuffer the freeze buffer
+         * @param maxFreezeSamples the length of the freeze buffer
+         * @param clearer the clearer of the main buffer, the regions pending
+         * a clear are copied as silence
+         */
+        void Init(Sample *buffer, Sample *freezeBuffer, int32_t maxFreezeSamples, const Clearer *clearer)
+        {
+            buffer_ = buffer;
+            freezeBuffer_ = freezeBuffer;
+            maxFreezeSamples_ = maxFreezeSamples;
+            clearer_ = clearer;
+            active_ = false;
+        }
+
+        /**
+         * @brief Starts the snapshot of the given loop region. Regions longer
+         * than the freeze buffer are truncated, the rest of the loop is read
+         * from the main buffer.
+         *
+         * @param start the loop start in the main buffer
+         * @param length the loop length
+         * @param bufferSamples the length of the main buffer, for wrapping
+         * @param from the index where copying starts
+         * @param forward whether copying goes forward or backwards
+         */
+        void Start(int32_t start, int32_t length, int32_t bufferSamples, int32_t from, bool forward)
+        {
+            start_ = start;
+            bufferSamples_ = bufferSamples;
+            length_ = std::max(std::min(length, maxFreezeSamples_), 0);
+            chunkShift_ = kMinChunkShift;
+            while ((static_cast<int64_t>(kMaxChunks) << chunkShift_) < length_)
+            {
+                chunkShift_++;
+            }
+            chunks_ = (length_ + (1 << chunkShift_) - 1) >> chunkShift_;
+            std::fill(pending_, pending_ + chunks_, true);
+            pendingChunks_ = chunks_;
+            int32_t offset = Offset(from);
+            sweepChunk_ = offset < length_ ? offset >> chunkShift_ : 0;
+            sweepStep_ = forward ? 1 : -1;
+            credit_ = 0;
+            active_ = length_ > 0;
+        }
+
+        /**
+         * @brief Stops the snapshot, the frozen samples are read from the main
+         * buffer again.
+         */
+        void Stop()
+        {
+            active_ = false;
+        }
+
+        inline bool IsActive() const { return active_; }
+
+        /**
+         * @brief Copies the pending chunks for at most the given amount of
+         * bytes, plus whatever was left over from the previous calls.
+         *
+         * @param bytes
+         */
+        void Sweep(size_t bytes)
+        {
+            if (!active_ || !pendingChunks_)
+            {
+                return;
+            }
+
+            credit_ += bytes;
+            size_t chunkBytes = Storage::kBytes * (static_cast<size_t>(1) << chunkShift_);
+            while (credit_ >= chunkBytes && pendingChunks_)
+            {
+                // Skip the chunks already copied by a write.
+                while (!pending_[sweepChunk_])
+                {
+                    sweepChunk_ += sweepStep_;
+                    sweepChunk_ = sweepChunk_ < 0 ? chunks_ - 1 : (sweepChunk_ >= chunks_ ? 0 : sweepChunk_);
+                }
+                CopyChunk(sweepChunk_);
+                credit_ -= chunkBytes;
+            }
+            if (!pendingChunks_)
+            {
+                credit_ = 0;
+            }
+        }
+
+        /**
+         * @brief Returns the position in the freeze buffer of the frozen
+         * sample at the given index of the main buffer, or -1 if it must be
+         * read from the main buffer.
+         *
+         * @param index
+         * @return int32_t
+         */
+        inline int32_t Find(int32_t index) const
+        {
+            int32_t offset = Offset(index);
+            if (!active_ || offset >= length_ || pending_[offset >> chunkShift_])
+            {
+                return -1;
+            }
+
+            return offset;
+        }
+
+        inline Value Load(int32_t offset) const
+        {
+            return Storage::Load(freezeBuffer_, offset);
+        }
+
+        /**
+         * @brief Copies the chunk of the given index right away, if it's
+         * pending. This must be called before writing in the main buffer.
+         *
+         * @param index
+         */
+        inline void Touch(int32_t index)
+        {
+            int32_t offset = Offset(index);
+            if (active_ && offset < length_ && pending_[offset >> chunkShift_])
+            {
+                CopyChunk(offset >> chunkShift_);
+            }
+        }
+
+        /**
+         * @brief Writes in the snapshot at the given index of the main buffer,
+         * if the index is inside the frozen region.
+         *
+         * @param index
+         * @param value
+         */
+        inline void Write(int32_t index, const Value &value)
+        {
+            Touch(index);
+            int32_t offset = Offset(index);
+            if (active_ && offset < length_)
+            {
+                Storage::Store(freezeBuffer_, offset, value, random_);
+            }
+        }
+
+    private:
+        inline int32_t Offset(int32_t index) const
+        {
+            int32_t offset = index - start_;
+
+            return offset < 0 ? offset + bufferSamples_ : offset;
+        }
+
+        void CopyChunk(int32_t chunk)
+        {
+            int32_t from = chunk << chunkShift_;
+            int32_t to = std::min(from + (1 << chunkShift_), length_);
+            if (clearer_ && clearer_->IsActive())
+            {
+                for (int32_t offset = from; offset < to; offset++)
+                {
+                    int32_t index = Wrap(start_ + offset);
+                    std::memcpy(Storage::At(freezeBuffer_, offset), Storage::At(buffer_, index), Storage::kBytes);
+                    if (clearer_->IsPending(index))
+                    {
+                        std::memset(Storage::At(freezeBuffer_, offset), 0, Storage::kBytes);
+                    }
+                }
+            }
+            else
+            {
+                // The region may wrap around the end of the main buffer.
+                int32_t index = Wrap(start_ + from);
+                int32_t first = std::min(to - from, bufferSamples_ - index);
+                std::memcpy(Storage::At(freezeBuffer_, from), Storage::At(buffer_, index), first * Storage::kBytes);
+                std::memcpy(Storage::At(freezeBuffer_, from + first), buffer_, (to - from - first) * Storage::kBytes);
+            }
+            pending_[chunk] = false;
+            pendingChunks_--;
+        }
+
+        inline int32_t Wrap(int32_t index) const
+        {
+            return index >= bufferSamples_ ? index - bufferSamples_ : index;
+        }
+
+        Sample *buffer_{};
+        Sample *freezeBuffer_{};
+        const Clearer *clearer_{};
+        Random random_{}; // For the dither
+        int32_t maxFreezeSamples_{};
+        int32_t start_{};
+        int32_t length_{};
+        int32_t bufferSamples_{1};
+        int32_t chunkShift_{kMinChunkShift};
+        int32_t chunks_{};
+        bool pending_[kMaxChunks]{};
+        int32_t pendingChunks_{};
+        int32_t sweepChunk_{};
+        int32_t sweepStep_{1};
+        size_t credit_{};
+        bool active_{};
+    };
+
+    using FreezeSnapshot = BasicFreezeSnapshot<>;
+} // namespace wreath
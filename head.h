@@ -1,17 +1,37 @@
 #pragma once
 
+#include "buffer_clearer.h"
 #include "fader.h"
+#include "freeze_snapshot.h"
+#include "interpolator.h"
+#include "loop_cache.h"
+#include "phase.h"
+#include "prefetch.h"
+#include "random.h"
+#include "storage.h"
+#include "write_behind.h"
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
-#include <cstring>
 #include <limits>
+#include <type_traits>
 
 namespace wreath
 {
     constexpr float kMinLoopLengthSamples{46.f}; // ~C1 @ 48KHz
     constexpr float kMinSamplesForTone{91.f};    // ~C2 @ 48KHz
     constexpr float kMinSamplesForFlanger{1722.f};
+    constexpr int32_t kReadAheadSamples{512}; // Samples staged by each reading head
+
+    // Whether the fast reading heads stage their spans in a read-ahead ring,
+    // with any storage and interpolator. It's meant for the buffers in the
+    // external SDRAM, where the host timings don't tell the cost of a miss,
+    // so building with WREATH_READ_AHEAD turns it on.
+#if defined(WREATH_READ_AHEAD)
+    constexpr bool kReadAhead{true};
+#else
+    constexpr bool kReadAhead{false};
+#endif
 
     enum Type
     {
@@ -39,12 +59,24 @@ namespace wreath
      *
      * Inspired by Monome Softcut's subhead class:
      * https://github.com/monome/softcut-lib/blob/main/softcut-lib/src/SubHead.cpp
+     *
+     * @tparam Interpolator the policy used to read at fractional positions
+     * @tparam Storage the policy used to keep the samples in the buffer
+     * @tparam kStaging whether the fast reading heads stage their spans in a
+     * read-ahead ring, as set by the build
      */
-    class Head
+    template <typename Interpolator = LinearInterpolator, typename Storage = FloatStorage, bool kStaging = kReadAhead>
+    class BasicHead
     {
     public:
-        Head(Type type) : type_{type} {}
-        ~Head() {}
+        BasicHead(Type type) : type_{type} {}
+        ~BasicHead() {}
+
+        using Sample = typename Storage::Sample;
+        using Value = typename Storage::Value;
+        using Clearer = BasicBufferClearer<Storage>;
+        using Snapshot = BasicFreezeSnapshot<Storage>;
+        using Cache = BasicLoopCache<Interpolator, Storage>;
 
         enum class Action
         {
@@ -57,21 +89,24 @@ namespace wreath
         void Reset()
         {
             intIndex_ = 0;
-            index_ = 0.f;
+            index_ = Phase{};
             intLoopStart_ = 0;
             intLoopEnd_ = 0;
+            CompileLoop();
         }
 
-        void Init(float *buffer, float *buffer2, int32_t maxBufferSamples)
+        void Init(Sample *buffer, int32_t maxBufferSamples)
         {
             buffer_ = buffer;
-            freezeBuffer_ = buffer2;
+            readAhead_.Init(buffer);
+            writeBehind_.Init(buffer);
             maxBufferSamples_ = maxBufferSamples;
             rate_ = 1.f;
             looping_ = false;
             movement_ = Movement::NORMAL;
             direction_ = Direction::FORWARD;
             samplesToFade_ = std::min(kSamplesToFade, loopLength_ / 2.f);
+            UpdateStep();
             Reset();
         }
 
@@ -80,6 +115,7 @@ namespace wreath
             loopStart_ = start;
             intLoopStart_ = loopStart_;
             CalculateLoopEnd();
+            CompileLoop();
             if (!looping_)
             {
                 ResetPosition();
@@ -93,6 +129,7 @@ namespace wreath
             intLoopLength_ = loopLength_;
             CalculateLoopEnd();
             samplesToFade_ = std::min(kSamplesToFade, loopLength_ / 2.f);
+            CompileLoop();
 
             return loopLength_;
         }
@@ -105,6 +142,7 @@ namespace wreath
             intLoopLength_ = loopLength_;
             CalculateLoopEnd();
             samplesToFade_ = std::min(kSamplesToFade, loopLength_ / 2.f);
+            CompileLoop();
         }
 
         inline void SetFreeze(float amount)
@@ -132,24 +170,75 @@ namespace wreath
             }
         }
 
+        /**
+         * @brief Whether the recording in the freeze buffer is fading out.
+         *
+         * @return true
+         * @return false
+         */
+        inline bool IsFreezing() { return mustFreeze_; }
+
         inline void SetRate(float rate)
         {
             rate_ = std::abs(rate);
+            UpdateStep();
         }
+        /**
+         * @brief Sets the clearer shared by the heads of the same buffers, so
+         * that the regions pending a clear are read as silence.
+         *
+         * @param clearer
+         */
+        inline void SetClearer(Clearer *clearer)
+        {
+            clearer_ = clearer;
+        }
+
+        /**
+         * @brief Sets the snapshot shared by the heads of the same buffers,
+         * where the frozen samples are read and written.
+         *
+         * @param snapshot
+         */
+        inline void SetSnapshot(Snapshot *snapshot)
+        {
+            snapshot_ = snapshot;
+        }
+
+        /**
+         * @brief Sets the cache of the short loops shared by the heads of the
+         * same buffer. The reading heads read from it when it covers their
+         * loop, the writing head keeps it coherent.
+         *
+         * @param cache
+         */
+        inline void SetCache(Cache *cache)
+        {
+            cache_ = cache;
+        }
+
         inline void SetMovement(Movement movement)
         {
             movement_ = movement;
+            CompileLoop();
         }
 
         inline void SetDirection(Direction direction)
         {
             direction_ = direction;
+            UpdateStep();
+            CompileLoop();
         }
 
         inline void SetIndex(float index)
+        {
+            SetIndex(Phase::FromFloat(index));
+        }
+
+        inline void SetIndex(Phase index)
         {
             index_ = index;
-            intIndex_ = std::floor(index_);
+            intIndex_ = index_.Int();
         }
 
         inline void SetOffset(float offset)
@@ -174,17 +263,21 @@ namespace wreath
                 return Action::NO_ACTION;
             }
 
-            float index = index_ + (rate_ * direction_);
-            SetIndex(index);
+            SetIndex(index_ + step_);
             Action action = HandleLoopAction();
 
-            if (intIndex_ >= bufferSamples_)
+            // Power of two buffers wrap both ways with a mask.
+            if (loop_.mask)
+            {
+                SetIndex(Phase::FromRaw(index_.Raw() & ((static_cast<int64_t>(loop_.mask) << Phase::kFracBits) | Phase::kFracMask)));
+            }
+            else if (intIndex_ >= bufferSamples_)
             {
-                SetIndex(index_ - bufferSamples_);
+                SetIndex(index_ - Phase::FromInt(bufferSamples_));
             }
             else if (intIndex_ < 0)
             {
-                SetIndex(bufferSamples_ + index_);
+                SetIndex(index_ + Phase::FromInt(bufferSamples_));
             }
 
             switch (action)
@@ -203,6 +296,214 @@ namespace wreath
             return action;
         }
 
+        /**
+         * @brief Returns how many times the head can be read and moved before
+         * it needs to handle a loop action, a buffer wrap or an interpolation
+         * that crosses the loop boundaries, none while the buffers are being
+         * cleared.
+         *
+         * @return int32_t
+         */
+        int32_t SamplesToNextAction()
+        {
+            // Check every sample while the buffers are being cleared.
+            if (IsClearing())
+            {
+                return 0;
+            }
+
+            return SamplesToBoundary();
+        }
+
+        /**
+         * @brief Returns how many times the head can be moved before it needs
+         * to handle a loop action, a buffer wrap or an interpolation that
+         * crosses the loop boundaries, so that up to there its positions, and
+         * their taps, follow each other in a straight line.
+         *
+         * @return int32_t
+         */
+        int32_t SamplesToBoundary()
+        {
+            if (!active_ || step_ == Phase{})
+            {
+                return std::numeric_limits<int32_t>::max();
+            }
+
+            // The region where reading and moving don't need any check is the
+            // loop segment the head is in, minus the interpolation taps and
+            // the samples that would trigger an action.
+            int32_t segment = loop_.Segment(intIndex_);
+            Phase lo = Phase::FromInt(loop_.start[segment] + Interpolator::kBefore);
+            Phase hi = Phase::FromInt(loop_.end[segment] - Interpolator::kAfter);
+            if (index_ >= loop_.actionLo && index_ <= loop_.actionHi)
+            {
+                return 0;
+            }
+            if (step_ > Phase{} && loop_.actionLo > index_)
+            {
+                hi = std::min(hi, loop_.actionLo - Phase::FromRaw(1));
+            }
+            else if (step_ < Phase{} && loop_.actionHi < index_)
+            {
+                lo = std::max(lo, loop_.actionHi + Phase::FromRaw(1));
+            }
+            if (index_ < lo || index_ > hi)
+            {
+                return 0;
+            }
+
+            // The stepping is exact, so the room is too.
+            int64_t room = step_ > Phase{} ? (hi - index_).Raw() / step_.Raw() : (index_ - lo).Raw() / -step_.Raw();
+
+            return static_cast<int32_t>(std::min(room, static_cast<int64_t>(std::numeric_limits<int32_t>::max() / 2)));
+        }
+
+        /**
+         * @brief Reads and moves the head for the given number of samples,
+         * stopping right after a loop action occurs so that the caller can
+         * handle it. Between actions, the samples are processed in a tight
+         * loop without any boundary check.
+         *
+         * @param out
+         * @param size
+         * @param action
+         * @return size_t the number of samples processed
+         */
+        size_t ReadBlock(Value *out, size_t size, Action &action)
+        {
+            action = Action::NO_ACTION;
+            // The buffer may have been written since the last block.
+            readAhead_.Invalidate();
+            size_t done{};
+            while (done < size)
+            {
+                size_t span = std::min(size - done, static_cast<size_t>(SamplesToNextAction()));
+                if (span > 0)
+                {
+                    int64_t step = active_ ? step_.Raw() : 0;
+                    int64_t index = index_.Raw();
+                    // The span stays in the loop segment, so the whole of it
+                    // can be read from the cache when that covers the segment.
+                    int32_t segment = loop_.Segment(intIndex_);
+                    if (cache_ && cache_->Covers(loop_.start[segment], loop_.end[segment]))
+                    {
+                        for (size_t i = 0; i < span; i++)
+                        {
+                            int32_t intPos = index >> Phase::kFracBits;
+                            uint32_t fracBits = index & Phase::kFracMask;
+                            float frac = (fracBits >> 8) * (1.f / (1 << 24));
+                            out[done + i] = fracBits ? cache_->Interpolate(intPos - Interpolator::kBefore, frac) : cache_->Load(intPos);
+                            index += step;
+                        }
+                    }
+                    else if (ReadsAhead(step))
+                    {
+                        span = StageSpan(index, step, span);
+                        for (size_t i = 0; i < span; i++)
+                        {
+                            int32_t intPos = index >> Phase::kFracBits;
+                            uint32_t fracBits = index & Phase::kFracMask;
+                            float frac = (fracBits >> 8) * (1.f / (1 << 24));
+                            out[done + i] = fracBits ? readAhead_.Interpolate(intPos - Interpolator::kBefore, frac) : readAhead_.Load(intPos);
+                            index += step;
+                        }
+                    }
+                    else
+                    {
+                        for (size_t i = 0; i < span; i++)
+                        {
+                            int32_t intPos = index >> Phase::kFracBits;
+                            uint32_t fracBits = index & Phase::kFracMask;
+                            float frac = (fracBits >> 8) * (1.f / (1 << 24));
+                            out[done + i] = fracBits ? Storage::template Interpolate<Interpolator>(buffer_, intPos - Interpolator::kBefore, frac) : Storage::Load(buffer_, intPos);
+                            index += step;
+                        }
+                    }
+                    SetIndex(Phase::FromRaw(index));
+                    done += span;
+                    continue;
+                }
+
+                out[done++] = Read();
+                action = UpdatePosition();
+                if (Action::NO_ACTION != action)
+                {
+                    break;
+                }
+            }
+
+            return done;
+        }
+
+        /**
+         * @brief Writes and moves the head for the given number of samples,
+         * stopping right after a loop action occurs so that the caller can
+         * handle it. Between actions, and when no freeze fade is going on,
+         * the samples are processed in a tight loop without any boundary
+         * check. There, when built with kWriteBehind, the heads moving by at
+         * most one sample per write store the contiguous runs in bursts, all
+         * flushed before returning.
+         *
+         * @param in
+         * @param size
+         * @param action
+         * @return size_t the number of samples processed
+         */
+        size_t WriteBlock(const Value *in, size_t size, Action &action)
+        {
+            action = Action::NO_ACTION;
+            size_t done{};
+            while (done < size)
+            {
+                size_t span = mustFreeze_ || mustUnfreeze_ ? 0 : std::min(size - done, static_cast<size_t>(SamplesToNextAction()));
+                if (span > 0)
+                {
+                    int64_t step = active_ ? step_.Raw() : 0;
+                    int64_t index = index_.Raw();
+                    bool snapshotting = snapshot_ && snapshot_->IsActive();
+                    bool caching = cache_ && cache_->IsValid();
+                    if (kBurstsWrites && step <= kOneSampleStep && step >= -kOneSampleStep)
+                    {
+                        for (size_t i = 0; i < span;)
+                        {
+                            i += writeBehind_.Gather(in + done + i, span - i, index, step, dither_);
+                            FlushWriteBehind(snapshotting, caching);
+                        }
+                    }
+                    else
+                    {
+                        for (size_t i = 0; i < span; i++)
+                        {
+                            int32_t intPos = index >> Phase::kFracBits;
+                            if (snapshotting)
+                            {
+                                snapshot_->Touch(intPos);
+                            }
+                            Storage::Store(buffer_, intPos, in[done + i], dither_);
+                            if (caching)
+                            {
+                                cache_->Update(intPos);
+                            }
+                            index += step;
+                        }
+                    }
+                    SetIndex(Phase::FromRaw(index));
+                    done += span;
+                    continue;
+                }
+
+                Write(in[done++]);
+                action = UpdatePosition();
+                if (Action::NO_ACTION != action)
+                {
+                    break;
+                }
+            }
+
+            return done;
+        }
+
         float GetSamplesToFade()
         {
             return samplesToFade_;
@@ -211,16 +512,30 @@ namespace wreath
         void SetSamplesToFade(float samples)
         {
             samplesToFade_ = loopLength_ ? std::min(samples, loopLength_ / 2.f) : samples;
+            CompileLoop();
         }
 
-        float ReadFrozen()
+        Value ReadFrozen()
         {
-            return frozen_ ? ReadAt(freezeBuffer_, index_) : 0;
+            if (!frozen_)
+            {
+                return Value{};
+            }
+            // Without a snapshot, the frozen samples are the same of the main
+            // buffer.
+            if (!snapshot_ || !snapshot_->IsActive())
+            {
+                return Read();
+            }
+
+            return ReadAt(index_, false, [this](int32_t index)
+                          { return FetchFrozen(index); });
         }
 
-        float Read()
+        Value Read()
         {
-            return ReadAt(buffer_, index_);
+            return ReadAt(index_, !IsClearing(), [this](int32_t index)
+                          { return Fetch(index); });
         }
 
         bool toggleOnset{true};
@@ -229,6 +544,51 @@ namespace wreath
          * @brief Bresenham implementation of an Euclidean Rhythm Algorithm.
          */
         bool BresenhamEuclidean(float pulses, float onsetAmount)
+        {
+            return BresenhamEuclidean(pulses, onsetAmount, index_);
+        }
+
+        /**
+         * @brief Runs the rhythm generator over the positions the head takes
+         * in the next samples at its current step, as the per-sample calls
+         * would. Only the buffer wrap is followed, the samples after a loop
+         * action within the span are gated as if the head went on.
+         *
+         * @param pulses
+         * @param onsetAmount
+         * @param index the first position, the head's one to start with
+         * @param onsets the result for each sample
+         * @param size
+         * @return Phase the position following the span
+         */
+        Phase BresenhamEuclidean(float pulses, float onsetAmount, Phase index, bool *onsets, size_t size)
+        {
+            Phase step = active_ ? step_ : Phase{};
+            for (size_t i = 0; i < size; i++)
+            {
+                onsets[i] = BresenhamEuclidean(pulses, onsetAmount, index);
+                index += step;
+                if (loop_.mask)
+                {
+                    index = Phase::FromRaw(index.Raw() & ((static_cast<int64_t>(loop_.mask) << Phase::kFracBits) | Phase::kFracMask));
+                }
+                else if (index.Int() >= bufferSamples_)
+                {
+                    index -= Phase::FromInt(bufferSamples_);
+                }
+                else if (index.Int() < 0)
+                {
+                    index += Phase::FromInt(bufferSamples_);
+                }
+            }
+
+            return index;
+        }
+
+        /**
+         * @brief Runs the rhythm generator at the given position.
+         */
+        bool BresenhamEuclidean(float pulses, float onsetAmount, Phase index)
         {
             float ratio = bufferSamples_ / pulses;
             float onsets = onsetAmount * pulses;
@@ -243,7 +603,7 @@ namespace wreath
             else
             {
                 float slope = onsets / pulses;
-                int32_t current = (index_ / ratio) * slope;
+                int32_t current = (index.ToFloat() / ratio) * slope;
                 if (current != previousE_)
                 {
                     toggleOnset = !toggleOnset;
@@ -258,9 +618,15 @@ namespace wreath
          *
          * @param input
          */
-        void HandleFreeze(float input)
+        void HandleFreeze(Value input)
         {
-            float frozenValue = freezeBuffer_[intIndex_];
+            // The freeze buffer is only recorded while fading.
+            if (!mustFreeze_ && !mustUnfreeze_)
+            {
+                return;
+            }
+
+            Value frozenValue = FetchFrozen(intIndex_);
             if (mustFreeze_)
             {
                 input = Fader::EqualCrossFade(input, frozenValue, freezeFadeIndex_ * (1.f / samplesToFade_));
@@ -281,9 +647,14 @@ namespace wreath
                 }
                 freezeFadeIndex_ += rate_;
             }
-            if (!frozen_ || mustUnfreeze_)
+            if ((!frozen_ || mustUnfreeze_) && snapshot_)
+            {
+                snapshot_->Write(intIndex_, input);
+            }
+            // Once unfrozen, the snapshot is not needed anymore.
+            if (!frozen_ && !mustFreeze_ && !mustUnfreeze_ && snapshot_)
             {
-                freezeBuffer_[intIndex_] = input;
+                snapshot_->Stop();
             }
         }
 
@@ -292,20 +663,22 @@ namespace wreath
          *
          * @param input
          */
-        void Write(float input)
+        void Write(Value input)
         {
+            if (IsClearing())
+            {
+                clearer_->Touch(intIndex_);
+            }
             HandleFreeze(input);
-            buffer_[intIndex_] = input;
-        }
-
-        /**
-         * @brief Clears the buffers.
-         *
-         */
-        void ClearBuffer()
-        {
-            memset(buffer_, 0.f, maxBufferSamples_);
-            memset(freezeBuffer_, 0.f, maxBufferSamples_);
+            if (snapshot_)
+            {
+                snapshot_->Touch(intIndex_);
+            }
+            Storage::Store(buffer_, intIndex_, input, dither_);
+            if (cache_)
+            {
+                cache_->Update(intIndex_);
+            }
         }
 
         /**
@@ -316,10 +689,13 @@ namespace wreath
          * @return true
          * @return false
          */
-        bool Buffer(float value)
+        bool Buffer(Value value)
         {
-            buffer_[intIndex_] = value;
-            freezeBuffer_[intIndex_] = value;
+            if (IsClearing())
+            {
+                clearer_->Touch(intIndex_);
+            }
+            Storage::Store(buffer_, intIndex_, value, dither_);
             bufferSamples_ = intIndex_ + 1;
 
             // End of available buffer?
@@ -346,6 +722,7 @@ namespace wreath
             loopEnd_ = loopLength_ - 1.f;
             intLoopEnd_ = loopEnd_;
             samplesToFade_ = std::min(kSamplesToFade, loopLength_ / 2.f);
+            CompileLoop();
         }
 
         /**
@@ -355,14 +732,15 @@ namespace wreath
          */
         int32_t StopBuffering()
         {
-            index_ = 0.f;
+            index_ = Phase{};
             intIndex_ = 0;
             loopLength_ = bufferSamples_;
             intLoopLength_ = loopLength_;
             loopEnd_ = loopLength_ - 1.f;
             intLoopEnd_ = loopEnd_;
-            ResetPosition();
             samplesToFade_ = std::min(kSamplesToFade, loopLength_ / 2.f);
+            CompileLoop();
+            ResetPosition();
 
             return bufferSamples_;
         }
@@ -370,6 +748,8 @@ namespace wreath
         inline Direction ToggleDirection()
         {
             direction_ = static_cast<Direction>(direction_ * -1);
+            UpdateStep();
+            CompileLoop();
 
             return direction_;
         }
@@ -382,6 +762,7 @@ namespace wreath
         void SetLooping(bool looping)
         {
             looping_ = looping;
+            CompileLoop();
         }
 
         void SetLoopSync(bool active)
@@ -393,29 +774,120 @@ namespace wreath
         inline float GetLoopEnd() { return loopEnd_; }
         inline float GetLoopLength() { return loopLength_; }
         inline float GetRate() { return rate_; }
-        inline float GetPosition() { return index_; }
+        inline float GetPosition() { return index_.ToFloat(); }
+        inline Phase GetPhase() { return index_; }
+        inline Phase GetStep() { return active_ ? step_ : Phase{}; }
         inline float GetOffset() { return offset_; }
         inline int32_t GetIntPosition() { return intIndex_; }
         bool IsGoingForward() { return Direction::FORWARD == direction_; }
 
     private:
+        static constexpr bool kStagesReads{kStaging};
+        static constexpr bool kBurstsWrites{kWriteBehind};
+        static constexpr int64_t kMinStagedStep{static_cast<int64_t>(2) << Phase::kFracBits};
+        static constexpr int64_t kOneSampleStep{static_cast<int64_t>(1) << Phase::kFracBits};
+
+        /**
+         * @brief A wrapping rule: indices past the limit map to
+         * base + sign * index.
+         */
+        struct WrapRule
+        {
+            int32_t limit{};
+            int32_t base{};
+            int32_t sign{};
+        };
+
+        /**
+         * @brief The loop boundaries, movement, direction and looping state
+         * compiled in a form that the per-sample methods can use without
+         * branching on them.
+         */
+        struct LoopDescriptor
+        {
+            // The contiguous segments of the loop. With normal boundaries
+            // they are the same, with inverted ones the first goes from the
+            // buffer start to the end point and the second from the start
+            // point to the buffer end.
+            int32_t start[2]{};
+            int32_t end[2]{};
+            bool inverted{};
+            // The mask used to wrap the indices when the loop spans a whole
+            // power of two buffer, 0 otherwise.
+            int32_t mask{};
+            // The positions that trigger the action.
+            Phase actionLo{};
+            Phase actionHi{};
+            Action action{Action::NO_ACTION};
+            WrapRule above{};
+            WrapRule below{};
+            // The gap between the end and the start points of inverted
+            // boundaries.
+            int32_t gapLo{};
+            int32_t gapHi{};
+            WrapRule gap{};
+
+            inline int32_t Segment(int32_t index) const
+            {
+                return inverted && index >= start[1];
+            }
+        };
+
+        /**
+         * @brief Stands in for the read-ahead ring of the heads that don't
+         * stage their reads, so that they don't carry it.
+         */
+        struct NoReadAhead
+        {
+            inline void Init(const Sample *) {}
+            inline void Invalidate() {}
+            inline void Follow(int32_t, int32_t) {}
+            inline Value Load(int32_t) const { return Value{}; }
+            inline Value Interpolate(int32_t, float) const { return Value{}; }
+        };
+
+        /**
+         * @brief Stands in for the write-behind run when the heads don't
+         * store in bursts.
+         */
+        struct NoWriteBehind
+        {
+            inline void Init(Sample *) {}
+            inline size_t Gather(const Value *, size_t size, int64_t &, int64_t, Random &) { return size; }
+            inline int32_t GetLo() const { return 0; }
+            inline int32_t GetHi() const { return -1; }
+            inline void Flush() {}
+        };
+
+        using ReadAhead = typename std::conditional<kStagesReads, BasicLoopCache<Interpolator, Storage, kReadAheadSamples>, NoReadAhead>::type;
+        using WriteBehind = typename std::conditional<kBurstsWrites, BasicWriteBehind<Storage>, NoWriteBehind>::type;
+
         const Type type_;
-        float *buffer_;
-        float *freezeBuffer_;
+        Sample *buffer_;
+        Clearer *clearer_{};
+        Snapshot *snapshot_{};
+        Cache *cache_{};
+        ReadAhead readAhead_{};
+        WriteBehind writeBehind_{};
+        Random dither_{};
 
         int32_t maxBufferSamples_{}; // The whole buffer length in samples
         int32_t bufferSamples_{};    // The written buffer length in samples
 
         int32_t intIndex_{};
-        float index_{};
+        Phase index_{};
         float rate_{};
+        Phase step_{}; // The fixed point increment for rate and direction
         float fadeIndex_{};
         bool loopSync_{};
 
         float loopStart_{};
         int32_t intLoopStart_{};
+        Phase loopStartPhase_{};
         float loopEnd_{};
         int32_t intLoopEnd_{};
+        Phase loopEndPhase_{};
+        LoopDescriptor loop_{};
         float loopLength_{};
         int32_t intLoopLength_{};
 
@@ -446,147 +918,382 @@ namespace wreath
          */
         Action HandleLoopAction()
         {
-            // Handle normal loop boundaries.
-            if (intLoopEnd_ > intLoopStart_)
+            // A single unsigned comparison tells whether the index is inside
+            // the action range.
+            if (static_cast<uint64_t>(index_.Raw() - loop_.actionLo.Raw()) > static_cast<uint64_t>(loop_.actionHi.Raw() - loop_.actionLo.Raw()))
             {
-                if (looping_ && ((Direction::FORWARD == direction_ && index_ > loopEnd_) || (Direction::BACKWARDS == direction_ && index_ < loopStart_)))
-                {
-                    offset_ = rate_ != 1.f ? (Direction::FORWARD == direction_ ? index_ - loopEnd_ : loopStart_ - index_) : 0;
+                return Action::NO_ACTION;
+            }
+
+            if (Action::LOOP == loop_.action)
+            {
+                offset_ = rate_ != 1.f ? (Direction::FORWARD == direction_ ? index_ - loopEndPhase_ : loopStartPhase_ - index_).ToFloat() : 0;
+            }
+            else
+            {
+                offset_ = 0;
+            }
+
+            return loop_.action;
+        }
+
+        /**
+         * @brief Wraps the provided index in the buffer.
+         *
+         * @param index
+         * @return int32_t
+         */
+        int32_t WrapIndex(int32_t index)
+        {
+            int32_t wrapped = index;
+            wrapped = index > loop_.above.limit ? loop_.above.base + loop_.above.sign * index : wrapped;
+            wrapped = index < loop_.below.limit ? loop_.below.base + loop_.below.sign * index : wrapped;
+            wrapped = index > loop_.gapLo && index < loop_.gapHi ? std::min(std::max(loop_.gap.base + loop_.gap.sign * index, static_cast<int32_t>(0)), bufferSamples_ - 1) : wrapped;
+
+            return wrapped;
+        }
+
+        /**
+         * @brief Calculates the loop end point depending on the loop start
+         * point and length.
+         */
+        void CalculateLoopEnd()
+        {
+            if (intLoopStart_ + intLoopLength_ > bufferSamples_)
+            {
+                loopEnd_ = (loopStart_ + loopLength_) - bufferSamples_ - 1;
+            }
+            else
+            {
+                loopEnd_ = loopStart_ + loopLength_ - 1;
+            }
+            intLoopEnd_ = loopEnd_;
+        }
 
-                    return Action::LOOP;
+        /**
+         * @brief Compiles the loop boundaries, movement, direction and
+         * looping state in the descriptor used by the per-sample methods.
+         * This must be called every time one of them changes.
+         */
+        void CompileLoop()
+        {
+            loopStartPhase_ = Phase::FromFloat(loopStart_);
+            loopEndPhase_ = Phase::FromFloat(loopEnd_);
+
+            int32_t frame{bufferSamples_ - 1};
+            bool pendulum{Movement::PENDULUM == movement_};
+            bool forward{Direction::FORWARD == direction_};
+            Phase min = Phase::FromRaw(std::numeric_limits<int64_t>::min() / 2);
+            Phase max = Phase::FromRaw(std::numeric_limits<int64_t>::max() / 2);
+            Phase ulp = Phase::FromRaw(1);
+
+            loop_.inverted = intLoopEnd_ <= intLoopStart_;
+            loop_.mask = !loop_.inverted && intLoopStart_ == 0 && intLoopEnd_ == frame && bufferSamples_ > 0 && !(bufferSamples_ & frame) && !pendulum ? frame : 0;
+            loop_.action = looping_ ? Action::LOOP : Action::STOP;
+
+            if (!loop_.inverted)
+            {
+                loop_.start[0] = loop_.start[1] = intLoopStart_;
+                loop_.end[0] = loop_.end[1] = intLoopEnd_;
+
+                if (looping_)
+                {
+                    loop_.actionLo = forward ? loopEndPhase_ + ulp : min;
+                    loop_.actionHi = forward ? max : loopStartPhase_ - ulp;
                 }
-                if (!looping_ && ((Direction::FORWARD == direction_ && index_ >= loopEnd_ - samplesToFade_) || (Direction::BACKWARDS == direction_ && index_ <= loopStart_ + samplesToFade_)))
+                else
                 {
-                    offset_ = 0;
-
-                    return Action::STOP;
+                    loop_.actionLo = forward ? Phase::FromFloat(loopEnd_ - samplesToFade_) : min;
+                    loop_.actionHi = forward ? max : Phase::FromFloat(loopStart_ + samplesToFade_);
                 }
+
+                // Past the end point.
+                loop_.above.limit = intLoopEnd_;
+                loop_.above.base = pendulum ? 2 * intLoopEnd_ : (forward ? intLoopStart_ - intLoopEnd_ - 1 : 0);
+                loop_.above.sign = pendulum ? -1 : (forward ? 1 : 0);
+                // Before the start point.
+                loop_.below.limit = intLoopStart_;
+                loop_.below.base = pendulum ? 2 * intLoopStart_ : (forward ? 0 : intLoopEnd_ - intLoopStart_ + 1);
+                loop_.below.sign = pendulum ? -1 : (forward ? 0 : 1);
+                // No gap.
+                loop_.gapLo = std::numeric_limits<int32_t>::max();
+                loop_.gapHi = std::numeric_limits<int32_t>::min();
             }
-            // Handle inverted loop boundaries (end point comes before start point).
             else
             {
-                if (looping_ && index_ > loopEnd_ && index_ < loopStart_)
+                // The segment before the end point and the one after the start
+                // point.
+                loop_.start[0] = 0;
+                loop_.end[0] = intLoopEnd_;
+                loop_.start[1] = intLoopStart_;
+                loop_.end[1] = frame;
+
+                if (looping_)
                 {
-                    offset_ = rate_ != 1.f ? (Direction::FORWARD == direction_ ? index_ - loopEnd_ : loopStart_ - index_) : 0;
-
-                    return Action::LOOP;
+                    loop_.actionLo = loopEndPhase_ + ulp;
+                    loop_.actionHi = loopStartPhase_ - ulp;
                 }
-                if (!looping_ && ((Direction::FORWARD == direction_ && index_ >= loopEnd_ - samplesToFade_ && index_ < loopStart_) || (Direction::BACKWARDS == direction_ && index_ <= loopStart_ + samplesToFade_ && index_ > loopEnd_)))
+                else
                 {
-                    offset_ = 0;
+                    loop_.actionLo = forward ? Phase::FromFloat(loopEnd_ - samplesToFade_) : loopEndPhase_ + ulp;
+                    loop_.actionHi = forward ? loopStartPhase_ - ulp : Phase::FromFloat(loopStart_ + samplesToFade_);
+                }
 
-                    return Action::STOP;
+                // Outside of the buffer.
+                loop_.above.limit = frame;
+                loop_.above.base = -bufferSamples_;
+                loop_.above.sign = 1;
+                loop_.below.limit = 0;
+                loop_.below.base = bufferSamples_;
+                loop_.below.sign = 1;
+                // Between the end and the start points.
+                loop_.gapLo = intLoopEnd_;
+                loop_.gapHi = intLoopStart_;
+                if (forward)
+                {
+                    loop_.gap.base = pendulum ? 2 * intLoopEnd_ : intLoopStart_ - intLoopEnd_ - 1;
+                    loop_.gap.sign = pendulum ? -1 : 1;
+                }
+                else
+                {
+                    loop_.gap.base = pendulum ? 2 * intLoopStart_ : intLoopEnd_ - intLoopStart_ + 1;
+                    loop_.gap.sign = pendulum ? -1 : 1;
                 }
             }
+        }
 
-            return Action::NO_ACTION;
+        /**
+         * @brief Updates the fixed point increment of the position.
+         */
+        void UpdateStep()
+        {
+            step_ = Phase::FromFloat(rate_ * direction_);
         }
 
         /**
-         * @brief Wraps the provided index in the buffer.
+         * @brief Wraps the index of an interpolation tap. Differently from
+         * WrapIndex(), the loop is always treated as circular, so that the
+         * taps crossing a boundary continue from the other one.
          *
          * @param index
+         * @param inLoop whether the head is inside the loop
          * @return int32_t
          */
-        int32_t WrapIndex(int32_t index)
+        int32_t WrapTap(int32_t index, bool inLoop)
         {
-            // Handle normal loop boundaries.
-            if (intLoopEnd_ > intLoopStart_)
+            if (inLoop && !loop_.inverted)
             {
-                // Forward direction.
                 if (index > intLoopEnd_)
                 {
-                    if (Movement::PENDULUM == movement_)
-                    {
-                        index = intLoopEnd_ - (index - intLoopEnd_);
-                    }
-                    else
-                    {
-                        index = (FORWARD == direction_) ? (intLoopStart_ + (index - intLoopEnd_)) - 1 : 0;
-                    }
+                    return intLoopStart_ + (index - intLoopEnd_ - 1);
                 }
-                // Backwards direction.
-                else if (index < intLoopStart_)
+                if (index < intLoopStart_)
                 {
-                    if (Movement::PENDULUM == movement_)
-                    {
-                        index = intLoopStart_ + (intLoopStart_ - index);
-                    }
-                    else
-                    {
-                        index = (BACKWARDS == direction_) ? (intLoopEnd_ - std::abs(intLoopStart_ - index)) + 1 : 0;
-                    }
+                    return intLoopEnd_ - (intLoopStart_ - index - 1);
                 }
+
+                return index;
             }
-            // Handle inverted loop boundaries (end point comes before start point).
-            else
+
+            if (loop_.mask)
             {
-                int32_t frame{bufferSamples_ - 1};
-                if (index > frame)
-                {
-                    index = (index - frame) - 1;
-                }
-                else if (index < 0)
+                return index & loop_.mask;
+            }
+            if (index >= bufferSamples_)
+            {
+                index -= bufferSamples_;
+            }
+            else if (index < 0)
+            {
+                index += bufferSamples_;
+            }
+            // With inverted loop boundaries, jump over the gap between the
+            // end and the start points from the closest one.
+            if (inLoop && index > loop_.gapLo && index < loop_.gapHi)
+            {
+                return (index - intLoopEnd_ <= intLoopStart_ - index) ? intLoopStart_ + (index - intLoopEnd_ - 1) : intLoopEnd_ - (intLoopStart_ - index - 1);
+            }
+
+            return index;
+        }
+
+        /**
+         * @brief Stores the gathered run of written samples in the buffer,
+         * saving the samples it overwrites in the snapshot first and reloading
+         * the ones in the loop cache after.
+         *
+         * @param snapshotting whether the snapshot is active
+         * @param caching whether the loop cache is valid
+         */
+        void FlushWriteBehind(bool snapshotting, bool caching)
+        {
+            int32_t lo = writeBehind_.GetLo();
+            int32_t hi = writeBehind_.GetHi();
+            if (snapshotting)
+            {
+                for (int32_t index = lo; index <= hi; index++)
                 {
-                    // Wrap-around.
-                    index = (frame - std::abs(index)) + 1;
+                    snapshot_->Touch(index);
                 }
-                else if (index > intLoopEnd_ && index < intLoopStart_)
+            }
+            writeBehind_.Flush();
+            if (caching)
+            {
+                for (int32_t index = lo; index <= hi; index++)
                 {
-                    if (FORWARD == direction_)
-                    {
-                        // Max/min to avoid overflow.
-                        index = (Movement::PENDULUM == movement_) ? std::max(intLoopEnd_ - (index - intLoopEnd_), static_cast<int32_t>(0)) : std::min(intLoopStart_ + (index - intLoopEnd_) - 1, frame);
-                    }
-                    else
-                    {
-                        // Max/min to avoid overflow.
-                        index = (Movement::PENDULUM == movement_) ? std::min(intLoopStart_ + (intLoopStart_ - index), frame) : std::max(intLoopEnd_ - (intLoopStart_ - index) + 1, static_cast<int32_t>(0));
-                    }
+                    cache_->Update(index);
                 }
             }
+        }
 
-            return index;
+        /**
+         * @brief Whether a span read with the given raw increment goes through
+         * the read-ahead ring, when built with kReadAhead. Staging only pays
+         * off when the taps don't overlap much between two reads, from two
+         * samples per read. Otherwise the direct reads are cheaper.
+         *
+         * @param step
+         * @return true
+         * @return false
+         */
+        inline bool ReadsAhead(int64_t step) const
+        {
+            return kStagesReads && (step >= kMinStagedStep || step <= -kMinStagedStep);
         }
 
         /**
-         * @brief Calculates the loop end point depending on the loop start
-         * point and length.
+         * @brief Stages in the read-ahead ring the samples read by the given
+         * span, so that each of them is decoded once however many taps use
+         * it, and hints the memory system about the samples that follow in
+         * the reading direction. The span must be in a loop segment, it's
+         * shortened if its samples don't fit the ring.
+         *
+         * @param index the raw position of the first read
+         * @param step the raw increment
+         * @param span
+         * @return size_t the number of reads that can be done from the ring
          */
-        void CalculateLoopEnd()
+        size_t StageSpan(int64_t index, int64_t step, size_t span)
         {
-            if (intLoopStart_ + intLoopLength_ > bufferSamples_)
+            int64_t stride = step < 0 ? -step : step;
+            if (stride)
             {
-                loopEnd_ = (loopStart_ + loopLength_) - bufferSamples_ - 1;
+                int64_t fits = (static_cast<int64_t>(kReadAheadSamples - Interpolator::kTaps - 1) << Phase::kFracBits) / stride + 1;
+                span = std::min(span, static_cast<size_t>(std::max(fits, static_cast<int64_t>(1))));
             }
-            else
+            int64_t last = index + step * static_cast<int64_t>(span - 1);
+            int32_t lo = static_cast<int32_t>(std::min(index, last) >> Phase::kFracBits) - Interpolator::kBefore;
+            int32_t hi = static_cast<int32_t>(std::max(index, last) >> Phase::kFracBits) + Interpolator::kAfter;
+            readAhead_.Follow(lo, hi);
+
+            // The next span will most likely read as many samples further on.
+            int32_t next = step < 0 ? std::max(lo - (hi - lo + 1), static_cast<int32_t>(0)) : std::min(hi + 1, bufferSamples_);
+            int32_t count = std::min(hi - lo + 1, bufferSamples_ - next);
+            if (count > 0)
             {
-                loopEnd_ = loopStart_ + loopLength_ - 1;
+                Prefetch(Storage::At(buffer_, next), count * Storage::kBytes);
             }
-            intLoopEnd_ = loopEnd_;
+
+            return span;
+        }
+
+        inline bool IsClearing() const
+        {
+            return clearer_ && clearer_->IsActive();
+        }
+
+        /**
+         * @brief Returns the sample of the main buffer at the given index,
+         * from the cache if it's there. The regions still to be cleared read
+         * as silence.
+         *
+         * @param index
+         * @return Value
+         */
+        inline Value Fetch(int32_t index)
+        {
+            if (IsClearing() && clearer_->IsPending(index))
+            {
+                return Value{};
+            }
+
+            return cache_ && cache_->Contains(index) ? cache_->Load(index) : Storage::Load(buffer_, index);
+        }
+
+        /**
+         * @brief Returns the frozen sample at the given index, from the
+         * snapshot if it's been copied already, otherwise from the main
+         * buffer.
+         *
+         * @param index
+         * @return Value
+         */
+        inline Value FetchFrozen(int32_t index)
+        {
+            int32_t offset = snapshot_ ? snapshot_->Find(index) : -1;
+
+            return offset >= 0 ? snapshot_->Load(offset) : Fetch(index);
         }
 
         /**
-         * @brief Reads the value in the buffer of choice at the given index.
-         * Uses interpolation if the index is not integral.
+         * @brief Reads the value at the given index, using the provided
+         * function to get the samples. Uses interpolation if the index is not
+         * integral.
          *
-         * @param buffer
          * @param index
-         * @return float
+         * @param direct whether the taps can be read straight from the main
+         * buffer when they don't need wrapping
+         * @param fetch
+         * @return Value
          */
-        float ReadAt(float *buffer, float index)
+        template <typename Fetcher>
+        Value ReadAt(Phase index, bool direct, Fetcher fetch)
         {
-            int32_t intPos = index;
-            float value = buffer[intPos];
-            float frac = index - intPos;
+            int32_t intPos = index.Int();
 
             // Interpolate value only it the index has a fractional part.
-            if (frac > std::numeric_limits<float>::epsilon())
+            if (!index.FracBits())
+            {
+                return fetch(intPos);
+            }
+
+            // The contiguous region around the index that doesn't need
+            // wrapping.
+            int32_t segment = loop_.Segment(intPos);
+            int32_t lo{loop_.start[segment]};
+            int32_t hi{loop_.end[segment]};
+            bool inLoop = intPos <= hi && (loop_.inverted || intPos >= lo);
+
+            int32_t first = intPos - Interpolator::kBefore;
+            if (direct && inLoop && first >= lo && first + Interpolator::kTaps - 1 <= hi)
+            {
+                if (cache_ && cache_->Covers(first, first + Interpolator::kTaps - 1))
+                {
+                    return cache_->Interpolate(first, index.Frac());
+                }
+
+                return Storage::template Interpolate<Interpolator>(buffer_, first, index.Frac());
+            }
+
+            Value taps[Interpolator::kTaps];
+            for (int32_t i = 0; i < Interpolator::kTaps; i++)
             {
-                value = value + (buffer[WrapIndex(intPos + direction_)] - value) * frac;
+                taps[i] = fetch(WrapTap(first + i, inLoop));
             }
 
-            return value;
+            return Interpolator::Interpolate(taps, index.Frac());
         }
     };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <typename Interpolator, typename Storage, bool kStaging>
+    constexpr bool BasicHead<Interpolator, Storage, kStaging>::kStagesReads;
+    template <typename Interpolator, typename Storage, bool kStaging>
+    constexpr bool BasicHead<Interpolator, Storage, kStaging>::kBurstsWrites;
+    template <typename Interpolator, typename Storage, bool kStaging>
+    constexpr int64_t BasicHead<Interpolator, Storage, kStaging>::kMinStagedStep;
+    template <typename Interpolator, typename Storage, bool kStaging>
+    constexpr int64_t BasicHead<Interpolator, Storage, kStaging>::kOneSampleStep;
+
+    using Head = BasicHead<>;
 } // namespace wreath
\ No newline at end of file
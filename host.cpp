@@ -0,0 +1,97 @@
+#include "host_arena.h"
+#include "stereo_looper.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace wreath;
+
+/**
+ * Renders a StereoLooper off-target, through the whole signal path, and
+ * reports how fast it runs, to benchmark and profile it on the host.
+ *
+ * Usage: looper_host [seconds] [mode] [linked]
+ *  seconds: the length of the render once the looper is running (60)
+ *  mode: 0 for MONO, 1 for CROSS, 2 for DUAL (2)
+ *  linked: 1 to link the channels in a single looper (0)
+ */
+
+constexpr size_t kBlockSize{48};
+constexpr float kHostBufferSeconds{10.f};
+
+StereoLooper looper;
+
+/**
+ * @brief Processes the given number of blocks of a test signal, returning a
+ * checksum of the output so that the work can't be optimized away.
+ *
+ * @param blocks
+ * @param frame the first frame of the signal, advanced
+ * @return double
+ */
+double Render(size_t blocks, size_t &frame)
+{
+    float in[2][kBlockSize];
+    float out[2][kBlockSize];
+    double sum{};
+    for (size_t block = 0; block < blocks; block++)
+    {
+        for (size_t i = 0; i < kBlockSize; i++, frame++)
+        {
+            in[0][i] = 0.5f * std::sin(frame * 0.013f) + 0.2f * std::sin(frame * 0.0007f);
+            in[1][i] = 0.4f * std::sin(frame * 0.021f);
+        }
+        looper.ProcessBlock(in[0], in[1], out[0], out[1], kBlockSize);
+        for (size_t i = 0; i < kBlockSize; i++)
+        {
+            sum += out[0][i] + out[1][i];
+        }
+    }
+
+    return sum;
+}
+
+int main(int argc, char **argv)
+{
+    float seconds = argc > 1 ? std::atof(argv[1]) : 60.f;
+    StereoLooper::Mode mode = argc > 2 ? static_cast<StereoLooper::Mode>(std::atoi(argv[2])) : StereoLooper::Mode::DUAL;
+
+    HostArena arena;
+    if (!arena.Open(StereoLooper::GetArenaBytes(kSampleRate, kHostBufferSeconds), true))
+    {
+        std::printf("Can't map the buffers\n");
+
+        return 1;
+    }
+    StereoLooper::Conf conf{mode, Movement::NORMAL, Direction::FORWARD, 1.f};
+    conf.linked = argc > 3 && std::atoi(argv[3]);
+    if (!looper.Init(kSampleRate, conf, arena, kHostBufferSeconds))
+    {
+        std::printf("Can't map the buffers\n");
+
+        return 1;
+    }
+
+    // Record a few seconds, then start with the feedback on and the heads
+    // moving at different rates, so that every stage of the path runs.
+    size_t frame{};
+    double sum = Render(kSampleRate * 4 / kBlockSize, frame);
+    looper.Send(StereoLooper::CommandType::STOP_BUFFERING);
+    sum += Render(1, frame);
+    looper.Start();
+    looper.Send(StereoLooper::CommandType::SET_FEEDBACK, StereoLooper::BOTH, 0.5f);
+    looper.SetReadRate(StereoLooper::BOTH, 1.5f);
+    looper.SetWriteRate(StereoLooper::BOTH, 0.75f);
+    looper.SetDegradation(0.3f);
+    sum += Render(1, frame);
+
+    size_t blocks = static_cast<size_t>(seconds * kSampleRate / kBlockSize);
+    auto start = std::chrono::steady_clock::now();
+    sum += Render(blocks, frame);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("Rendered %.1fs in %.3fs: %.1fx realtime, %.0fns per block of %zu frames (checksum %f)\n", blocks * kBlockSize / static_cast<double>(kSampleRate), elapsed, blocks * kBlockSize / (elapsed * kSampleRate), elapsed * 1e9 / (blocks ? blocks : 1), kBlockSize, sum);
+
+    return 0;
+}
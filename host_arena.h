@@ -0,0 +1,89 @@
+#pragma once
+
+#include "arena.h"
+#include <cstddef>
+#include <sys/mman.h>
+
+namespace wreath
+{
+    /**
+     * @brief An arena owning its memory, for host builds (POSIX only). The
+     * memory is mapped anonymously, so it's zeroed by the system on demand
+     * and only the pages the loopers record into become resident.
+     *
+     * The loopers' buffers are large and read by moving heads, so on Linux
+     * they can be backed by huge pages, cutting the TLB misses: explicit ones
+     * when the system has reserved them, transparent ones otherwise.
+     */
+    class HostArena : public Arena
+    {
+    public:
+        static constexpr size_t kHugePageBytes{1 << 21};
+
+        HostArena() {}
+        ~HostArena() { Close(); }
+
+        /**
+         * @brief Maps the memory of the arena.
+         *
+         * @param bytes
+         * @param hugePages whether to back the memory with huge pages, when
+         * available
+         * @return true if the memory has been mapped
+         * @return false
+         */
+        bool Open(size_t bytes, bool hugePages = false)
+        {
+            Close();
+
+            bytes = (bytes + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+            void *memory = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+            if (hugePages)
+            {
+                memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            }
+#endif
+            if (MAP_FAILED == memory)
+            {
+                memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (MAP_FAILED == memory)
+                {
+                    return false;
+                }
+#if defined(MADV_HUGEPAGE)
+                if (hugePages)
+                {
+                    madvise(memory, bytes, MADV_HUGEPAGE);
+                }
+#endif
+            }
+            memory_ = memory;
+            mappedBytes_ = bytes;
+            Init(memory_, mappedBytes_);
+
+            return true;
+        }
+
+        /**
+         * @brief Unmaps the memory, the buffers allocated from the arena
+         * mustn't be used anymore.
+         */
+        void Close()
+        {
+            if (memory_)
+            {
+                munmap(memory_, mappedBytes_);
+                memory_ = nullptr;
+            }
+            mappedBytes_ = 0;
+            Init(nullptr, 0);
+        }
+
+        inline bool IsOpen() const { return memory_ != nullptr; }
+
+    private:
+        void *memory_{};
+        size_t mappedBytes_{};
+    };
+} // namespace wreath
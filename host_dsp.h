@@ -0,0 +1,86 @@
+#pragma once
+
+#include "constexpr_math.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace wreath
+{
+    /**
+     * Header-only equivalents of the DaisySP helpers used by the looper, for
+     * host builds (WREATH_HOST) without the DaisySP library. Each one gives
+     * the same output as its DaisySP counterpart on the Daisy.
+     */
+
+    inline float fclamp(float in, float min, float max)
+    {
+        return std::fmin(std::fmax(in, min), max);
+    }
+
+    /**
+     * @brief Maps a value in the [0, 1] range to the given one, linearly.
+     *
+     * @param in
+     * @param min
+     * @param max
+     * @return float
+     */
+    inline float fmap(float in, float min, float max)
+    {
+        return fclamp(min + in * (max - min), min, max);
+    }
+
+    /**
+     * @brief One-pole lowpass filter, moving out towards in by the given
+     * coefficient.
+     *
+     * @param out
+     * @param in
+     * @param coeff
+     */
+    inline void fonepole(float &out, float in, float coeff)
+    {
+        out += coeff * (in - out);
+    }
+
+    inline float SoftLimit(float x)
+    {
+        return x * (27.f + x * x) / (27.f + 9.f * x * x);
+    }
+
+    inline float SoftClip(float x)
+    {
+        if (x < -3.f)
+        {
+            return -1.f;
+        }
+        if (x > 3.f)
+        {
+            return 1.f;
+        }
+
+        return SoftLimit(x);
+    }
+
+    /**
+     * @brief Approximates the n-th root of the given value by shifting its
+     * exponent. DaisySP does it on a long, 32 bits on the Daisy, so it's done
+     * on 32 bits here too.
+     *
+     * @param f
+     * @param n
+     * @return float
+     */
+    inline float fastroot(float f, int n)
+    {
+        int32_t l;
+        std::memcpy(&l, &f, sizeof(l));
+        l -= 0x3F800000;
+        l >>= (n - 1);
+        l += 0x3F800000;
+        std::memcpy(&f, &l, sizeof(f));
+
+        return f;
+    }
+} // namespace wreath
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "host_dsp.h"
+#include <algorithm>
+#include <cmath>
+
+namespace wreath
+{
+    /**
+     * @brief Double sampled, stable state variable filter, the header-only
+     * equivalent of DaisySP's Svf for host builds (WREATH_HOST), with the
+     * same output.
+     *
+     * @see https://www.musicdsp.org/en/latest/Filters/92-state-variable-filter-double-sampled-stable.html
+     */
+    class Svf
+    {
+    public:
+        Svf() {}
+        ~Svf() {}
+
+        void Init(float sampleRate)
+        {
+            sampleRate_ = sampleRate;
+            fc_ = 200.f;
+            res_ = 0.5f;
+            drive_ = 0.5f;
+            preDrive_ = 0.5f;
+            freq_ = 0.25f;
+            damp_ = 0.f;
+            notch_ = 0.f;
+            low_ = 0.f;
+            high_ = 0.f;
+            band_ = 0.f;
+            outNotch_ = 0.f;
+            outLow_ = 0.f;
+            outHigh_ = 0.f;
+            outPeak_ = 0.f;
+            outBand_ = 0.f;
+            fcMax_ = sampleRate_ / 3.f;
+        }
+
+        /**
+         * @brief Filters the given sample, the outputs are then read with the
+         * getters below.
+         *
+         * @param in
+         */
+        void Process(float in)
+        {
+            // The first pass gives half of the outputs, the second one the
+            // other half.
+            Pass(in);
+            outLow_ = 0.5f * low_;
+            outHigh_ = 0.5f * high_;
+            outBand_ = 0.5f * band_;
+            outPeak_ = 0.5f * (low_ - high_);
+            outNotch_ = 0.5f * notch_;
+
+            Pass(in);
+            outLow_ += 0.5f * low_;
+            outHigh_ += 0.5f * high_;
+            outBand_ += 0.5f * band_;
+            outPeak_ += 0.5f * (low_ - high_);
+            outNotch_ += 0.5f * notch_;
+        }
+
+        /**
+         * @brief Sets the cutoff frequency, up to a third of the sample rate.
+         *
+         * @param frequency in Hz
+         */
+        void SetFreq(float frequency)
+        {
+            fc_ = fclamp(frequency, 1.0e-6f, fcMax_);
+            // Double the sample rate, as the filter is double sampled.
+            freq_ = 2.f * sinf(static_cast<float>(kPi) * std::min(0.25f, fc_ / (sampleRate_ * 2.f)));
+            UpdateDamp();
+        }
+
+        /**
+         * @brief Sets the resonance, in the [0, 1] range.
+         *
+         * @param resonance
+         */
+        void SetRes(float resonance)
+        {
+            res_ = fclamp(resonance, 0.f, 1.f);
+            UpdateDamp();
+            drive_ = preDrive_ * res_;
+        }
+
+        /**
+         * @brief Sets the drive, in the [0, 10] range.
+         *
+         * @param drive
+         */
+        void SetDrive(float drive)
+        {
+            preDrive_ = fclamp(drive * 0.1f, 0.f, 1.f);
+            drive_ = preDrive_ * res_;
+        }
+
+        inline float Low() { return outLow_; }
+        inline float High() { return outHigh_; }
+        inline float Band() { return outBand_; }
+        inline float Notch() { return outNotch_; }
+        inline float Peak() { return outPeak_; }
+
+    private:
+        float sampleRate_{};
+        float fc_{};
+        float fcMax_{};
+        float res_{};
+        float drive_{};
+        float preDrive_{};
+        float freq_{};
+        float damp_{};
+        float notch_{};
+        float low_{};
+        float high_{};
+        float band_{};
+        float outNotch_{};
+        float outLow_{};
+        float outHigh_{};
+        float outPeak_{};
+        float outBand_{};
+
+        inline void Pass(float in)
+        {
+            notch_ = in - damp_ * band_;
+            low_ = low_ + freq_ * band_;
+            high_ = notch_ - low_;
+            band_ = freq_ * high_ + band_ - drive_ * band_ * band_ * band_;
+        }
+
+        inline void UpdateDamp()
+        {
+            damp_ = std::min(2.f * (1.f - powf(res_, 0.25f)), std::min(2.f, 2.f / freq_ - freq_ * 0.5f));
+        }
+    };
+} // namespace wreath
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "constexpr_math.h"
+#include <cstdint>
+
+namespace wreath
+{
+    /**
+     * The interpolators are the policies used by the heads to read the
+     * buffer at fractional positions. Each one declares how many samples
+     * it needs before (kBefore) and after (kAfter) the integral position and
+     * interpolates the contiguous taps it's given, so the heads can pass a
+     * pointer right into the buffer when the taps don't cross the loop
+     * boundaries, or a small wrapped copy when they do. The taps are either
+     * samples or frames of a linked looper.
+     */
+
+    /**
+     * @brief Linear interpolation between the two closest samples.
+     */
+    struct LinearInterpolator
+    {
+        static constexpr int32_t kBefore{0};
+        static constexpr int32_t kAfter{1};
+        static constexpr int32_t kTaps{kBefore + 1 + kAfter};
+
+        /**
+         * @brief Interpolates the given taps.
+         *
+         * @tparam T float or Frame
+         * @param taps the kTaps samples starting at kBefore samples before
+         * the integral position
+         * @param frac the fractional position, in the [0, 1) range
+         * @return T
+         */
+        template <typename T>
+        static inline T Interpolate(const T *taps, float frac)
+        {
+            return taps[0] + (taps[1] - taps[0]) * frac;
+        }
+    };
+
+    /**
+     * @brief 4-point, 3rd-order Hermite interpolation.
+     * @see http://yehar.com/blog/wp-content/uploads/2009/08/deip.pdf
+     */
+    struct HermiteInterpolator
+    {
+        static constexpr int32_t kBefore{1};
+        static constexpr int32_t kAfter{2};
+        static constexpr int32_t kTaps{kBefore + 1 + kAfter};
+
+        template <typename T>
+        static inline T Interpolate(const T *taps, float frac)
+        {
+            T c1 = 0.5f * (taps[2] - taps[0]);
+            T c2 = taps[0] - 2.5f * taps[1] + 2.f * taps[2] - 0.5f * taps[3];
+            T c3 = 0.5f * (taps[3] - taps[0]) + 1.5f * (taps[1] - taps[2]);
+
+            return ((c3 * frac + c2) * frac + c1) * frac + taps[1];
+        }
+    };
+
+    /**
+     * @brief Blackman windowed sinc interpolation, using a polyphase table
+     * generated at compile time. The coefficients between two phases are
+     * linearly interpolated.
+     *
+     * @tparam kZeroCrossings the number of zero crossings on each side
+     * @tparam kPhases the number of phases in the table
+     */
+    template <int32_t kZeroCrossings = 4, int32_t kPhases = 128>
+    struct SincInterpolator
+    {
+        static constexpr int32_t kBefore{kZeroCrossings - 1};
+        static constexpr int32_t kAfter{kZeroCrossings};
+        static constexpr int32_t kTaps{kBefore + 1 + kAfter};
+
+        struct Table
+        {
+            float coeffs[kPhases + 1][kTaps]{};
+        };
+
+        static constexpr Table MakeTable()
+        {
+            Table table{};
+            for (int32_t phase = 0; phase <= kPhases; phase++)
+            {
+                double frac = phase / static_cast<double>(kPhases);
+                double coeffs[kTaps]{};
+                double sum{};
+                for (int32_t tap = 0; tap < kTaps; tap++)
+                {
+                    double x = (tap - kBefore) - frac;
+                    double sinc = x == 0 ? 1.0 : ConstexprSin(kPi * x) / (kPi * x);
+                    double u = x / kZeroCrossings;
+                    double window = u <= -1 || u >= 1 ? 0.0 : 0.42 + 0.5 * ConstexprCos(kPi * u) + 0.08 * ConstexprCos(2 * kPi * u);
+                    coeffs[tap] = sinc * window;
+                    sum += coeffs[tap];
+                }
+                // Normalize for unity gain at DC.
+                for (int32_t tap = 0; tap < kTaps; tap++)
+                {
+                    table.coeffs[phase][tap] = static_cast<float>(coeffs[tap] / sum);
+                }
+            }
+
+            return table;
+        }
+
+        static constexpr Table kTable{MakeTable()};
+
+        template <typename T>
+        static inline T Interpolate(const T *taps, float frac)
+        {
+            float position = frac * kPhases;
+            int32_t phase = static_cast<int32_t>(position);
+            float t = position - phase;
+            const float *c0 = kTable.coeffs[phase];
+            const float *c1 = kTable.coeffs[phase + 1];
+
+            T value{};
+            for (int32_t tap = 0; tap < kTaps; tap++)
+            {
+                value += taps[tap] * (c0[tap] + (c1[tap] - c0[tap]) * t);
+            }
+
+            return value;
+        }
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <int32_t kZeroCrossings, int32_t kPhases>
+    constexpr typename SincInterpolator<kZeroCrossings, kPhases>::Table SincInterpolator<kZeroCrossings, kPhases>::kTable;
+} // namespace wreath
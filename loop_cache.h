@@ -0,0 +1,180 @@
+#pragma once
+
+#include "interpolator.h"
+#include "storage.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace wreath
+{
+    constexpr int32_t kLoopCacheSamples{2048}; // Fits the loops of note and flanger modes
+
+    /**
+     * @brief Keeps a decoded copy of a short loop of the main buffer, so that
+     * the heads spinning over it in note and flanger modes read from internal
+     * RAM instead of paying the external memory latency at every tap.
+     *
+     * The samples sit at their buffer index modulo the cache size, so when
+     * the loop moves only the samples entering the window are loaded. The
+     * first slots are mirrored past the end, so that the taps around any
+     * cached index are contiguous. The writes falling in the window must be
+     * reported with Update() to keep the copy coherent.
+     *
+     * @tparam Interpolator the policy used by the reading heads
+     * @tparam Storage the storage policy of the main buffer
+     * @tparam kSamples the size of the cache, a power of two
+     */
+    template <typename Interpolator = LinearInterpolator, typename Storage = FloatStorage, int32_t kSamples = kLoopCacheSamples>
+    class BasicLoopCache
+    {
+    public:
+        BasicLoopCache() {}
+        ~BasicLoopCache() {}
+
+        using Sample = typename Storage::Sample;
+        using Value = typename Storage::Value;
+
+        static_assert(!(kSamples & (kSamples - 1)), "The cache size must be a power of two");
+
+        void Init(const Sample *buffer)
+        {
+            buffer_ = buffer;
+            Invalidate();
+        }
+
+        inline void Invalidate()
+        {
+            start_ = 0;
+            length_ = 0;
+        }
+
+        /**
+         * @brief Moves the window of the cache to the given region, loading
+         * the samples that weren't cached yet. Regions that don't fit are not
+         * cached.
+         *
+         * @param start the first index of the region
+         * @param end the last index of the region
+         */
+        void Follow(int32_t start, int32_t end)
+        {
+            int32_t length = end - start + 1;
+            if (length <= 0 || length > kSamples)
+            {
+                Invalidate();
+
+                return;
+            }
+            if (start == start_ && length == length_)
+            {
+                return;
+            }
+
+            // The samples in both windows are already there.
+            int32_t keptLo = std::max(start, start_);
+            int32_t keptHi = std::min(end, start_ + length_ - 1);
+            if (keptLo > keptHi)
+            {
+                Fill(start, end);
+            }
+            else
+            {
+                Fill(start, keptLo - 1);
+                Fill(keptHi + 1, end);
+            }
+            start_ = start;
+            length_ = length;
+        }
+
+        inline bool IsValid() const { return length_ > 0; }
+
+        /**
+         * @brief Whether the given index is cached.
+         *
+         * @param index
+         * @return true
+         * @return false
+         */
+        inline bool Contains(int32_t index) const
+        {
+            return static_cast<uint32_t>(index - start_) < static_cast<uint32_t>(length_);
+        }
+
+        /**
+         * @brief Whether all the indices between the given ones are cached.
+         *
+         * @param lo
+         * @param hi
+         * @return true
+         * @return false
+         */
+        inline bool Covers(int32_t lo, int32_t hi) const
+        {
+            return IsValid() && lo >= start_ && hi < start_ + length_;
+        }
+
+        inline Value Load(int32_t index) const
+        {
+            return samples_[index & kMask];
+        }
+
+        /**
+         * @brief Interpolates the taps starting at the given index, which must
+         * all be cached.
+         *
+         * @param first
+         * @param frac
+         * @return Value
+         */
+        inline Value Interpolate(int32_t first, float frac) const
+        {
+            return Interpolator::Interpolate(samples_ + (first & kMask), frac);
+        }
+
+        /**
+         * @brief Reloads the sample at the given index, if it's cached, after
+         * it's been written in the main buffer.
+         *
+         * @param index
+         */
+        inline void Update(int32_t index)
+        {
+            if (Contains(index))
+            {
+                Set(index, Storage::Load(buffer_, index));
+            }
+        }
+
+    private:
+        static constexpr int32_t kMask{kSamples - 1};
+
+        void Fill(int32_t from, int32_t to)
+        {
+            for (int32_t index = from; index <= to; index++)
+            {
+                Set(index, Storage::Load(buffer_, index));
+            }
+        }
+
+        inline void Set(int32_t index, const Value &value)
+        {
+            int32_t slot = index & kMask;
+            samples_[slot] = value;
+            if (slot < Interpolator::kTaps)
+            {
+                samples_[kSamples + slot] = value;
+            }
+        }
+
+        const Sample *buffer_{};
+        int32_t start_{};
+        int32_t length_{};
+        Value samples_[kSamples + Interpolator::kTaps]{};
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <typename Interpolator, typename Storage, int32_t kSamples>
+    constexpr int32_t BasicLoopCache<Interpolator, Storage, kSamples>::kMask;
+
+    using LoopCache = BasicLoopCache<>;
+} // namespace wreath
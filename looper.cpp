@@ -1,15 +1,28 @@
 #include "looper.h"
-#include "Utility/dsp.h"
 
 using namespace wreath;
-using namespace daisysp;
 
-void Looper::Init(int32_t sampleRate, float *buffer, float *buffer2, int32_t maxBufferSamples)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::Init(int32_t sampleRate, BufferSpan<Storage> buffer, BufferSpan<Storage> freezeBuffer)
 {
     sampleRate_ = sampleRate;
-    readHeads_[0].Init(buffer, buffer2, maxBufferSamples);
-    readHeads_[1].Init(buffer, buffer2, maxBufferSamples);
-    writeHead_.Init(buffer, buffer2, maxBufferSamples);
+    readHeads_[0].Init(buffer.data, buffer.length);
+    readHeads_[1].Init(buffer.data, buffer.length);
+    writeHead_.Init(buffer.data, buffer.length);
+    clearer_.Init(buffer.data, buffer.length);
+    snapshot_.Init(buffer.data, freezeBuffer.data, freezeBuffer.length, &clearer_);
+    cache_.Init(buffer.data);
+    voices_.Init(buffer.data);
+    for (Head *head : {&readHeads_[0], &readHeads_[1], &writeHead_})
+    {
+        head->SetClearer(&clearer_);
+        head->SetSnapshot(&snapshot_);
+        head->SetCache(&cache_);
+    }
+    fades_.Init(this);
+    fades_.SetCallback(LOOP_FADE, &BasicLooper::OnLoopFaded);
+    fades_.SetCallback(STOP_READING_FADE, &BasicLooper::OnReadingFadedOut);
+    fades_.SetCallback(STOP_WRITING_FADE, &BasicLooper::OnWritingFadedOut);
     Reset();
     movement_ = Movement::NORMAL;
     direction_ = Direction::FORWARD;
@@ -29,56 +42,91 @@ void Looper::Init(int32_t sampleRate, float *buffer, float *buffer2, int32_t max
     writeHead_.SetLooping(true);
 }
 
-void Looper::Reset()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::Reset()
 {
-    std::srand(static_cast<unsigned>(time(0)));
-    eRand_ = std::rand() / (float)RAND_MAX;
+    eRand_ = random_.NextFloat();
     readHeads_[0].Reset();
     readHeads_[1].Reset();
     writeHead_.Reset();
     bufferSamples_ = 0;
-    bufferSeconds_ = 0.f;
     loopStart_ = 0;
-    loopStartSeconds_ = 0.f;
     loopEnd_ = 0;
     loopLength_ = 0.f;
     intLoopEnd_ = 0;
     intLoopLength_ = 0;
-    loopLengthSeconds_ = 0.f;
-    readPos_ = 0.f;
-    readPosSeconds_ = 0.f;
-    writePos_ = 0.f;
+    UpdateLoopPhases();
+    readPos_ = Phase{};
+    writePos_ = Phase{};
+    samplesToHorizon_ = 0;
+    cache_.Invalidate();
+    voices_.Stop();
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::ClearBuffer()
+{
+    clearer_.Start();
+    // The frozen samples are cleared as well.
+    snapshot_.Stop();
+    // The cache is rebuilt once the buffer is clear.
+    cache_.Invalidate();
+    // The voices would play the stale samples.
+    voices_.Stop();
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::UpdateBufferClear(size_t bytes)
+{
+    clearer_.Sweep(bytes);
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::UpdateFreezeSnapshot(size_t bytes)
+{
+    snapshot_.Sweep(bytes);
 }
 
-void Looper::ClearBuffer()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::UpdateLoopCache()
 {
-    writeHead_.ClearBuffer();
+    // Only the loops of note and flanger modes are cached, and only when
+    // they don't wrap around the end of the buffer. The cleared regions would
+    // be stale in the cache, so wait for the clearing to end.
+    if (clearer_.IsActive() || loopLength_ > kMinSamplesForFlanger || intLoopEnd_ <= intLoopStart_)
+    {
+        cache_.Invalidate();
+
+        return;
+    }
+    cache_.Follow(intLoopStart_, intLoopEnd_);
 }
 
-bool Looper::Buffer(float value)
+template <typename Interpolator, typename Storage>
+bool BasicLooper<Interpolator, Storage>::Buffer(Value value)
 {
     bool end = writeHead_.Buffer(value);
     bufferSamples_ = writeHead_.GetBufferSamples();
-    bufferSeconds_ = bufferSamples_ / static_cast<float>(sampleRate_);
 
     return end;
 }
 
-void Looper::StopBuffering()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::StopBuffering()
 {
     float samples = writeHead_.StopBuffering();
     readHeads_[0].InitBuffer(samples);
     readHeads_[1].InitBuffer(samples);
     loopStart_ = 0;
-    loopStartSeconds_ = 0.f;
     loopEnd_ = bufferSamples_ - 1;
     intLoopEnd_ = loopEnd_;
     loopLength_ = bufferSamples_;
     intLoopLength_ = bufferSamples_;
-    loopLengthSeconds_ = loopLength_ / sampleRate_;
+    UpdateLoopPhases();
 }
 
-void Looper::StartReading(bool now)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::StartReading(bool now)
 {
     if (readingActive_)
     {
@@ -90,11 +138,12 @@ void Looper::StartReading(bool now)
     readingActive_ = true;
     if (!now)
     {
-        startReadingFade.Init(Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, readRate_);
+        fades_.Start(START_READING_FADE, Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, readRate_);
     }
 }
 
-void Looper::StopReading(bool now)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::StopReading(bool now)
 {
     if (!readingActive_)
     {
@@ -109,11 +158,12 @@ void Looper::StopReading(bool now)
     }
     else
     {
-        stopReadingFade.Init(Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, readRate_);
+        fades_.Start(STOP_READING_FADE, Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, readRate_);
     }
 }
 
-void Looper::StartWriting(bool now)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::StartWriting(bool now)
 {
     if (writingActive_)
     {
@@ -123,11 +173,12 @@ void Looper::StartWriting(bool now)
     writingActive_ = true;
     if (!now)
     {
-        startWritingFade.Init(Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, writeRate_);
+        fades_.Start(START_WRITING_FADE, Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, writeRate_);
     }
 }
 
-void Looper::StopWriting(bool now)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::StopWriting(bool now)
 {
     if (!writingActive_)
     {
@@ -140,11 +191,12 @@ void Looper::StopWriting(bool now)
     }
     else
     {
-        stopWritingFade.Init(Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, writeRate_);
+        fades_.Start(STOP_WRITING_FADE, Fader::FadeType::FADE_SINGLE, kSamplesToFadeTrigger, writeRate_);
     }
 }
 
-void Looper::Trigger(bool restart)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::Trigger(bool restart)
 {
     // Update the loop start
     readHeads_[0].SetLoopStart(loopStart_);
@@ -166,21 +218,25 @@ void Looper::Trigger(bool restart)
         {
             writeHead_.ResetPosition();
         }
+        samplesToHorizon_ = 0;
         StartReading(false);
     }
 }
 
-void Looper::SetSamplesToFade(float samples)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetSamplesToFade(float samples)
 {
     readHeads_[0].SetSamplesToFade(samples);
     readHeads_[1].SetSamplesToFade(samples);
     writeHead_.SetSamplesToFade(samples);
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetLoopStart(float start)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetLoopStart(float start)
 {
     // Do not change value if there's a loop fade going.
-    if (loopFade.IsActive() && loopLength_ > kMinSamplesForFlanger)
+    if (fades_.IsActive(LOOP_FADE) && loopLength_ > kMinSamplesForFlanger)
     {
         return;
     }
@@ -208,10 +264,11 @@ void Looper::SetLoopStart(float start)
     }
 
     intLoopStart_ = loopStart_;
-    loopStartSeconds_ = loopStart_ / static_cast<float>(sampleRate_);
     loopEnd_ = readHeads_[!activeReadHead_].GetLoopEnd();
     intLoopEnd_ = loopEnd_;
+    UpdateLoopPhases();
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 
     // In delay mode, keep the loop synched.
     if (loopSync_)
@@ -220,10 +277,11 @@ void Looper::SetLoopStart(float start)
     }
 }
 
-void Looper::SetLoopLength(float length)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetLoopLength(float length)
 {
     // Do not change value if there's a loop fade going.
-    if (loopFade.IsActive() && loopLength_ > kMinSamplesForFlanger)
+    if (fades_.IsActive(LOOP_FADE) && loopLength_ > kMinSamplesForFlanger)
     {
         return;
     }
@@ -241,10 +299,11 @@ void Looper::SetLoopLength(float length)
     }
 
     intLoopLength_ = loopLength_;
-    loopLengthSeconds_ = loopLength_ / sampleRate_;
     loopEnd_ = readHeads_[!activeReadHead_].GetLoopEnd();
     intLoopEnd_ = loopEnd_;
+    UpdateLoopPhases();
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 
     // In delay mode, keep the loop synched.
     if (loopSync_)
@@ -253,7 +312,8 @@ void Looper::SetLoopLength(float length)
     }
 }
 
-void Looper::SetReadRate(float rate)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetReadRate(float rate)
 {
     readHeads_[0].SetRate(rate);
     readHeads_[1].SetRate(rate);
@@ -261,6 +321,7 @@ void Looper::SetReadRate(float rate)
     readSpeed_ = sampleRate_ * readRate_;
     sampleRateSpeed_ = static_cast<int32_t>(sampleRate_ / readRate_);
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
     // In delay mode, when setting the rate back to 1 we flag for a realignment
     // of the heads at the next loop to keep the correct delay time.
     if (loopSync_ && rate == 1.f)
@@ -269,53 +330,66 @@ void Looper::SetReadRate(float rate)
     }
 }
 
-void Looper::SetWriteRate(float rate)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetWriteRate(float rate)
 {
     writeHead_.SetRate(rate);
     writeRate_ = rate;
     writeSpeed_ = sampleRate_ * writeRate_;
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetMovement(Movement movement)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetMovement(Movement movement)
 {
     readHeads_[0].SetMovement(movement);
     readHeads_[1].SetMovement(movement);
     movement_ = movement;
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetDirection(Direction direction)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetDirection(Direction direction)
 {
     readHeads_[0].SetDirection(direction);
     readHeads_[1].SetDirection(direction);
     direction_ = direction;
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetReadPos(float position)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetReadPos(float position)
 {
     readHeads_[0].SetIndex(position);
     readHeads_[1].SetIndex(position);
-    readPos_ = position;
+    readPos_ = Phase::FromFloat(position);
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetWritePos(float position)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetWritePos(float position)
 {
     writeHead_.SetIndex(position);
-    writePos_ = position;
+    writePos_ = Phase::FromFloat(position);
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetLooping(bool looping)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetLooping(bool looping)
 {
     readHeads_[0].SetLooping(looping);
     readHeads_[1].SetLooping(looping);
     looping_ = looping;
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetLoopSync(bool loopSync)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetLoopSync(bool loopSync)
 {
     // If loopSync = true it means we're in delay mode, so the writing head must
     // loop when the reading head does.
@@ -332,113 +406,312 @@ void Looper::SetLoopSync(bool loopSync)
     readHeads_[1].SetLoopSync(loopSync_);
     writeHead_.SetLoopSync(loopSync_);
     crossPointFound_ = false;
+    samplesToHorizon_ = 0;
 }
 
-float Looper::Read()
+template <typename Interpolator, typename Storage>
+typename BasicLooper<Interpolator, Storage>::Value BasicLooper<Interpolator, Storage>::Read()
 {
-    float value = readHeads_[activeReadHead_].Read();
+    Value value = readHeads_[activeReadHead_].Read();
+
+    // Steady playback skips all the fades at once.
+    if (fades_.IsAnyActive(kReadingFades))
+    {
+        // Fade in reading.
+        if (fades_.IsActive(START_READING_FADE))
+        {
+            value = fades_.Process(START_READING_FADE, Value{}, value);
+        }
+        // Fade out reading.
+        else if (fades_.IsActive(STOP_READING_FADE))
+        {
+            value = fades_.Process(STOP_READING_FADE, value, Value{});
+        }
+        else if (!readingActive_)
+        {
+            return Value{};
+        }
+
+        if (fades_.IsActive(LOOP_FADE))
+        {
+            value = fades_.Process(LOOP_FADE, readHeads_[!activeReadHead_].Read(), value);
+        }
+    }
+    else if (!readingActive_)
+    {
+        return Value{};
+    }
 
-    // Fade in reading.
-    if (startReadingFade.IsActive())
+    if (freeze_ > 0)
     {
-        startReadingFade.Process(0, value);
-        value = startReadingFade.GetOutput();
+        // Crossfade with the frozen buffer.
+        value = Fader::EqualCrossFade(value, readHeads_[activeReadHead_].ReadFrozen(), freeze_);
     }
-    // Fade out reading.
-    else if (stopReadingFade.IsActive())
+
+    return value;
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::Write(Value input)
+{
+    // Steady recording skips all the fades at once.
+    if (fades_.IsAnyActive(kWritingFades))
     {
-        if (Fader::FadeStatus::ENDED == stopReadingFade.Process(value, 0))
+        // Fade in writing.
+        if (fades_.IsActive(START_WRITING_FADE))
         {
-            readHeads_[0].SetActive(false);
-            readHeads_[1].SetActive(false);
-            readingActive_ = false;
-            // If the looper had been re-triggered while playing, at the end of
-            // the fade out we reset the heads and then fade in reading.
-            if (triggered_)
-            {
-                readHeads_[0].ResetPosition();
-                readHeads_[1].ResetPosition();
-                if (loopSync_)
-                {
-                    writeHead_.ResetPosition();
-                }
-                StartReading(false);
-                triggered_ = false;
-            }
+            input = fades_.Process(START_WRITING_FADE, Value{}, input);
+        }
+        // Fade out writing.
+        else if (fades_.IsActive(STOP_WRITING_FADE))
+        {
+            input = fades_.Process(STOP_WRITING_FADE, input, Value{});
+        }
+        else if (!writingActive_)
+        {
+            return;
+        }
+
+        if (freeze_ < 1.f && fades_.IsActive(HEADS_CROSS_FADE))
+        {
+            input = fades_.Process(HEADS_CROSS_FADE, input, writeHead_.Read());
         }
-        value = stopReadingFade.GetOutput();
     }
-    else if (!readingActive_)
+    else if (!writingActive_)
     {
-        return 0.f;
+        return;
     }
 
-    if (loopFade.IsActive())
+    writeHead_.Write(input);
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::OnReadingFadedOut()
+{
+    readHeads_[0].SetActive(false);
+    readHeads_[1].SetActive(false);
+    readingActive_ = false;
+    // If the looper had been re-triggered while playing, at the end of
+    // the fade out we reset the heads and then fade in reading.
+    if (triggered_)
     {
-        if (Fader::FadeStatus::ENDED == loopFade.Process(readHeads_[!activeReadHead_].Read(), value))
+        readHeads_[0].ResetPosition();
+        readHeads_[1].ResetPosition();
+        if (loopSync_)
         {
-            readHeads_[!activeReadHead_].SetLoopStartAndLength(loopStart_, loopLength_);
-            readHeads_[!activeReadHead_].SetIndex(readPos_);
-            if (loopSync_)
-            {
-                writeHead_.SetIndex(readPos_);
-            }
+            writeHead_.ResetPosition();
         }
-        value = loopFade.GetOutput();
+        StartReading(false);
+        triggered_ = false;
+        samplesToHorizon_ = 0;
     }
+}
 
-    if (freeze_ > 0)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::OnWritingFadedOut()
+{
+    writingActive_ = false;
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::OnLoopFaded()
+{
+    readHeads_[!activeReadHead_].SetLoopStartAndLength(loopStart_, loopLength_);
+    readHeads_[!activeReadHead_].SetIndex(readPos_);
+    if (loopSync_)
     {
-        // Crossfade with the frozen buffer.
-        value = Fader::EqualCrossFade(value, readHeads_[activeReadHead_].ReadFrozen(), freeze_);
+        writeHead_.SetIndex(readPos_);
     }
+    samplesToHorizon_ = 0;
+}
 
-    // Handle fade on re-triggering.
-    if (triggerFade.IsActive())
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::ReadBlock(Value *out, size_t size)
+{
+    size_t done{};
+    while (done < size)
     {
-        triggerFade.Process(0, value);
-        value = triggerFade.GetOutput();
+        // Fading out, crossfading, freezing and loop changes need the full
+        // per-sample handling.
+        bool loopChanging = loopChanged_ && (!loopLengthGrown_ || !IsGoingForward());
+        if (!readingActive_ || loopChanging || freeze_ > 0 || fades_.IsAnyActive(Bit(STOP_READING_FADE) | Bit(LOOP_FADE)))
+        {
+            out[done++] = Read();
+            UpdateReadPos();
+            continue;
+        }
+
+        Action action;
+        size_t read = readHeads_[activeReadHead_].ReadBlock(out + done, size - done, action);
+        // Fading in from silence just scales the block.
+        if (fades_.IsActive(START_READING_FADE))
+        {
+            fades_.template ProcessBlock<Value>(START_READING_FADE, nullptr, out + done, out + done, read);
+        }
+        done += read;
+        readHeads_[!activeReadHead_].SetIndex(readHeads_[activeReadHead_].GetPhase());
+        readHeads_[!activeReadHead_].SetOffset(readHeads_[activeReadHead_].GetOffset());
+        HandleReadAction(action);
     }
+}
 
-    return value;
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::WriteBlock(const Value *in, size_t size)
+{
+    size_t done{};
+    while (done < size)
+    {
+        // Fades and the tracking of the heads' cross point need the full
+        // per-sample handling, but the tracking can be skipped up to the
+        // next predicted event.
+        bool trackHeads = freeze_ < 1.f && (readSpeed_ != writeSpeed_ || !IsGoingForward());
+        bool crossFading = freeze_ < 1.f && fades_.IsActive(HEADS_CROSS_FADE);
+        if (!writingActive_ || crossFading || (trackHeads && samplesToHorizon_ <= 0) || fades_.IsAnyActive(Bit(START_WRITING_FADE) | Bit(STOP_WRITING_FADE)))
+        {
+            Write(in[done++]);
+            UpdateWritePos();
+            continue;
+        }
+
+        Action action;
+        size_t span = trackHeads ? std::min(size - done, static_cast<size_t>(samplesToHorizon_)) : size - done;
+        size_t written = writeHead_.WriteBlock(in + done, span, action);
+        samplesToHorizon_ = trackHeads ? samplesToHorizon_ - static_cast<int32_t>(written) : 0;
+        done += written;
+        HandleWriteAction(action);
+    }
 }
 
-void Looper::Write(float input)
+template <typename Interpolator, typename Storage>
+size_t BasicLooper<Interpolator, Storage>::GetIndependentSpan(size_t size)
 {
-    // Fade in writing.
-    if (startWritingFade.IsActive())
+    if (!writingActive_ && !fades_.IsAnyActive(kWritingFades))
+    {
+        return size;
+    }
+
+    // Going backwards, a changed loop makes the reading heads jump right
+    // away.
+    if (loopChanged_ && !IsGoingForward())
     {
-        startWritingFade.Process(0, input);
-        input = startWritingFade.GetOutput();
+        return 1;
     }
-    // Fade out writing.
-    else if (stopWritingFade.IsActive())
+
+    // The end of these fades makes the heads jump while reading, the reading
+    // ones back to the loop and, in delay mode, the writing one to the
+    // reading one, so it gets a span of its own.
+    for (Fade fade : {LOOP_FADE, STOP_READING_FADE})
     {
-        if (Fader::FadeStatus::ENDED == stopWritingFade.Process(input, 0))
+        if (fades_.IsActive(fade))
         {
-            writingActive_ = false;
+            size_t samples = fades_.SamplesToEnd(fade, size + 1);
+            size = std::min(size, samples > 1 ? samples - 1 : 1);
         }
-        input = stopWritingFade.GetOutput();
     }
-    else if (!writingActive_)
+
+    // When the speeds differ, the writing head looks for the reading one at
+    // each horizon, which a reading action resets, and once the heads have
+    // crossfaded, so that must happen at the end of a span, when the reading
+    // head is where it would be.
+    bool trackHeads = freeze_ < 1.f && (readSpeed_ != writeSpeed_ || !IsGoingForward());
+    if (trackHeads)
     {
-        return;
+        size = fades_.IsActive(HEADS_CROSS_FADE) ? fades_.SamplesToEnd(HEADS_CROSS_FADE, size) : std::min(size, static_cast<size_t>(std::max(samplesToHorizon_, 0)) + 1);
+    }
+
+    // Only the reading heads the writing head can get close to are followed,
+    // up to where any of them leaves its straight line. The inactive one only
+    // moves on its own while the loop changes.
+    int32_t writePos = writeHead_.GetIntPosition();
+    float writeRate = std::fabs(writeHead_.GetStep().ToFloat());
+    size_t writeRoom = static_cast<size_t>(writeHead_.SamplesToBoundary()) + 1;
+    int32_t heads = fades_.IsActive(LOOP_FADE) || loopChanged_ ? 2 : 1;
+    for (int32_t i = 0; i < heads; i++)
+    {
+        Head &head = readHeads_[i ? !activeReadHead_ : activeReadHead_];
+        int32_t reach = static_cast<int32_t>(std::ceil(size * (std::fabs(head.GetStep().ToFloat()) + writeRate))) + Interpolator::kTaps;
+        size_t room = static_cast<size_t>(head.SamplesToBoundary()) + 1;
+        if (trackHeads)
+        {
+            size = std::min(size, room);
+        }
+        // Past their boundary, the heads can jump anywhere in the loop.
+        int32_t headPos = head.GetIntPosition();
+        bool close = DistanceToRegion(writePos, headPos, headPos) <= reach ||
+                     (room < size && DistanceToRegion(writePos, intLoopStart_, intLoopEnd_) <= reach) ||
+                     (writeRoom < size && DistanceToRegion(headPos, intLoopStart_, intLoopEnd_) <= reach);
+        if (close)
+        {
+            size = SamplesToWritten(head, std::min(size, std::min(room, writeRoom)));
+        }
     }
 
-    if (freeze_ < 1.f && headsCrossFade.IsActive())
+    if (voices_.IsActive())
     {
-        headsCrossFade.Process(input, writeHead_.Read());
-        input = headsCrossFade.GetOutput();
+        size = std::min(size, writeRoom);
+        int64_t write = writeHead_.GetPhase().Raw();
+        int64_t step = writeHead_.GetStep().Raw();
+        size = voices_.SamplesToOverwrite(size, [write, step](size_t frame) { return Phase::FromRaw(write + static_cast<int64_t>(frame) * step).Int(); });
     }
 
-    writeHead_.Write(input);
+    return size;
+}
+
+template <typename Interpolator, typename Storage>
+size_t BasicLooper<Interpolator, Storage>::SamplesToWritten(Head &head, size_t size)
+{
+    int64_t index = head.GetPhase().Raw();
+    int64_t step = head.GetStep().Raw();
+    int64_t write = writeHead_.GetPhase().Raw();
+    int64_t writeStep = writeHead_.GetStep().Raw();
+    // The samples written before the current one.
+    int32_t lo = writeHead_.GetIntPosition();
+    int32_t hi = lo;
+    for (size_t i = 1; i < size; i++)
+    {
+        index += step;
+        // The integral positions are read without interpolating.
+        Phase position = Phase::FromRaw(index);
+        int32_t first = position.FracBits() ? position.Int() - Interpolator::kBefore : position.Int();
+        int32_t last = position.FracBits() ? position.Int() + Interpolator::kAfter : position.Int();
+        if (first <= hi && last >= lo)
+        {
+            return i;
+        }
+        write += writeStep;
+        lo = std::min(lo, Phase::FromRaw(write).Int());
+        hi = std::max(hi, Phase::FromRaw(write).Int());
+    }
+
+    return size;
 }
 
-float Looper::Degrade(float input)
+template <typename Interpolator, typename Storage>
+int32_t BasicLooper<Interpolator, Storage>::DistanceToRegion(int32_t position, int32_t start, int32_t end)
+{
+    if (bufferSamples_ <= 0)
+    {
+        return 0;
+    }
+
+    auto forward = [this](int32_t from, int32_t to) {
+        int32_t distance = (to - from) % bufferSamples_;
+        return distance < 0 ? distance + bufferSamples_ : distance;
+    };
+    if (forward(start, position) <= forward(start, end))
+    {
+        return 0;
+    }
+
+    return std::min(forward(position, start), forward(end, position));
+}
+
+template <typename Interpolator, typename Storage>
+typename BasicLooper<Interpolator, Storage>::Value BasicLooper<Interpolator, Storage>::Degrade(Value input)
 {
     if (degradation_ > 0.f)
     {
-        float d = 1.f - ((std::rand() / (float)RAND_MAX) * degradation_) * 0.5f;
+        float d = 1.f - (random_.NextFloat() * degradation_) * 0.5f;
 
         // Use an Euclidean rhythm generator to apply degradation at fixed
         // buffer points
@@ -448,9 +721,67 @@ float Looper::Degrade(float input)
     return input;
 }
 
-void Looper::FadeReadingToResetPosition()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::DegradeBlock(Value *buffer, size_t size)
+{
+    if (degradation_ <= 0.f)
+    {
+        return;
+    }
+
+    // The block is degraded before being written, so the rhythm generator
+    // runs over the positions the writing head is about to take.
+    constexpr size_t kNoiseBlockSize{32};
+    float noise[kNoiseBlockSize];
+    bool onsets[kNoiseBlockSize];
+    Phase index = writeHead_.GetPhase();
+    size_t done{};
+    while (done < size)
+    {
+        size_t span = std::min(size - done, kNoiseBlockSize);
+        random_.Fill(noise, span);
+        index = writeHead_.BresenhamEuclidean(eRand_ * 64, degradation_, index, onsets, span);
+        for (size_t i = 0; i < span; i++)
+        {
+            buffer[done + i] *= onsets[i] ? 1.f : 1.f - (noise[i] * degradation_) * 0.5f;
+        }
+        done += span;
+    }
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::NoteOn(int32_t note, float velocity)
+{
+    if (velocity <= 0.f)
+    {
+        NoteOff(note);
+
+        return;
+    }
+
+    // The voices don't wrap around the end of the buffer, they play the
+    // loop up to there.
+    int32_t length = std::min(intLoopLength_, bufferSamples_ - intLoopStart_);
+    float rate = std::pow(2.f, (note - kVoiceRootNote) / 12.f);
+    voices_.NoteOn(note, IsGoingForward() ? rate : -rate, velocity, intLoopStart_, length);
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::NoteOff(int32_t note)
+{
+    voices_.NoteOff(note);
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::ReadVoices(Value *out, size_t size)
+{
+    voices_.Process(out, size);
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::FadeReadingToResetPosition()
 {
-    if (loopFade.IsActive())
+    if (fades_.IsActive(LOOP_FADE))
     {
         return;
     }
@@ -481,13 +812,15 @@ void Looper::FadeReadingToResetPosition()
     // Active: length - buffer
     // inactive: length
     float samples = std::min(readHeads_[activeReadHead_].GetSamplesToFade(), readHeads_[!activeReadHead_].GetSamplesToFade());
-    loopFade.Init(Fader::FadeType::FADE_SINGLE, samples, readRate_);
+    fades_.Start(LOOP_FADE, Fader::FadeType::FADE_SINGLE, samples, readRate_);
     activeReadHead_ = !activeReadHead_;
+    samplesToHorizon_ = 0;
 }
 
-void Looper::UpdateReadPos()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::UpdateReadPos()
 {
-    Head::Action action = readHeads_[activeReadHead_].UpdatePosition();
+    Action action = readHeads_[activeReadHead_].UpdatePosition();
 
     // When the loop length shrunk, the inactive reading head dictates when
     // looping occurs, so we need to update its position as well.
@@ -498,43 +831,139 @@ void Looper::UpdateReadPos()
     // Otherwise, just sync it with the active reading head.
     else
     {
-        readHeads_[!activeReadHead_].SetIndex(readHeads_[activeReadHead_].GetPosition());
+        readHeads_[!activeReadHead_].SetIndex(readHeads_[activeReadHead_].GetPhase());
         readHeads_[!activeReadHead_].SetOffset(readHeads_[activeReadHead_].GetOffset());
     }
 
+    HandleReadAction(action);
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::HandleReadAction(Action action)
+{
     // Note that in delay mode we don't need to fade the loop, and we wouldn't do
     // it anyway because it'd need a few samples from outside the loop and these
     // samples are probably unrelated.Fading when the loop changes yields the
     // same problem, but it sounds better than if we don't.
     // Also note that when going backwards, when the loop changes we fade right
     // away.
-    if ((loopChanged_ && !IsGoingForward()) || (Head::Action::LOOP == action && loopLength_ > kMinSamplesForFlanger && (loopChanged_ || (!loopSync_ && loopLength_ < bufferSamples_))))
+    if ((loopChanged_ && !IsGoingForward()) || (Action::LOOP == action && loopLength_ > kMinSamplesForFlanger && (loopChanged_ || (!loopSync_ && loopLength_ < bufferSamples_))))
     {
         FadeReadingToResetPosition();
         loopChanged_ = false;
     }
     // Here we handle normal looping in delay mode or when the loop length is
     // small.
-    else if (Head::Action::LOOP == action && (loopLength_ <= kMinSamplesForFlanger || loopSync_) && loopLength_ < bufferSamples_)
+    else if (Action::LOOP == action && (loopLength_ <= kMinSamplesForFlanger || loopSync_) && loopLength_ < bufferSamples_)
     {
         readHeads_[0].ResetPosition();
         readHeads_[1].ResetPosition();
     }
-    else if (Head::Action::STOP == action)
+    else if (Action::STOP == action)
     {
         StopReading(false);
     }
 
-    readPos_ = readHeads_[activeReadHead_].GetPosition();
-    readPosSeconds_ = readPos_ / sampleRate_;
+    // The heads may have jumped, predict the next event again.
+    if (Action::NO_ACTION != action)
+    {
+        samplesToHorizon_ = 0;
+    }
+
+    readPos_ = readHeads_[activeReadHead_].GetPhase();
 }
 
-void Looper::UpdateWritePos()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::UpdateWritePos()
 {
-    Head::Action action = writeHead_.UpdatePosition();
-    writePos_ = writeHead_.GetIntPosition();
+    HandleWriteAction(writeHead_.UpdatePosition());
+
+    // When reading and writing speeds differ or we're going backwards, we
+    // calculate the point where the two heads will meet and set up a writing
+    // fade at that point.
+    if (freeze_ >= 1.f || fades_.IsActive(HEADS_CROSS_FADE) || (readSpeed_ == writeSpeed_ && IsGoingForward()))
+    {
+        samplesToHorizon_ = 0;
+
+        return;
+    }
 
-    if (Head::Action::LOOP == action && loopSync_)
+    // Nothing can happen before the horizon.
+    if (samplesToHorizon_ > 0)
+    {
+        samplesToHorizon_--;
+
+        return;
+    }
+
+    headsDistance_ = CalculateDistance(readPos_, writePos_, readSpeed_, writeSpeed_, direction_).ToFloat();
+    float samplesToFade = writeHead_.GetSamplesToFade();
+
+    // Calculate the cross point when the two heads are close enough.
+    if (!crossPointFound_ && headsDistance_ > 0 && headsDistance_ <= samplesToFade * 2)
+    {
+        CalculateCrossPoint();
+    }
+
+    if (crossPointFound_)
+    {
+        float samples = CalculateDistance(writePos_, Phase::FromFloat(crossPoint_), writeSpeed_, 0, Direction::FORWARD).ToFloat();
+        // If the condition are met, set up the cross point fade.
+        if (samples > 0 && samples <= samplesToFade)
+        {
+            crossPointFound_ = false;
+            fades_.Start(HEADS_CROSS_FADE, Fader::FadeType::FADE_OUT_IN, samples * 2, writeRate_);
+        }
+        // Only the writing head moves towards the cross point. Going
+        // backwards, the distance is measured past the cross point instead,
+        // so it keeps growing until the writing head reaches it.
+        else if (samples > samplesToFade && IsGoingForward())
+        {
+            samplesToHorizon_ = PredictHorizon(samples - samplesToFade, std::fabs(writeRate_));
+        }
+    }
+    // The heads can't get closer than the sum of their rates each sample.
+    else if (headsDistance_ > samplesToFade * 2)
+    {
+        samplesToHorizon_ = PredictHorizon(headsDistance_ - samplesToFade * 2, std::fabs(readRate_) + std::fabs(writeRate_));
+    }
+}
+
+template <typename Interpolator, typename Storage>
+int32_t BasicLooper<Interpolator, Storage>::PredictHorizon(float distance, float rate)
+{
+    // The drunk movement makes the reading head jump at random.
+    if (Movement::DRUNK == movement_ || rate <= 0.f)
+    {
+        return 0;
+    }
+
+    // The distance between the heads jumps when the writing head enters or
+    // leaves the loop, or wraps around the buffer.
+    float writePos = writePos_.ToFloat();
+    float boundary = std::min(std::min(std::fabs(writePos - loopStart_), std::fabs(writePos - loopEnd_)), std::min(writePos, bufferSamples_ - writePos));
+    float horizon = distance / rate;
+    if (writeRate_ != 0.f)
+    {
+        horizon = std::min(horizon, boundary / std::fabs(writeRate_));
+    }
+
+    // Keep a sample of margin for the rounding.
+    return static_cast<int32_t>(std::min(horizon, static_cast<float>(kMaxHorizon))) - 1;
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::HandleWriteAction(Action action)
+{
+    writePos_ = Phase::FromInt(writeHead_.GetIntPosition());
+
+    // The heads may jump, predict the next event again.
+    if (Action::NO_ACTION != action)
+    {
+        samplesToHorizon_ = 0;
+    }
+
+    if (Action::LOOP == action && loopSync_)
     {
         // Loop the writing head.
         if (loopLength_ < bufferSamples_)
@@ -552,88 +981,89 @@ void Looper::UpdateWritePos()
             mustSyncHeads_ = false;
         }
     }
-
-    // When reading and writing speeds differ or we're going backwards, we
-    // calculate the point where the two heads will meet and set up a writing
-    // fade at that point.
-    if (freeze_ < 1.f && !headsCrossFade.IsActive() && (readSpeed_ != writeSpeed_ || !IsGoingForward()))
-    {
-        headsDistance_ = CalculateDistance(readPos_, writePos_, readSpeed_, writeSpeed_, direction_);
-
-        // Calculate the cross point when the two heads are close enough.
-        if (!crossPointFound_ && headsDistance_ > 0 && headsDistance_ <= writeHead_.GetSamplesToFade() * 2)
-        {
-            CalculateCrossPoint();
-        }
-
-        if (crossPointFound_)
-        {
-            float samples = CalculateDistance(writePos_, crossPoint_, writeSpeed_, 0, Direction::FORWARD);
-            // If the condition are met, set up the cross point fade.
-            if (samples > 0 && samples <= writeHead_.GetSamplesToFade())
-            {
-                crossPointFound_ = false;
-                headsCrossFade.Init(Fader::FadeType::FADE_OUT_IN, samples * 2, writeRate_);
-            }
-        }
-    }
 }
 
-void Looper::ToggleDirection()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::ToggleDirection()
 {
     direction_ = readHeads_[0].ToggleDirection();
     readHeads_[1].ToggleDirection();
+    samplesToHorizon_ = 0;
 }
 
-void Looper::SetFreeze(float amount)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetFreeze(float amount)
 {
     freeze_ = amount;
     readHeads_[0].SetFreeze(amount);
     readHeads_[1].SetFreeze(amount);
+    bool freezing = writeHead_.IsFreezing();
     writeHead_.SetFreeze(amount);
+    // Snapshot the loop when freezing starts, copying it ahead of the
+    // reading head.
+    if (!freezing && writeHead_.IsFreezing())
+    {
+        int32_t length = intLoopEnd_ - intLoopStart_ + 1;
+        snapshot_.Start(intLoopStart_, length > 0 ? length : length + bufferSamples_, bufferSamples_, readPos_.Int(), IsGoingForward());
+    }
 }
 
-void Looper::SetDegradation(float amount)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetDegradation(float amount)
 {
     degradation_ = amount;
 }
 
-float Looper::CalculateDistance(float a, float b, float aSpeed, float bSpeed, Direction direction)
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::SetSeed(uint32_t seed)
+{
+    random_.Seed(seed);
+}
+
+template <typename Interpolator, typename Storage>
+float BasicLooper<Interpolator, Storage>::CalculateDistance(float a, float b, float aSpeed, float bSpeed, Direction direction)
+{
+    return CalculateDistance(Phase::FromFloat(a), Phase::FromFloat(b), aSpeed, bSpeed, direction).ToFloat();
+}
+
+template <typename Interpolator, typename Storage>
+Phase BasicLooper<Interpolator, Storage>::CalculateDistance(Phase a, Phase b, float aSpeed, float bSpeed, Direction direction)
 {
     if (a == b)
     {
-        return 0;
+        return Phase{};
     }
 
-    if (loopStart_ > loopEnd_)
+    if (loopStartPhase_ > loopEndPhase_)
     {
         // Broken loop, case where a is in the second segment and b in the first.
-        if (a >= loopStart_ && b <= loopEnd_)
+        if (a >= loopStartPhase_ && b <= loopEndPhase_)
         {
-            return (IsGoingForward() && aSpeed > bSpeed) ? loopLength_ - ((loopEnd_ - b) + (a - loopStart_)) : (loopEnd_ - b) + (a - loopStart_);
+            return (IsGoingForward() && aSpeed > bSpeed) ? loopLengthPhase_ - ((loopEndPhase_ - b) + (a - loopStartPhase_)) : (loopEndPhase_ - b) + (a - loopStartPhase_);
         }
 
         // Broken loop, case where b is in the second segment and a in the first.
-        if (b >= loopStart_ && a <= loopEnd_)
+        if (b >= loopStartPhase_ && a <= loopEndPhase_)
         {
-            return (!IsGoingForward() || bSpeed > aSpeed) ? loopLength_ - ((loopEnd_ - a) + (b - loopStart_)) : (loopEnd_ - a) + (b - loopStart_);
+            return (!IsGoingForward() || bSpeed > aSpeed) ? loopLengthPhase_ - ((loopEndPhase_ - a) + (b - loopStartPhase_)) : (loopEndPhase_ - a) + (b - loopStartPhase_);
         }
     }
 
     if (a > b)
     {
-        return (IsGoingForward() && aSpeed > bSpeed) ? loopLength_ - (a - b) : a - b;
+        return (IsGoingForward() && aSpeed > bSpeed) ? loopLengthPhase_ - (a - b) : a - b;
     }
 
-    return (!IsGoingForward() || bSpeed > aSpeed) ? loopLength_ - (b - a) : b - a;
+    return (!IsGoingForward() || bSpeed > aSpeed) ? loopLengthPhase_ - (b - a) : b - a;
 }
 
-void Looper::CalculateCrossPoint()
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::CalculateCrossPoint()
 {
     // Do not calculate the cross point if the write head is outside of
     // the loop (this is especially true in looper mode, when it roams
     // along all the buffer).
-    if ((loopEnd_ > loopStart_ && (writePos_ < loopStart_ || writePos_ > loopEnd_)) || (loopStart_ > loopEnd_ && writePos_ < loopStart_ && writePos_ > loopEnd_))
+    if ((loopEndPhase_ > loopStartPhase_ && (writePos_ < loopStartPhase_ || writePos_ > loopEndPhase_)) || (loopStartPhase_ > loopEndPhase_ && writePos_ < loopStartPhase_ && writePos_ > loopEndPhase_))
     {
         return;
     }
@@ -645,38 +1075,65 @@ void Looper::CalculateCrossPoint()
     }
 
     float deltaTime = headsDistance_ / relSpeed;
-    crossPoint_ = writePos_ + writeSpeed_ * deltaTime;
+    Phase crossPoint = writePos_ + Phase::FromFloat(writeSpeed_ * deltaTime);
 
     // Normal loop
-    if (loopEnd_ > loopStart_)
+    if (loopEndPhase_ > loopStartPhase_)
     {
         // Wrap the crossing point if it's outside of the loop.
-        if (crossPoint_ > loopEnd_)
+        if (crossPoint > loopEndPhase_)
         {
-            crossPoint_ = loopStart_ + std::fmod(crossPoint_, loopLength_);
+            crossPoint = loopStartPhase_ + Phase::FromRaw(crossPoint.Raw() % loopLengthPhase_.Raw());
         }
-        else if (crossPoint_ < loopStart_)
+        else if (crossPoint < loopStartPhase_)
         {
-            crossPoint_ = loopStart_ + std::fmod(crossPoint_ + loopStart_, loopLength_);
+            crossPoint = loopStartPhase_ + Phase::FromRaw((crossPoint + loopStartPhase_).Raw() % loopLengthPhase_.Raw());
         }
     }
     // Inverted loop
     else
     {
         // Wrap the crossing point if it's outside of the buffer.
-        if (crossPoint_ >= bufferSamples_)
+        if (crossPoint >= Phase::FromInt(bufferSamples_))
         {
-            crossPoint_ = std::fmod(crossPoint_, loopLength_);
+            crossPoint = Phase::FromRaw(crossPoint.Raw() % loopLengthPhase_.Raw());
         }
         // If the cross point falls just between the loop's start and end point,
         // nudge it forward.
-        if (crossPoint_ > loopEnd_ && crossPoint_ < loopStart_)
+        if (crossPoint > loopEndPhase_ && crossPoint < loopStartPhase_)
         {
-            crossPoint_ = loopStart_ + (crossPoint_ - loopEnd_);
+            crossPoint = loopStartPhase_ + (crossPoint - loopEndPhase_);
         }
     }
 
-    crossPoint_ = std::floor(crossPoint_);
+    crossPoint_ = crossPoint.Int();
 
     crossPointFound_ = true;
-}
\ No newline at end of file
+}
+
+template <typename Interpolator, typename Storage>
+void BasicLooper<Interpolator, Storage>::UpdateLoopPhases()
+{
+    loopStartPhase_ = Phase::FromFloat(loopStart_);
+    loopEndPhase_ = Phase::FromFloat(loopEnd_);
+    loopLengthPhase_ = Phase::FromFloat(loopLength_);
+}
+
+template class wreath::BasicLooper<LinearInterpolator, FloatStorage>;
+template class wreath::BasicLooper<HermiteInterpolator, FloatStorage>;
+template class wreath::BasicLooper<SincInterpolator<>, FloatStorage>;
+template class wreath::BasicLooper<LinearInterpolator, Int16Storage>;
+template class wreath::BasicLooper<HermiteInterpolator, Int16Storage>;
+template class wreath::BasicLooper<SincInterpolator<>, Int16Storage>;
+template class wreath::BasicLooper<LinearInterpolator, Packed24Storage>;
+template class wreath::BasicLooper<HermiteInterpolator, Packed24Storage>;
+template class wreath::BasicLooper<SincInterpolator<>, Packed24Storage>;
+template class wreath::BasicLooper<LinearInterpolator, InterleavedStorage<FloatStorage>>;
+template class wreath::BasicLooper<HermiteInterpolator, InterleavedStorage<FloatStorage>>;
+template class wreath::BasicLooper<SincInterpolator<>, InterleavedStorage<FloatStorage>>;
+template class wreath::BasicLooper<LinearInterpolator, InterleavedStorage<Int16Storage>>;
+template class wreath::BasicLooper<HermiteInterpolator, InterleavedStorage<Int16Storage>>;
+template class wreath::BasicLooper<SincInterpolator<>, InterleavedStorage<Int16Storage>>;
+template class wreath::BasicLooper<LinearInterpolator, InterleavedStorage<Packed24Storage>>;
+template class wreath::BasicLooper<HermiteInterpolator, InterleavedStorage<Packed24Storage>>;
+template class wreath::BasicLooper<SincInterpolator<>, InterleavedStorage<Packed24Storage>>;
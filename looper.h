@@ -1,8 +1,11 @@
 #pragma once
 
+#include "fade_scheduler.h"
 #include "head.h"
-#include <ctime>
+#include "random.h"
+#include "voice_bank.h"
 #include <cstdint>
+#include <cstddef>
 
 namespace wreath
 {
@@ -10,26 +13,76 @@ namespace wreath
      * @brief Represents the main looper, with a reading and a writing head.
      * @author Roberto Noris
      * @date Nov 2021
+     *
+     * @tparam Interpolator the policy used by the reading heads
+     * @tparam Storage the policy used to keep the samples in the buffers
      */
-    class Looper
+    template <typename Interpolator = LinearInterpolator, typename Storage = FloatStorage>
+    class BasicLooper
     {
     public:
-        Looper() {}
-        ~Looper() {}
+        BasicLooper() {}
+        ~BasicLooper() {}
+
+        using Head = BasicHead<Interpolator, Storage>;
+        using Sample = typename Storage::Sample;
+        using Value = typename Storage::Value;
+        using Action = typename Head::Action;
 
         /**
          * @brief Initializes the looper the first time.
          *
          * @param sampleRate
-         * @param buffer
-         * @param maxBufferSamples
+         * @param buffer the main buffer
+         * @param freezeBuffer the buffer for the frozen loop
+         * @param maxBufferSamples the length of the buffers in samples
          */
-        void Init(int32_t sampleRate, float *buffer, float *buffer2, int32_t maxBufferSamples);
+        void Init(int32_t sampleRate, Sample *buffer, Sample *freezeBuffer, int32_t maxBufferSamples)
+        {
+            Init(sampleRate, BufferSpan<Storage>{buffer, maxBufferSamples}, BufferSpan<Storage>{freezeBuffer, maxBufferSamples});
+        }
+        /**
+         * @brief Initializes the looper the first time, on the given spans.
+         *
+         * @param sampleRate
+         * @param buffer the main buffer
+         * @param freezeBuffer the buffer for the frozen loop, the loops longer
+         * than it are frozen in part and an empty one freezes nothing, the
+         * frozen loop is then read from the main buffer
+         */
+        void Init(int32_t sampleRate, BufferSpan<Storage> buffer, BufferSpan<Storage> freezeBuffer);
         /**
          * @brief Resets the looper when needed.
          */
         void Reset();
+        /**
+         * @brief Starts clearing the buffers. The clearing is spread over the
+         * next calls to UpdateBufferClear(), meanwhile the regions not yet
+         * cleared are read as silence.
+         */
         void ClearBuffer();
+        /**
+         * @brief Clears the next chunks of the buffers, for at most the given
+         * amount of bytes plus the leftover of the previous calls.
+         *
+         * @param bytes
+         */
+        void UpdateBufferClear(size_t bytes);
+        inline bool IsClearingBuffer() { return clearer_.IsActive(); }
+        /**
+         * @brief Copies the next chunks of the frozen loop in the freeze
+         * buffer, for at most the given amount of bytes plus the leftover of
+         * the previous calls.
+         *
+         * @param bytes
+         */
+        void UpdateFreezeSnapshot(size_t bytes);
+        /**
+         * @brief Moves the cache of the short loops to the current loop, when
+         * it's short enough to fit, loading the samples that entered it.
+         * Call this once per block, after the loop changes.
+         */
+        void UpdateLoopCache();
         /**
          * @brief Writes the given value in the buffer during the buffering procedure.
          *
@@ -37,7 +90,7 @@ namespace wreath
          * @return true
          * @return false
          */
-        bool Buffer(float value);
+        bool Buffer(Value value);
         /**
          * @brief Completes the buffering procedure.
          */
@@ -146,22 +199,84 @@ namespace wreath
         /**
          * @brief Reads the current value from the buffer.
          *
-         * @return float
+         * @return Value
          */
-        float Read();
+        Value Read();
         /**
          * @brief Writes the provided value to the buffer.
          *
          * @param input
          */
-        void Write(float input);
+        void Write(Value input);
+        /**
+         * @brief Reads the given number of samples from the buffer, updating
+         * the reading position after each one. This is equivalent to calling
+         * Read() and UpdateReadPos() for each sample, but when nothing is
+         * fading the samples are read in contiguous spans.
+         *
+         * @param out
+         * @param size
+         */
+        void ReadBlock(Value *out, size_t size);
+        /**
+         * @brief Writes the given number of samples to the buffer, updating
+         * the writing position after each one. This is equivalent to calling
+         * Write() and UpdateWritePos() for each sample, but when nothing is
+         * fading the samples are written in contiguous spans.
+         *
+         * @param in
+         * @param size
+         */
+        void WriteBlock(const Value *in, size_t size);
+        /**
+         * @brief Returns how many of the given samples can be read with
+         * ReadBlock() before being written with WriteBlock(), and the voices
+         * read after, the same as one sample at a time: the span ends before
+         * a reading head reaches what the writing head has just written, or
+         * the writing head what a voice has just read.
+         *
+         * @param size
+         * @return size_t at least one sample
+         */
+        size_t GetIndependentSpan(size_t size);
         /**
          * @brief Applies degradation to the given signal.
          *
          * @param input
-         * @return float
+         * @return Value
          */
-        float Degrade(float input);
+        Value Degrade(Value input);
+        /**
+         * @brief Applies degradation to the given block, in place, before
+         * it's written. The noise is generated in chunks, the rhythm gating
+         * it is run per sample over the writing head's next positions.
+         *
+         * @param buffer
+         * @param size
+         */
+        void DegradeBlock(Value *buffer, size_t size);
+        /**
+         * @brief Starts a voice playing the current loop at the pitch of the
+         * given note, kVoiceRootNote being the recorded pitch. The voices go
+         * in the looper's direction and keep their loop when it changes.
+         *
+         * @param note
+         * @param velocity in the [0, 1] range, zero releasing the note
+         */
+        void NoteOn(int32_t note, float velocity);
+        /**
+         * @brief Releases the voices playing the given note.
+         *
+         * @param note
+         */
+        void NoteOff(int32_t note);
+        /**
+         * @brief Adds the playing voices to the given block.
+         *
+         * @param out
+         * @param size
+         */
+        void ReadVoices(Value *out, size_t size);
         /**
          * @brief Sets up a fade between the two reading heads.
          */
@@ -190,6 +305,13 @@ namespace wreath
          * @param amount
          */
         void SetDegradation(float amount);
+        /**
+         * @brief Seeds the generator used for the degradation, so that
+         * renders with the same seed are identical.
+         *
+         * @param seed
+         */
+        void SetSeed(uint32_t seed);
         /**
          * @brief Calculates the distance between point a and b, taking into
          * account their speed and direction. This is mainly used to calculate
@@ -203,6 +325,17 @@ namespace wreath
          * @return float
          */
         float CalculateDistance(float a, float b, float aSpeed, float bSpeed, Direction direction);
+        /**
+         * @brief Fixed point version of the above, used internally.
+         *
+         * @param a
+         * @param b
+         * @param aSpeed
+         * @param bSpeed
+         * @param direction
+         * @return Phase
+         */
+        Phase CalculateDistance(Phase a, Phase b, float aSpeed, float bSpeed, Direction direction);
 
         void SetReading(bool active) { readingActive_ = active; }
         void SetWriting(bool active) { writingActive_ = active; }
@@ -210,22 +343,24 @@ namespace wreath
         inline float GetSamplesToFade() { return readHeads_[activeReadHead_].GetSamplesToFade(); }
 
         inline int32_t GetBufferSamples() { return bufferSamples_; }
-        inline float GetBufferSeconds() { return bufferSeconds_; }
+        inline float GetBufferSeconds() { return bufferSamples_ / static_cast<float>(sampleRate_); }
 
         inline float GetLoopStart() { return loopStart_; }
-        inline float GetLoopStartSeconds() { return loopStartSeconds_; }
+        inline float GetLoopStartSeconds() { return loopStart_ / sampleRate_; }
 
         inline float GetLoopEnd() { return loopEnd_; }
 
         inline float GetLoopLength() { return loopLength_; }
-        inline float GetLoopLengthSeconds() { return loopLengthSeconds_; }
+        inline float GetLoopLengthSeconds() { return loopLength_ / sampleRate_; }
 
-        inline float GetReadPos() { return readPos_; }
-        inline float GetReadPosSeconds() { return readPosSeconds_; }
+        inline float GetReadPos() { return readPos_.ToFloat(); }
+        inline float GetReadPosSeconds() { return readPos_.ToFloat() / sampleRate_; }
 
         inline float GetFreeze() { return freeze_; }
 
-        inline float GetWritePos() { return writePos_; }
+        inline int32_t GetActiveVoices() { return voices_.GetActiveVoices(); }
+
+        inline float GetWritePos() { return writePos_.ToFloat(); }
 
         inline float GetReadRate() { return readRate_; }
         inline float GetWriteRate() { return writeRate_; }
@@ -236,7 +371,14 @@ namespace wreath
         inline bool IsDrunkMovement() { return Movement::DRUNK == movement_; }
         inline bool IsGoingForward() { return Direction::FORWARD == direction_; }
 
-        inline float GetHeadsDistance() { return headsDistance_; }
+        /**
+         * @brief Returns the current distance between the heads. It's
+         * computed on each call, the one used to find the cross point is only
+         * updated at the horizons.
+         *
+         * @return float
+         */
+        inline float GetHeadsDistance() { return CalculateDistance(readPos_, writePos_, readSpeed_, writeSpeed_, direction_).ToFloat(); }
         inline float GetCrossPoint() { return crossPoint_; }
         inline bool CrossPointFound() { return crossPointFound_; }
 
@@ -246,39 +388,112 @@ namespace wreath
     private:
         enum Fade
         {
-            NO_FADE,
-            FADE_IN,
-            FADE_OUT,
-            FADE_OUT_IN,
-            FADE_TRIGGER,
+            LOOP_FADE,          // Crossfade between the reading heads on loop changes
+            HEADS_CROSS_FADE,   // Writing fade where the reading and writing heads meet
+            START_READING_FADE,
+            STOP_READING_FADE,
+            START_WRITING_FADE,
+            STOP_WRITING_FADE,
+            FADES,
         };
 
+        using Fades = FadeScheduler<BasicLooper, FADES>;
+
+        static constexpr uint32_t Bit(Fade fade) { return Fades::Bit(fade); }
+        static constexpr uint32_t kReadingFades{Fades::Bit(LOOP_FADE) | Fades::Bit(START_READING_FADE) | Fades::Bit(STOP_READING_FADE)};
+        static constexpr uint32_t kWritingFades{Fades::Bit(HEADS_CROSS_FADE) | Fades::Bit(START_WRITING_FADE) | Fades::Bit(STOP_WRITING_FADE)};
+        static constexpr int32_t kMaxHorizon{1 << 24};
+
+        /**
+         * @brief Called when reading has faded out, stops reading or, after a
+         * trigger, restarts it from the beginning.
+         */
+        void OnReadingFadedOut();
+        /**
+         * @brief Called when writing has faded out.
+         */
+        void OnWritingFadedOut();
+        /**
+         * @brief Called when the reading heads have crossfaded, moves the
+         * inactive one to the new loop.
+         */
+        void OnLoopFaded();
+
         /**
          * @brief Calculates where in the buffer the active reading head and the
          * writing head will meet.
          */
         void CalculateCrossPoint();
+        /**
+         * @brief Predicts how many samples can pass before the heads need to
+         * be tracked again, as nothing relevant can happen in between: they
+         * can't cover the given distance at the given rate, nor can the
+         * writing head reach a loop or buffer boundary. Any jump of the heads
+         * or parameter change invalidates the prediction.
+         *
+         * @param distance
+         * @param rate the max rate at which the distance shrinks
+         * @return int32_t
+         */
+        int32_t PredictHorizon(float distance, float rate);
+        /**
+         * @brief Returns the first of the given samples at which the given
+         * reading head reads what the writing head has written since the
+         * first one. Both heads must move in a straight line up to there.
+         *
+         * @param head
+         * @param size
+         * @return size_t
+         */
+        size_t SamplesToWritten(Head &head, size_t size);
+        /**
+         * @brief Returns how far the given position is from the given region
+         * of the buffer, going around it either way.
+         *
+         * @param position
+         * @param start the first sample of the region
+         * @param end the last sample of the region
+         * @return int32_t
+         */
+        int32_t DistanceToRegion(int32_t position, int32_t start, int32_t end);
+        /**
+         * @brief Handles the action returned by the active reading head after
+         * it moved.
+         *
+         * @param action
+         */
+        void HandleReadAction(Action action);
+        /**
+         * @brief Handles the action returned by the writing head after it
+         * moved.
+         *
+         * @param action
+         */
+        void HandleWriteAction(Action action);
+        /**
+         * @brief Keeps the fixed point loop boundaries in line with the float
+         * ones.
+         */
+        void UpdateLoopPhases();
 
-        float *buffer_{};           // The buffer
-        float *freezeBuffer_{};     // The buffer
-        float bufferSeconds_{};     // Written buffer length in seconds
-        float readPos_{};           // The read position
-        float readPosSeconds_{};    // Read position in seconds
-        float loopStartSeconds_{};  // Start of the loop in seconds
-        float loopLengthSeconds_{}; // Length of the loop in seconds
+        Phase readPos_{};           // The read position
         float readRate_{};          // Speed multiplier
         float writeRate_{};         // Speed multiplier
         float readSpeed_{};         // Actual read speed
         float writeSpeed_{};        // Actual write speed
         int32_t bufferSamples_{};   // The written buffer length in samples
-        float writePos_{};          // The write position
+        Phase writePos_{};          // The write position
         float loopStart_{};         // Loop start position
         float loopEnd_{};           // Loop end position
         float loopLength_{};        // Length of the loop in samples
         int32_t intLoopLength_{};
         int32_t intLoopStart_{}; // Loop start position
         int32_t intLoopEnd_{};   // Loop end position
-        float headsDistance_{};
+        Phase loopStartPhase_{}; // Loop start position, in fixed point
+        Phase loopEndPhase_{};   // Loop end position, in fixed point
+        Phase loopLengthPhase_{}; // Length of the loop, in fixed point
+        float headsDistance_{};     // Updated at each horizon when the heads' speeds differ, to find the cross point
+        int32_t samplesToHorizon_{}; // Samples before the next event that needs to track the heads
         int32_t sampleRate_{}; // The sample rate
         Direction direction_{};
         float freeze_{};
@@ -297,22 +512,21 @@ namespace wreath
         bool triggered_{};
 
         float eRand_{};
+        Random random_{};
+        BasicBufferClearer<Storage> clearer_{};
+        BasicFreezeSnapshot<Storage> snapshot_{};
+        typename Head::Cache cache_{};
+        BasicVoiceBank<Interpolator, Storage> voices_{};
 
         Head writeHead_{Type::WRITE};
         Head readHeads_[2]{{Type::READ}, {Type::READ}};
 
         short activeReadHead_{};
 
-        Fader loopFade;
-        Fader triggerFade;
-        Fader headsCrossFade;
-        Fader loopLengthFade;
-        Fader frozenFade;
-        Fader startReadingFade;
-        Fader stopReadingFade;
-        Fader startWritingFade;
-        Fader stopWritingFade;
+        Fades fades_{};
 
         Movement movement_{}; // The current movement type of the looper
     };
+
+    using Looper = BasicLooper<>;
 } // namespace wreath
\ No newline at end of file
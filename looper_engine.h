@@ -0,0 +1,162 @@
+#pragma once
+
+#include "host_arena.h"
+#include "stereo_looper.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace wreath
+{
+    /**
+     * @brief Runs many independent stereo loopers, one per track, for host
+     * builds. The instances and their buffers, sized to the tracks' length,
+     * share the budget of a HostArena, and the instances are processed block
+     * by block across a ThreadPool.
+     *
+     * The instances don't share any state, so the output doesn't depend on
+     * the number of threads nor on which thread processed which instance.
+     * Commands are sent to each instance as usual, from a single control
+     * thread.
+     *
+     * @tparam Looper the type of the instances, a BasicStereoLooper
+     */
+    template <typename Looper = StereoLooper>
+    class BasicLooperEngine
+    {
+    public:
+        BasicLooperEngine() {}
+        ~BasicLooperEngine() { Release(); }
+
+        BasicLooperEngine(const BasicLooperEngine &) = delete;
+        BasicLooperEngine &operator=(const BasicLooperEngine &) = delete;
+
+        using Conf = typename Looper::Conf;
+
+        /**
+         * @brief The time spent on the last block. The work is the sum of the
+         * times of the instances, so that the work divided by the block time
+         * tells how well the processing scales with the threads.
+         */
+        struct Timing
+        {
+            uint64_t blockNanos{};
+            uint64_t workNanos{};
+            uint64_t maxInstanceNanos{}; // The slowest instance, the least the block can take
+
+            inline float Parallelism() const { return blockNanos ? workNanos / static_cast<float>(blockNanos) : 0.f; }
+        };
+
+        /**
+         * @brief Creates and inits the instances, one per configuration, and
+         * starts the threads.
+         *
+         * @param sampleRate
+         * @param confs
+         * @param bufferSeconds the length of each channel's buffer
+         * @param threads the threads processing the instances, the calling
+         * one included
+         * @param hugePages whether to back the buffers with huge pages, when
+         * available
+         * @return true
+         * @return false if the memory couldn't be mapped or the instances
+         * didn't fit it
+         */
+        bool Init(int32_t sampleRate, const std::vector<Conf> &confs, float bufferSeconds, size_t threads, bool hugePages = false)
+        {
+            Release();
+            size_t instances = confs.size();
+            size_t bytes = sizeof(Looper) * instances + alignof(Looper) + Looper::GetArenaBytes(sampleRate, bufferSeconds) * instances;
+            if (!arena_.Open(bytes, hugePages))
+            {
+                return false;
+            }
+            // The instances need the alignment of their command queues.
+            loopers_ = static_cast<Looper *>(arena_.Allocate(sizeof(Looper) * instances, alignof(Looper)));
+            if (!loopers_)
+            {
+                Release();
+
+                return false;
+            }
+            for (size_t i = 0; i < instances; i++)
+            {
+                new (&loopers_[i]) Looper();
+                instances_ = i + 1;
+                if (!loopers_[i].Init(sampleRate, confs[i], arena_, bufferSeconds))
+                {
+                    Release();
+
+                    return false;
+                }
+            }
+            instanceNanos_.assign(instances, 0);
+            pool_.Start(threads);
+
+            return true;
+        }
+
+        inline size_t GetInstances() const { return instances_; }
+        inline size_t GetThreads() const { return pool_.GetThreads(); }
+        inline Looper &GetLooper(size_t instance) { return loopers_[instance]; }
+        inline const Timing &GetTiming() const { return timing_; }
+        inline uint64_t GetInstanceNanos(size_t instance) const { return instanceNanos_[instance]; }
+
+        /**
+         * @brief Processes a block of all the instances, each one with its
+         * own planar stereo input and output.
+         *
+         * @param in two channels per instance, left then right
+         * @param out two channels per instance, left then right
+         * @param size
+         */
+        void ProcessBlock(const float *const *in, float *const *out, size_t size)
+        {
+            auto blockStart = std::chrono::steady_clock::now();
+            pool_.Run(instances_, [this, in, out, size](size_t instance) {
+                auto start = std::chrono::steady_clock::now();
+                loopers_[instance].ProcessBlock(in[2 * instance], in[2 * instance + 1], out[2 * instance], out[2 * instance + 1], size);
+                instanceNanos_[instance] = Nanos(start);
+            });
+
+            timing_.blockNanos = Nanos(blockStart);
+            timing_.workNanos = 0;
+            timing_.maxInstanceNanos = 0;
+            for (uint64_t nanos : instanceNanos_)
+            {
+                timing_.workNanos += nanos;
+                timing_.maxInstanceNanos = std::max(timing_.maxInstanceNanos, nanos);
+            }
+        }
+
+    private:
+        ThreadPool pool_{};
+        HostArena arena_{};
+        Looper *loopers_{};
+        size_t instances_{};
+        std::vector<uint64_t> instanceNanos_{};
+        Timing timing_{};
+
+        static uint64_t Nanos(std::chrono::steady_clock::time_point start)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        void Release()
+        {
+            pool_.Stop();
+            for (size_t i = 0; i < instances_; i++)
+            {
+                loopers_[i].~Looper();
+            }
+            arena_.Close();
+            loopers_ = nullptr;
+            instances_ = 0;
+        }
+    };
+
+    using LooperEngine = BasicLooperEngine<>;
+} // namespace wreath
@@ -0,0 +1,391 @@
+#pragma once
+
+#include "storage.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace wreath
+{
+    /**
+     * @brief A loop buffer backed by a memory-mapped file, for host builds
+     * (POSIX only). It lets the looper record far more material than fits in
+     * RAM, as a tape that lives on disk.
+     *
+     * The heads get a plain pointer to the mapping, like with any other
+     * buffer. A background thread follows the heads: it faults in the pages
+     * ahead of them, so the audio thread never waits for the disk, and
+     * releases the pages they left behind, so the resident set stays bounded
+     * by the windows around the heads regardless of the length of the tape.
+     *
+     * Clearing a mapped buffer touches all of its pages, prefer starting
+     * from a new file.
+     *
+     * @tparam Storage the storage policy of the buffer
+     */
+    template <typename Storage = FloatStorage>
+    class BasicMappedBuffer
+    {
+    public:
+        BasicMappedBuffer() {}
+        ~BasicMappedBuffer() { Close(); }
+
+        BasicMappedBuffer(const BasicMappedBuffer &) = delete;
+        BasicMappedBuffer &operator=(const BasicMappedBuffer &) = delete;
+
+        using Sample = typename Storage::Sample;
+
+        static constexpr int32_t kMaxCursors{4};
+        static constexpr size_t kMinChunkBytes{1 << 16};
+        static constexpr int32_t kDefaultAheadSamples{1 << 17}; // ~2.7 seconds @ 48KHz
+        static constexpr int32_t kDefaultBehindSamples{1 << 14};
+
+        /**
+         * @brief Maps the given file as a buffer of the given length, creating
+         * or extending it when needed. The new parts of the file read as
+         * silence.
+         *
+         * @param path
+         * @param samples
+         * @return true if the file has been mapped
+         * @return false
+         */
+        bool Open(const char *path, int32_t samples)
+        {
+            Close();
+
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            chunkBytes_ = std::max(kMinChunkBytes, page);
+            bytes_ = (samples * Storage::kBytes + page - 1) / page * page;
+
+            fd_ = open(path, O_RDWR | O_CREAT, 0644);
+            if (fd_ < 0)
+            {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd_, &info) || (static_cast<size_t>(info.st_size) < bytes_ && ftruncate(fd_, bytes_)))
+            {
+                Close();
+
+                return false;
+            }
+            void *data = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (MAP_FAILED == data)
+            {
+                Close();
+
+                return false;
+            }
+            data_ = static_cast<uint8_t *>(data);
+            // The read-ahead is done by the prefetcher, following the heads:
+            // disable the kernel's own guesses around the faults.
+            madvise(data_, bytes_, MADV_RANDOM);
+
+            samples_ = samples;
+            chunks_ = static_cast<int32_t>((bytes_ + chunkBytes_ - 1) / chunkBytes_);
+            resident_.assign(chunks_, false);
+            residentChunks_.clear();
+            residentBytes_ = 0;
+            wanted_.assign(chunks_, 0);
+            for (Cursor &cursor : cursors_)
+            {
+                cursor.index = -1;
+            }
+
+            return true;
+        }
+
+        /**
+         * @brief Stops the prefetcher, flushes the buffer to the file and
+         * unmaps it.
+         */
+        void Close()
+        {
+            Stop();
+            if (data_)
+            {
+                msync(data_, bytes_, MS_SYNC);
+                munmap(data_, bytes_);
+                data_ = nullptr;
+            }
+            if (fd_ >= 0)
+            {
+                close(fd_);
+                fd_ = -1;
+            }
+            samples_ = 0;
+        }
+
+        inline Sample *Data() { return reinterpret_cast<Sample *>(data_); }
+        inline int32_t Samples() const { return samples_; }
+        inline bool IsOpen() const { return data_ != nullptr; }
+
+        /**
+         * @brief Sets how many samples are kept resident ahead of and behind
+         * each cursor.
+         *
+         * @param ahead
+         * @param behind
+         */
+        void SetWindow(int32_t ahead, int32_t behind)
+        {
+            aheadSamples_ = std::max(ahead, 0);
+            behindSamples_ = std::max(behind, 0);
+        }
+
+        /**
+         * @brief Starts the background prefetcher.
+         *
+         * @param period how often the prefetcher catches up with the cursors
+         */
+        void Start(std::chrono::microseconds period = std::chrono::microseconds{2000})
+        {
+            if (!data_ || running_)
+            {
+                return;
+            }
+            running_ = true;
+            prefetcher_ = std::thread([this, period]() {
+                while (running_)
+                {
+                    Prefetch();
+                    std::this_thread::sleep_for(period);
+                }
+            });
+        }
+
+        void Stop()
+        {
+            if (running_)
+            {
+                running_ = false;
+                prefetcher_.join();
+            }
+        }
+
+        /**
+         * @brief Moves the given cursor, that the prefetcher follows. This is
+         * wait-free and can be called from the audio thread, once per block.
+         *
+         * @param cursor
+         * @param index the position of the head
+         * @param forward the direction of the head
+         * @param loopStart the start of the loop the head is moving in, the
+         * windows wrap around it
+         * @param loopLength the length of the loop, the whole buffer if zero
+         */
+        inline void Follow(int32_t cursor, int32_t index, bool forward, int32_t loopStart = 0, int32_t loopLength = 0)
+        {
+            cursors_[cursor].loopStart.store(loopStart, std::memory_order_relaxed);
+            cursors_[cursor].loopLength.store(loopLength, std::memory_order_relaxed);
+            cursors_[cursor].forward.store(forward, std::memory_order_relaxed);
+            cursors_[cursor].index.store(index, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Makes the prefetcher follow the reading and the writing heads
+         * of the given looper. Only the reading heads change direction, the
+         * writing one always moves forward.
+         *
+         * @tparam Looper
+         * @param looper
+         */
+        template <typename Looper>
+        inline void Follow(Looper &looper)
+        {
+            int32_t loopStart = static_cast<int32_t>(looper.GetLoopStart());
+            int32_t loopLength = static_cast<int32_t>(looper.GetLoopLength()) + 1;
+            Follow(0, static_cast<int32_t>(looper.GetReadPos()), looper.IsGoingForward(), loopStart, loopLength);
+            Follow(1, static_cast<int32_t>(looper.GetWritePos()), true, loopStart, loopLength);
+        }
+
+        /**
+         * @brief Releases the given cursor.
+         *
+         * @param cursor
+         */
+        inline void Unfollow(int32_t cursor)
+        {
+            cursors_[cursor].index.store(-1, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief Makes the windows around the cursors resident and releases
+         * the rest. Called periodically by the prefetcher, but it can also be
+         * called directly, for instance before starting the audio.
+         */
+        void Prefetch()
+        {
+            // Zero marks the chunks never wanted.
+            pass_ = pass_ + 1 ? pass_ + 1 : 1;
+            int32_t step = std::max(static_cast<int32_t>(chunkBytes_ / Storage::kBytes), 1);
+            for (Cursor &cursor : cursors_)
+            {
+                int32_t index = cursor.index.load(std::memory_order_relaxed);
+                if (index < 0 || index >= samples_)
+                {
+                    continue;
+                }
+                int32_t direction = cursor.forward.load(std::memory_order_relaxed) ? 1 : -1;
+                int32_t loopStart = cursor.loopStart.load(std::memory_order_relaxed);
+                int32_t loopLength = cursor.loopLength.load(std::memory_order_relaxed);
+                if (loopLength <= 0 || loopLength > samples_ || loopStart < 0 || loopStart >= samples_)
+                {
+                    loopStart = 0;
+                    loopLength = samples_;
+                }
+                // Start from the head and move in its direction, so that the
+                // closest chunks are loaded first, then go back to the chunks
+                // just behind it. The windows wrap around the loop, as the
+                // head does.
+                int32_t offset = index - loopStart;
+                offset = offset < 0 ? offset + samples_ : offset;
+                int32_t ahead = std::min(aheadSamples_, loopLength);
+                int32_t behind = std::min(behindSamples_, loopLength - ahead);
+                for (int32_t distance = 0; distance <= ahead + step; distance += step)
+                {
+                    Want(LoopIndex(loopStart, loopLength, offset + direction * std::min(distance, ahead)));
+                }
+                for (int32_t distance = step; distance <= behind + step; distance += step)
+                {
+                    Want(LoopIndex(loopStart, loopLength, offset - direction * std::min(distance, behind)));
+                }
+            }
+
+            // Release the chunks the heads left behind.
+            for (size_t i = 0; i < residentChunks_.size();)
+            {
+                int32_t chunk = residentChunks_[i];
+                if (wanted_[chunk] == pass_)
+                {
+                    i++;
+                    continue;
+                }
+                Release(chunk);
+                residentChunks_[i] = residentChunks_.back();
+                residentChunks_.pop_back();
+            }
+        }
+
+        /**
+         * @brief The bytes the prefetcher keeps resident.
+         *
+         * @return size_t
+         */
+        inline size_t GetResidentBytes() const { return residentBytes_.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief Whether the prefetcher keeps the given sample resident. Call
+         * this from the thread calling Prefetch(), or with the prefetcher
+         * stopped.
+         *
+         * @param index
+         * @return true
+         * @return false
+         */
+        inline bool IsResident(int32_t index) const
+        {
+            return index >= 0 && index < samples_ && resident_[index * Storage::kBytes / chunkBytes_];
+        }
+
+    private:
+        struct Cursor
+        {
+            std::atomic<int32_t> index{-1};
+            std::atomic<int32_t> loopStart{};
+            std::atomic<int32_t> loopLength{};
+            std::atomic<bool> forward{true};
+        };
+
+        inline int32_t LoopIndex(int32_t loopStart, int32_t loopLength, int32_t offset) const
+        {
+            offset %= loopLength;
+            int32_t index = loopStart + (offset < 0 ? offset + loopLength : offset);
+
+            return index >= samples_ ? index - samples_ : index;
+        }
+
+        void Want(int32_t index)
+        {
+            int32_t chunk = static_cast<int32_t>(index * Storage::kBytes / chunkBytes_);
+            if (wanted_[chunk] == pass_)
+            {
+                return;
+            }
+            wanted_[chunk] = pass_;
+            if (!resident_[chunk])
+            {
+                Load(chunk);
+            }
+        }
+
+        inline size_t ChunkBytes(int32_t chunk) const
+        {
+            return std::min(chunkBytes_, bytes_ - chunk * chunkBytes_);
+        }
+
+        void Load(int32_t chunk)
+        {
+            uint8_t *start = data_ + chunk * chunkBytes_;
+            size_t bytes = ChunkBytes(chunk);
+            madvise(start, bytes, MADV_WILLNEED);
+            // Touch every page, so that they're also mapped and the audio
+            // thread doesn't even take a minor fault.
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            for (size_t offset = 0; offset < bytes; offset += page)
+            {
+                static_cast<volatile uint8_t *>(start)[offset];
+            }
+            resident_[chunk] = true;
+            residentChunks_.push_back(chunk);
+            residentBytes_ += bytes;
+        }
+
+        void Release(int32_t chunk)
+        {
+            uint8_t *start = data_ + chunk * chunkBytes_;
+            size_t bytes = ChunkBytes(chunk);
+            // Write back first, so the pages can be dropped from the page
+            // cache too.
+            msync(start, bytes, MS_SYNC);
+            madvise(start, bytes, MADV_DONTNEED);
+#ifdef POSIX_FADV_DONTNEED
+            posix_fadvise(fd_, chunk * chunkBytes_, bytes, POSIX_FADV_DONTNEED);
+#endif
+            resident_[chunk] = false;
+            residentBytes_ -= bytes;
+        }
+
+        int fd_{-1};
+        uint8_t *data_{};
+        size_t bytes_{};
+        size_t chunkBytes_{kMinChunkBytes};
+        int32_t samples_{};
+        int32_t chunks_{};
+        int32_t aheadSamples_{kDefaultAheadSamples};
+        int32_t behindSamples_{kDefaultBehindSamples};
+
+        Cursor cursors_[kMaxCursors]{};
+
+        // Owned by the prefetcher.
+        std::vector<bool> resident_{};
+        std::vector<int32_t> residentChunks_{};
+        std::vector<uint32_t> wanted_{}; // The last pass that wanted each chunk
+        uint32_t pass_{};
+        std::atomic<size_t> residentBytes_{};
+
+        std::atomic<bool> running_{};
+        std::thread prefetcher_{};
+    };
+
+    using MappedBuffer = BasicMappedBuffer<>;
+} // namespace wreath
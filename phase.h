@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+
+namespace wreath
+{
+    /**
+     * @brief A 32.32 fixed point position in the buffer, used to move the
+     * heads with the same precision at any point of the buffer. With floats,
+     * the fractional part gets coarser as the position grows (at the end of
+     * an 80 seconds buffer only a quarter of sample is left).
+     */
+    class Phase
+    {
+    public:
+        constexpr Phase() {}
+
+        static constexpr int32_t kFracBits{32};
+        static constexpr int64_t kOne{static_cast<int64_t>(1) << kFracBits};
+        static constexpr uint64_t kFracMask{static_cast<uint64_t>(kOne) - 1};
+
+        static constexpr Phase FromRaw(int64_t raw)
+        {
+            Phase phase;
+            phase.raw_ = raw;
+
+            return phase;
+        }
+
+        static constexpr Phase FromInt(int32_t value)
+        {
+            return FromRaw(static_cast<int64_t>(value) * kOne);
+        }
+
+        /**
+         * @brief Converts a float to a phase. The conversion is exact, as
+         * a double holds all the bits of a float scaled by 2^32.
+         *
+         * @param value
+         * @return Phase
+         */
+        static Phase FromFloat(float value)
+        {
+            return FromRaw(static_cast<int64_t>(static_cast<double>(value) * kOne));
+        }
+
+        /**
+         * @brief Returns the integral part, rounded towards minus infinity.
+         *
+         * @return int32_t
+         */
+        constexpr int32_t Int() const { return static_cast<int32_t>(raw_ >> kFracBits); }
+
+        constexpr uint32_t FracBits() const { return static_cast<uint32_t>(raw_ & kFracMask); }
+
+        /**
+         * @brief Returns the fractional part in the [0, 1) range. Only the
+         * upper 24 bits are used, so that the conversion is exact.
+         *
+         * @return float
+         */
+        constexpr float Frac() const { return (FracBits() >> 8) * (1.f / (1 << 24)); }
+
+        constexpr int64_t Raw() const { return raw_; }
+
+        float ToFloat() const { return static_cast<float>(raw_ * (1.0 / kOne)); }
+
+        constexpr Phase operator+(Phase other) const { return FromRaw(raw_ + other.raw_); }
+        constexpr Phase operator-(Phase other) const { return FromRaw(raw_ - other.raw_); }
+        constexpr Phase operator-() const { return FromRaw(-raw_); }
+        Phase &operator+=(Phase other)
+        {
+            raw_ += other.raw_;
+            return *this;
+        }
+        Phase &operator-=(Phase other)
+        {
+            raw_ -= other.raw_;
+            return *this;
+        }
+
+        constexpr bool operator==(Phase other) const { return raw_ == other.raw_; }
+        constexpr bool operator!=(Phase other) const { return raw_ != other.raw_; }
+        constexpr bool operator<(Phase other) const { return raw_ < other.raw_; }
+        constexpr bool operator<=(Phase other) const { return raw_ <= other.raw_; }
+        constexpr bool operator>(Phase other) const { return raw_ > other.raw_; }
+        constexpr bool operator>=(Phase other) const { return raw_ >= other.raw_; }
+
+    private:
+        int64_t raw_{};
+    };
+} // namespace wreath
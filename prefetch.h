@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    constexpr size_t kCacheLineBytes{64};
+
+    /**
+     * @brief Hints the memory system that the given bytes are going to be
+     * read soon, so that they're on their way to the cache when needed. This
+     * is only a hint: it does nothing on the compilers without the builtin
+     * and it never faults, whatever the address.
+     *
+     * @param address
+     * @param bytes
+     */
+    inline void Prefetch(const void *address, size_t bytes)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        const uint8_t *start = static_cast<const uint8_t *>(address);
+        for (size_t offset = 0; offset < bytes; offset += kCacheLineBytes)
+        {
+            __builtin_prefetch(start + offset, 0, 0);
+        }
+#else
+        (void)address;
+        (void)bytes;
+#endif
+    }
+} // namespace wreath
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace wreath
+{
+    /**
+     * @brief Smooths a parameter towards its target at control rate.
+     *
+     * The ramp is advanced once per block, by the number of samples in the
+     * block, and returns the average of the values it would have taken sample
+     * by sample. Using it as a rate, the heads cover exactly the distance
+     * they would have covered slewing at each sample, whatever the block
+     * size, and the per-sample path doesn't need any smoothing.
+     */
+    class Ramp
+    {
+    public:
+        Ramp() {}
+        ~Ramp() {}
+
+        enum class Shape
+        {
+            LINEAR,      // Constant slope, reaches the target in the slew time
+            EXPONENTIAL, // One-pole, as DaisySP's fonepole()
+        };
+
+        /**
+         * @brief Jumps to the given value.
+         *
+         * @param value
+         */
+        void Reset(float value)
+        {
+            value_ = value;
+            target_ = value;
+            increment_ = 0.f;
+        }
+
+        void SetShape(Shape shape)
+        {
+            shape_ = shape;
+        }
+
+        /**
+         * @brief Sets the slew time, in samples. The coefficients are only
+         * recalculated when it changes.
+         *
+         * @param samples
+         */
+        void SetTime(float samples)
+        {
+            if (samples == time_)
+            {
+                return;
+            }
+            time_ = samples;
+            decay_ = time_ > 1.f ? 1.f - 1.f / time_ : 0.f;
+            decayN_ = 0.f;
+            decaySamples_ = 0;
+            Retarget();
+        }
+
+        /**
+         * @brief Sets the value to move towards.
+         *
+         * @param target
+         */
+        void SetTarget(float target)
+        {
+            if (target == target_)
+            {
+                return;
+            }
+            target_ = target;
+            Retarget();
+        }
+
+        inline bool IsMoving() const { return value_ != target_; }
+        inline float GetValue() const { return value_; }
+        inline float GetTarget() const { return target_; }
+
+        /**
+         * @brief Advances the ramp by the given number of samples.
+         *
+         * @param samples
+         * @return float the average value over the samples
+         */
+        float Advance(size_t samples)
+        {
+            if (!IsMoving() || !samples)
+            {
+                return value_;
+            }
+
+            return Shape::LINEAR == shape_ ? AdvanceLinear(samples) : AdvanceExponential(samples);
+        }
+
+    private:
+        static constexpr float kSnap{1e-6f}; // Below this distance the target is reached
+
+        /**
+         * @brief Recalculates the slope towards the target. Without a slew
+         * time the target is reached at once.
+         */
+        void Retarget()
+        {
+            if (time_ <= 1.f)
+            {
+                value_ = target_;
+                increment_ = 0.f;
+
+                return;
+            }
+            increment_ = (target_ - value_) / time_;
+        }
+
+        float AdvanceLinear(size_t samples)
+        {
+            float remaining = increment_ != 0.f ? (target_ - value_) / increment_ : 0.f;
+            if (remaining > samples)
+            {
+                float average = value_ + increment_ * (samples + 1) * 0.5f;
+                value_ += increment_ * samples;
+
+                return average;
+            }
+
+            // The target is reached within the block.
+            size_t moving = static_cast<size_t>(std::max(remaining, 0.f));
+            float sum = moving * value_ + increment_ * moving * (moving + 1) * 0.5f + (samples - moving) * target_;
+            value_ = target_;
+
+            return sum / samples;
+        }
+
+        float AdvanceExponential(size_t samples)
+        {
+            // The blocks usually have the same size, so the power is computed
+            // once.
+            if (samples != decaySamples_)
+            {
+                decaySamples_ = samples;
+                decayN_ = std::pow(decay_, static_cast<float>(samples));
+            }
+
+            // Closed forms of the one-pole after n samples and of the sum of
+            // its values.
+            float distance = value_ - target_;
+            float average = target_ + distance * decay_ * (1.f - decayN_) / (samples * (1.f - decay_));
+            value_ = target_ + distance * decayN_;
+            if (std::fabs(value_ - target_) < kSnap)
+            {
+                value_ = target_;
+            }
+
+            return average;
+        }
+
+        Shape shape_{Shape::EXPONENTIAL};
+        float value_{};
+        float target_{};
+        float time_{};
+        float increment_{};
+        float decay_{};
+        float decayN_{};
+        size_t decaySamples_{};
+    };
+} // namespace wreath
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace wreath
+{
+    /**
+     * @brief A small xorshift pseudo-random number generator. Each instance
+     * has its own state, so it can be used from the audio callback without
+     * locking and it yields the same sequence for the same seed.
+     * @see https://www.jstatsoft.org/article/view/v008i14
+     */
+    class Random
+    {
+    public:
+        Random() {}
+        ~Random() {}
+
+        /**
+         * @brief Seeds the generator. Any value is fine, zero included, as
+         * the seed is scrambled before being used as the state.
+         *
+         * @param seed
+         */
+        void Seed(uint32_t seed)
+        {
+            // SplitMix32 finalizer, so that close seeds yield unrelated
+            // sequences.
+            seed += 0x9e3779b9u;
+            seed = (seed ^ (seed >> 16)) * 0x85ebca6bu;
+            seed = (seed ^ (seed >> 13)) * 0xc2b2ae35u;
+            seed ^= seed >> 16;
+            // The xorshift state must never be zero.
+            state_ = seed ? seed : kDefaultState;
+        }
+
+        /**
+         * @brief Returns the next value of the sequence.
+         *
+         * @return uint32_t
+         */
+        inline uint32_t Next()
+        {
+            state_ ^= state_ << 13;
+            state_ ^= state_ >> 17;
+            state_ ^= state_ << 5;
+
+            return state_;
+        }
+
+        /**
+         * @brief Returns the next value of the sequence in the [0, 1) range.
+         *
+         * @return float
+         */
+        inline float NextFloat()
+        {
+            return (Next() >> 8) * (1.f / (1 << 24));
+        }
+
+        /**
+         * @brief Fills the given block with values in the [0, 1) range.
+         *
+         * @param out
+         * @param size
+         */
+        void Fill(float *out, size_t size)
+        {
+            uint32_t state = state_;
+            for (size_t i = 0; i < size; i++)
+            {
+                state ^= state << 13;
+                state ^= state >> 17;
+                state ^= state << 5;
+                out[i] = (state >> 8) * (1.f / (1 << 24));
+            }
+            state_ = state;
+        }
+
+    private:
+        static constexpr uint32_t kDefaultState{2463534242u};
+
+        uint32_t state_{kDefaultState};
+    };
+} // namespace wreath
@@ -1,4 +1,4 @@
 #!/bin/sh
 
-g++ -I./DaisySP/Source tests.cpp looper.cpp -o tests
+g++ -DWREATH_HOST -I./DaisySP/Source tests.cpp looper.cpp -o tests
 ./tests
\ No newline at end of file
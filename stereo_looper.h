@@ -1,42 +1,46 @@
 #pragma once
 
+#include "arena.h"
 #include "head.h"
 #include "looper.h"
 #include "envelope_follower.h"
+#include "ramp.h"
+#include "command_queue.h"
+#include "triple_buffer.h"
+#if defined(WREATH_HOST)
+#include "host_dsp.h"
+#include "host_svf.h"
+#else
 #include "Utility/dsp.h"
 #include "Filters/svf.h"
-#include "dev/sdram.h"
+#endif
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <new>
 #include <stddef.h>
 
 namespace wreath
 {
+#if !defined(WREATH_HOST)
     using namespace daisysp;
+#endif
 
     constexpr int32_t kSampleRate{48000};
-    constexpr int kBufferSeconds{80}; // 1:20 minutes, max with 4 buffers
+    constexpr int kBufferSeconds{80}; // Default buffers length, 1:20 minutes of floats is the max with 4 buffers in the SDRAM
     const int32_t kBufferSamples{kSampleRate * kBufferSeconds};
-
-    // Looper buffers.
-    float DSY_SDRAM_BSS leftBuffer_[kBufferSamples];
-    float DSY_SDRAM_BSS rightBuffer_[kBufferSamples];
-
-    // Freeze buffers.
-    float DSY_SDRAM_BSS leftFreezeBuffer_[kBufferSamples];
-    float DSY_SDRAM_BSS rightFreezeBuffer_[kBufferSamples];
+    const size_t kBufferBytes{kBufferSamples * sizeof(float)};
+    constexpr size_t kMaxBlockSize{64}; // Max frames processed at once by ProcessBlock()
+    constexpr size_t kClearBytesPerFrame{256}; // Max bytes of each looper's buffer cleared per frame
+    constexpr size_t kSnapshotBytesPerFrame{512}; // Max bytes of each looper's frozen loop copied per frame
+    constexpr size_t kMaxCommands{64}; // Max commands waiting to be executed, a power of two
 
     /**
-     * @brief The higher level class of the looper, this is the one you want to
-     *  instantiate.
-     * @author Roberto Noris
-     * @date Dec 2021
+     * @brief The types shared by all the StereoLooper flavours.
      */
-    class StereoLooper
+    class StereoLooperBase
     {
     public:
-        StereoLooper() {}
-        ~StereoLooper() {}
-
         enum
         {
             LEFT,
@@ -82,110 +86,372 @@ namespace wreath
             Movement movement;
             Direction direction;
             float rate;
+            uint32_t seed{}; // Seed of the degradation noise
+            bool monoFreeze{true}; // Whether MONO mode keeps half the memory to freeze the loop, or records for twice as long
+            bool linked{};         // Whether the channels share a single looper over stereo frames, ignored in MONO mode
         };
 
-        bool mustResetLooper{};
-        bool mustClearBuffer{};
-        bool mustStopBuffering{};
+        /**
+         * @brief The commands the control thread sends to the audio thread.
+         * The actions, from RESET to STOP_WRITING, are held until the looper
+         * is running and the commands following them wait behind them, in
+         * order, except for START and STOP_BUFFERING, which make it run.
+         */
+        enum class CommandType
+        {
+            START,          // Starts reading for the first time, once ready
+            STOP_BUFFERING, // Ends the buffering early
+            RESET,          // Stops the loopers and buffers again
+            CLEAR_BUFFER,
+            RETRIGGER,
+            RESTART,
+            START_READING,
+            STOP_READING,
+            START_WRITING, // Value: 1 to start immediately, 0 to fade in
+            STOP_WRITING,  // Value: 1 to stop immediately, 0 to fade out
+            SET_LOOP_START,
+            SET_LOOP_LENGTH,
+            SET_READ_RATE,
+            SET_WRITE_RATE,
+            SET_FREEZE,
+            SET_DIRECTION,
+            SET_MOVEMENT,
+            SET_LOOP_SYNC,
+            SET_LOOPING,
+            SET_DEGRADATION,
+            SET_FILTER_VALUE,
+            SET_FILTER_TYPE,
+            SET_FILTER_LEVEL,
+            SET_INPUT_GAIN,
+            SET_OUTPUT_GAIN,
+            SET_DRY_WET_MIX,
+            SET_DRY_LEVEL,
+            SET_FEEDBACK,
+            SET_FEEDBACK_LEVEL,
+            SET_FEEDBACK_ONLY,
+            SET_CROSSED_FEEDBACK,
+            SET_FEEDBACK_PATH,
+            SET_RATE_SLEW,
+            SET_RATE_SLEW_SHAPE,
+            SET_STEREO_WIDTH,
+            NOTE_ON,  // Value: the MIDI note times 128 plus the MIDI velocity
+            NOTE_OFF, // Value: the MIDI note
+        };
 
-        float inputGain{1.f};
-        float outputGain{1.f};
-        float dryWetMix{0.5f};
-        float feedback{0.f};
-        float feedbackLevel{1.f};
-        bool feedbackOnly{};
-        bool crossedFeedback{};
-        float leftFeedbackPath{0.f};
-        float rightFeedbackPath{1.f};
-        float filterLevel{0.3f};
-        float rateSlew{0.f};
-        float stereoWidth{1.f};
-        float dryLevel{1.f};
-        bool loopSync_{};
-        FilterType filterType{FilterType::BP};
+        struct Command
+        {
+            CommandType type;
+            int channel;
+            float value;    // Enums and flags are cast to float
+            uint32_t frame; // The frame the command was sent at
+        };
 
-        NoteMode noteModeLeft{};
-        NoteMode noteModeRight{};
+        /**
+         * @brief A consistent view of the looper, published by the audio
+         * thread once per block for the UI. Positions and lengths are in
+         * samples, Seconds() converts them when needed.
+         */
+        struct Telemetry
+        {
+            struct Channel
+            {
+                int32_t bufferSamples{};
+                float loopStart{};
+                float loopEnd{};
+                float loopLength{};
+                float readPos{};
+                float writePos{};
+                float readRate{};
+                float headsDistance{};
+                float crossPoint{};
+                Movement movement{};
+                bool goingForward{};
+                NoteMode noteMode{};
+            };
+
+            Channel channels[2]{};
+            State state{};
+            Mode mode{};
+            bool loopSync{};
+            float filterValue{};
+            int32_t sampleRate{1};
+            uint32_t frame{}; // The frame the view was taken at, newer views have later frames
+
+            inline float Seconds(float samples) const { return samples / sampleRate; }
+        };
+    };
 
-        int32_t nextLeftLoopStart{};
-        int32_t nextRightLoopStart{};
+    /**
+     * @brief The higher level class of the looper, this is the one you want to
+     *  instantiate.
+     * @author Roberto Noris
+     * @date Dec 2021
+     *
+     * In DUAL and CROSS modes each channel has its own looper, unless the
+     * channels are linked in the configuration: then one looper moves a
+     * single set of heads over interleaved stereo frames, so the position
+     * math and the fades are done once and each read fetches both channels
+     * together. The two sets of loopers share their storage. In MONO mode a
+     * single looper records the sum of the channels, with the buffers of
+     * both channels, and the freeze ones if asked to, as one buffer. The
+     * commands for a single channel apply to both when the channels are
+     * linked or in MONO mode.
+     *
+     * @tparam Interpolator the policy used by the reading heads, choose
+     * between LinearInterpolator, HermiteInterpolator and SincInterpolator
+     * depending on the quality you can afford on the target
+     * @tparam Storage the policy used to keep the samples in the buffers,
+     * choose between FloatStorage, Int16Storage (double the recording time)
+     * and Packed24Storage (4/3 of the recording time)
+     */
+    template <typename Interpolator = LinearInterpolator, typename Storage = FloatStorage>
+    class BasicStereoLooper : public StereoLooperBase
+    {
+    public:
+        BasicStereoLooper()
+        {
+            ConstructLoopers();
+        }
+        ~BasicStereoLooper()
+        {
+            DestroyLoopers();
+        }
 
-        Direction leftDirection{};
-        Direction rightDirection{};
+        using Sample = typename Storage::Sample;
+        using LinkedStorage = InterleavedStorage<Storage>;
+        using ChannelLooper = BasicLooper<Interpolator, Storage>;
+        using LinkedLooper = BasicLooper<Interpolator, LinkedStorage>;
 
-        int32_t nextLeftLoopLength{};
-        int32_t nextRightLoopLength{};
+        /**
+         * @brief Returns the bytes of a channel's buffer of the given length.
+         *
+         * @param sampleRate
+         * @param bufferSeconds
+         * @return size_t
+         */
+        static size_t GetBufferBytes(int32_t sampleRate, float bufferSeconds)
+        {
+            return static_cast<size_t>(sampleRate * bufferSeconds) * Storage::kBytes;
+        }
 
-        float nextLeftReadRate{};
-        float nextRightReadRate{};
+        /**
+         * @brief Returns the bytes a looper takes from an arena for buffers of
+         * the given length, to size the arena's budget.
+         *
+         * @param sampleRate
+         * @param bufferSeconds
+         * @return size_t
+         */
+        static size_t GetArenaBytes(int32_t sampleRate, float bufferSeconds = kBufferSeconds)
+        {
+            return 4 * GetBufferBytes(sampleRate, bufferSeconds) + kCacheLineBytes;
+        }
 
-        float nextLeftWriteRate{};
-        float nextRightWriteRate{};
+        /**
+         * @brief Fetches the latest view of the looper published by the audio
+         * thread. Call this once per UI frame, the getters below then read
+         * from the same view, so they are consistent with each other.
+         *
+         * @return const Telemetry&
+         */
+        const Telemetry &ReadTelemetry()
+        {
+            telemetry_.Fetch();
 
-        float nextLeftFreeze{};
-        float nextRightFreeze{};
+            return telemetry_.Front();
+        }
+
+        inline const Telemetry &GetTelemetry() { return telemetry_.Front(); }
+
+        inline int32_t GetBufferSamples(int channel) { return ChannelTelemetry(channel).bufferSamples; }
+        inline float GetBufferSeconds(int channel) { return GetTelemetry().Seconds(ChannelTelemetry(channel).bufferSamples); }
+        inline float GetLoopStartSeconds(int channel) { return GetTelemetry().Seconds(ChannelTelemetry(channel).loopStart); }
+        inline float GetLoopLengthSeconds(int channel) { return GetTelemetry().Seconds(ChannelTelemetry(channel).loopLength); }
+        inline float GetReadPosSeconds(int channel) { return GetTelemetry().Seconds(ChannelTelemetry(channel).readPos); }
+        inline float GetLoopStart(int channel) { return ChannelTelemetry(channel).loopStart; }
+        inline float GetLoopEnd(int channel) { return ChannelTelemetry(channel).loopEnd; }
+        inline float GetLoopLength(int channel) { return ChannelTelemetry(channel).loopLength; }
+        inline float GetReadPos(int channel) { return ChannelTelemetry(channel).readPos; }
+        inline float GetWritePos(int channel) { return ChannelTelemetry(channel).writePos; }
+        inline float GetReadRate(int channel) { return ChannelTelemetry(channel).readRate; }
+        inline Movement GetMovement(int channel) { return ChannelTelemetry(channel).movement; }
+        inline bool IsGoingForward(int channel) { return ChannelTelemetry(channel).goingForward; }
+        inline int32_t GetCrossPoint(int channel) { return ChannelTelemetry(channel).crossPoint; }
+        inline int32_t GetHeadsDistance(int channel) { return ChannelTelemetry(channel).headsDistance; }
+        inline NoteMode GetNoteMode(int channel) { return ChannelTelemetry(channel).noteMode; }
+
+        inline bool IsStartingUp() { return State::STARTUP == GetTelemetry().state; }
+        inline bool IsBuffering() { return State::BUFFERING == GetTelemetry().state; }
+        inline bool IsRecording() { return State::RECORDING == GetTelemetry().state; }
+        inline bool IsFrozen() { return State::FROZEN == GetTelemetry().state; }
+        inline bool IsRunning() { return State::RECORDING == GetTelemetry().state || State::FROZEN == GetTelemetry().state; }
+        inline bool IsReady() { return State::READY == GetTelemetry().state; }
+        inline bool IsMonoMode() { return Mode::MONO == GetTelemetry().mode; }
+        inline bool IsCrossMode() { return Mode::CROSS == GetTelemetry().mode; }
+        inline bool IsDualMode() { return Mode::DUAL == GetTelemetry().mode; }
+        inline Mode GetMode() { return GetTelemetry().mode; }
+        inline bool GetLoopSync() { return GetTelemetry().loopSync; }
+        inline float GetFilterValue() { return GetTelemetry().filterValue; }
+
+
+        /**
+         * @brief Inits the looper, taking from the given arena the buffers of
+         * the two channels and their freeze buffers, each of the given
+         * length. In MONO mode they make up a single buffer, two or four
+         * times as long. Call this before setting up the AudioCallback.
+         *
+         * @param sampleRate
+         * @param conf
+         * @param arena
+         * @param bufferSeconds
+         * @return true
+         * @return false if the arena can't fit the buffers
+         */
+        bool Init(int32_t sampleRate, Conf conf, Arena &arena, float bufferSeconds = kBufferSeconds)
+        {
+            size_t bufferBytes = GetBufferBytes(sampleRate, bufferSeconds);
+            uint8_t *memory = static_cast<uint8_t *>(arena.Allocate(4 * bufferBytes));
+            if (!memory)
+            {
+                return false;
+            }
+            Init(sampleRate, conf, memory, 4 * bufferBytes);
+
+            return true;
+        }
+
+        /**
+         * @brief Inits the looper on the given memory, partitioned by mode:
+         * the first half holds the buffers of the two channels and the second
+         * half their freeze buffers, unless in MONO mode without freezing,
+         * where the whole memory is a single buffer.
+         *
+         * @param sampleRate
+         * @param conf
+         * @param memory
+         * @param bytes
+         */
+        void Init(int32_t sampleRate, Conf conf, uint8_t *memory, size_t bytes)
+        {
+            BufferSpan<Storage> pool = BufferSpan<Storage>::FromBytes(memory, bytes);
+            if (Mode::MONO == conf.mode && !conf.monoFreeze)
+            {
+                Init(sampleRate, conf, pool, BufferSpan<Storage>{});
+            }
+            else
+            {
+                Init(sampleRate, conf, pool.Part(0, 2), pool.Part(1, 2));
+            }
+        }
+
+        /**
+         * @brief Inits the looper on the given memory. Each block holds the
+         * buffers of the two channels, one after the other, the linked looper
+         * interleaves them over the whole block and the mono one takes it as
+         * a single buffer. In MONO mode without freezing the freeze block is
+         * left unused, the two blocks aren't one span to record in: use the
+         * single memory overload for four times the recording time.
+         *
+         * @param sampleRate
+         * @param conf
+         * @param buffers at least twice bufferBytes
+         * @param freezeBuffers at least twice bufferBytes
+         * @param bufferBytes the bytes of each channel's buffer
+         */
+        void Init(int32_t sampleRate, Conf conf, uint8_t *buffers, uint8_t *freezeBuffers, size_t bufferBytes)
+        {
+            BufferSpan<Storage> channel = BufferSpan<Storage>::FromBytes(buffers, bufferBytes);
+            BufferSpan<Storage> freeze{reinterpret_cast<Sample *>(freezeBuffers), 2 * channel.length};
+            if (Mode::MONO == conf.mode && !conf.monoFreeze)
+            {
+                freeze = BufferSpan<Storage>{};
+            }
+            Init(sampleRate, conf, BufferSpan<Storage>{channel.data, 2 * channel.length}, freeze);
+        }
 
-        bool mustStartReading{};
-        bool mustStopReading{};
-        bool mustStartWriting{};
-        bool mustStopWriting{};
-        bool mustStartWritingLeft{};
-        bool mustStopWritingLeft{};
-        bool mustStartWritingRight{};
-        bool mustStopWritingRight{};
-        bool mustRetrigger{};
-        bool mustRestart{};
-
-        inline int32_t GetBufferSamples(int channel) { return loopers_[channel].GetBufferSamples(); }
-        inline float GetBufferSeconds(int channel) { return loopers_[channel].GetBufferSeconds(); }
-        inline float GetLoopStartSeconds(int channel) { return loopers_[channel].GetLoopStartSeconds(); }
-        inline float GetLoopLengthSeconds(int channel) { return loopers_[channel].GetLoopLengthSeconds(); }
-        inline float GetReadPosSeconds(int channel) { return loopers_[channel].GetReadPosSeconds(); }
-        inline float GetLoopStart(int channel) { return loopers_[channel].GetLoopStart(); }
-        inline float GetLoopEnd(int channel) { return loopers_[channel].GetLoopEnd(); }
-        inline float GetLoopLength(int channel) { return loopers_[channel].GetLoopLength(); }
-        inline float GetReadPos(int channel) { return loopers_[channel].GetReadPos(); }
-        inline float GetWritePos(int channel) { return loopers_[channel].GetWritePos(); }
-        inline float GetReadRate(int channel) { return loopers_[channel].GetReadRate(); }
-        inline Movement GetMovement(int channel) { return loopers_[channel].GetMovement(); }
-        inline bool IsGoingForward(int channel) { return loopers_[channel].IsGoingForward(); }
-        inline int32_t GetCrossPoint(int channel) { return loopers_[channel].GetCrossPoint(); }
-        inline int32_t GetHeadsDistance(int channel) { return loopers_[channel].GetHeadsDistance(); }
-
-        inline bool IsStartingUp() { return State::STARTUP == state_; }
-        inline bool IsBuffering() { return State::BUFFERING == state_; }
-        inline bool IsRecording() { return State::RECORDING == state_; }
-        inline bool IsFrozen() { return State::FROZEN == state_; }
-        inline bool IsRunning() { return State::RECORDING == state_ || State::FROZEN == state_; }
-        inline bool IsReady() { return State::READY == state_; }
-        inline bool IsMonoMode() { return Mode::MONO == conf_.mode; }
-        inline bool IsCrossMode() { return Mode::CROSS == conf_.mode; }
-        inline bool IsDualMode() { return Mode::DUAL == conf_.mode; }
-        inline Mode GetMode() { return conf_.mode; }
-        inline bool GetLoopSync() { return loopSync_; }
-        inline float GetFilterValue() { return filterValue_; }
-
-
-        /**
-         * @brief Inits the looper. Call this before setting up the AudioCallback.
+        /**
+         * @brief Inits the looper on the given spans, each one holding the
+         * buffers of both channels.
          *
          * @param sampleRate
          * @param conf
+         * @param buffers
+         * @param freezeBuffers
          */
-        void Init(int32_t sampleRate, Conf conf)
+        void Init(int32_t sampleRate, Conf conf, BufferSpan<Storage> buffers, BufferSpan<Storage> freezeBuffers)
         {
             sampleRate_ = sampleRate;
-            loopers_[LEFT].Init(sampleRate_, leftBuffer_, leftFreezeBuffer_, kBufferSamples);
-            loopers_[RIGHT].Init(sampleRate_, rightBuffer_, rightFreezeBuffer_, kBufferSamples);
+            conf_ = conf;
+            mono_ = Mode::MONO == conf_.mode;
+            DestroyLoopers();
+            linked_ = !mono_ && conf_.linked;
+            ConstructLoopers();
+            if (mono_)
+            {
+                loopers_[LEFT].Init(sampleRate_, buffers, freezeBuffers);
+            }
+            else if (linked_)
+            {
+                // The frames span the buffers of both channels.
+                linkedLooper_.Init(sampleRate_, BufferSpan<LinkedStorage>{buffers.data, buffers.length / 2}, BufferSpan<LinkedStorage>{freezeBuffers.data, freezeBuffers.length / 2});
+            }
+            else
+            {
+                loopers_[LEFT].Init(sampleRate_, buffers.Part(LEFT, 2), freezeBuffers.Part(LEFT, 2));
+                loopers_[RIGHT].Init(sampleRate_, buffers.Part(RIGHT, 2), freezeBuffers.Part(RIGHT, 2));
+            }
             state_ = State::STARTUP;
+            startupIndex_ = 0;
+            while (held_.Peek())
+            {
+                held_.Pop();
+            }
             feedbackFilter_.Init(sampleRate_);
 
             // Process configuration and reset the looper.
-            conf_ = conf;
-            loopers_[LEFT].Reset();
-            loopers_[RIGHT].Reset();
+            if (linked_)
+            {
+                linkedLooper_.SetSeed(conf_.seed);
+            }
+            else
+            {
+                loopers_[LEFT].SetSeed(conf_.seed);
+                loopers_[RIGHT].SetSeed(conf_.seed + 1);
+            }
+            Reset();
+            for (int channel : {LEFT, RIGHT})
+            {
+                readRates_[channel].Reset(WithLooper(channel, [](auto &looper) { return looper.GetReadRate(); }));
+                writeRates_[channel].Reset(WithLooper(channel, [](auto &looper) { return looper.GetWriteRate(); }));
+            }
+            PublishTelemetry();
+        }
+
+        /**
+         * @brief Sends a command to the audio thread. The commands are
+         * executed in order at the beginning of the next block, that is with
+         * a latency of at most one block. Call this, and the setters below
+         * that use it, from a single thread.
+         *
+         * @param type
+         * @param channel
+         * @param value
+         * @return true
+         * @return false if the queue is full and the command has been dropped
+         */
+        bool Send(CommandType type, int channel = BOTH, float value = 0.f)
+        {
+            return commands_.Push(Command{type, channel, value, frames_.load(std::memory_order_relaxed)});
         }
 
+        /**
+         * @brief Returns the number of frames between sending and executing
+         * the last command.
+         *
+         * @return uint32_t
+         */
+        inline uint32_t GetCommandLatency() { return commandLatency_.load(std::memory_order_relaxed); }
+
         /**
          * @brief Sets the looper loopSync parameter. If true, the writing head
          * loop is kept in sync with that of the reading head (AKA delay mode).
@@ -195,16 +461,7 @@ namespace wreath
          */
         void SetLoopSync(int channel, bool loopSync)
         {
-            if (BOTH == channel)
-            {
-                loopers_[LEFT].SetLoopSync(loopSync);
-                loopers_[RIGHT].SetLoopSync(loopSync);
-                loopSync_ = loopSync;
-            }
-            else
-            {
-                loopers_[channel].SetLoopSync(loopSync);
-            }
+            Send(CommandType::SET_LOOP_SYNC, channel, loopSync);
         }
 
         /**
@@ -215,10 +472,7 @@ namespace wreath
          */
         void SetFilterValue(float value)
         {
-            filterValue_ = value;
-            feedbackFilter_.SetFreq(filterValue_);
-            feedbackFilter_.SetDrive(0.75f);
-            feedbackFilter_.SetRes(fmap(1.f - feedback, 0.05f, 0.2f + (freeze_ * 0.2f)));
+            Send(CommandType::SET_FILTER_VALUE, BOTH, value);
         }
 
         /**
@@ -228,9 +482,7 @@ namespace wreath
          */
         void SetDegradation(float value)
         {
-            degradation_ = value;
-            loopers_[LEFT].SetDegradation(value);
-            loopers_[RIGHT].SetDegradation(value);
+            Send(CommandType::SET_DEGRADATION, BOTH, value);
         }
 
         /**
@@ -241,8 +493,7 @@ namespace wreath
          */
         void SetLooping(bool active)
         {
-            loopers_[LEFT].SetLooping(active);
-            loopers_[RIGHT].SetLooping(active);
+            Send(CommandType::SET_LOOPING, BOTH, active);
         }
 
         /**
@@ -255,16 +506,7 @@ namespace wreath
          */
         void SetMovement(int channel, Movement movement)
         {
-            if (BOTH == channel)
-            {
-                loopers_[LEFT].SetMovement(movement);
-                loopers_[RIGHT].SetMovement(movement);
-                conf_.movement = movement;
-            }
-            else
-            {
-                loopers_[channel].SetMovement(movement);
-            }
+            Send(CommandType::SET_MOVEMENT, channel, static_cast<float>(movement));
         }
 
         /**
@@ -275,25 +517,7 @@ namespace wreath
          */
         void SetDirection(int channel, Direction direction)
         {
-            if (LEFT == channel || BOTH == channel)
-            {
-                leftDirection = direction;
-            }
-            if (RIGHT == channel || BOTH == channel)
-            {
-                rightDirection = direction;
-            }
-            if (BOTH == channel)
-            {
-                conf_.direction = direction;
-            }
-            // Before the looper starts, if the direction is backwards set the
-            // reading head at the end of the loop.
-            if (State::READY == state_ && Direction::BACKWARDS == direction)
-            {
-                loopers_[LEFT].SetReadPos(loopers_[LEFT].GetLoopEnd());
-                loopers_[RIGHT].SetReadPos(loopers_[RIGHT].GetLoopEnd());
-            }
+            Send(CommandType::SET_DIRECTION, channel, static_cast<float>(direction));
         }
 
         /**
@@ -304,14 +528,7 @@ namespace wreath
          */
         void SetLoopStart(int channel, float value)
         {
-            if (LEFT == channel || BOTH == channel)
-            {
-                nextLeftLoopStart = std::min(std::max(value, 0.f), loopers_[LEFT].GetBufferSamples() - 1.f);
-            }
-            if (RIGHT == channel || BOTH == channel)
-            {
-                nextRightLoopStart = std::min(std::max(value, 0.f), loopers_[RIGHT].GetBufferSamples() - 1.f);
-            }
+            Send(CommandType::SET_LOOP_START, channel, value);
         }
 
         /**
@@ -322,19 +539,7 @@ namespace wreath
          */
         void SetFreeze(int channel, float amount)
         {
-            if (LEFT == channel || BOTH == channel)
-            {
-                nextLeftFreeze = amount;
-            }
-            if (RIGHT == channel || BOTH == channel)
-            {
-                nextRightFreeze = amount;
-            }
-            freeze_ = amount;
-            if (State::READY != state_)
-            {
-                state_ = amount == 1.f ? State::FROZEN : State::RECORDING;
-            }
+            Send(CommandType::SET_FREEZE, channel, amount);
         }
 
         /**
@@ -345,15 +550,7 @@ namespace wreath
          */
         void SetReadRate(int channel, float rate)
         {
-            if (LEFT == channel || BOTH == channel)
-            {
-                nextLeftReadRate = rate;
-            }
-            if (RIGHT == channel || BOTH == channel)
-            {
-                nextRightReadRate = rate;
-            }
-            conf_.rate = rate;
+            Send(CommandType::SET_READ_RATE, channel, rate);
         }
 
         /**
@@ -364,14 +561,7 @@ namespace wreath
          */
         void SetWriteRate(int channel, float rate)
         {
-            if (LEFT == channel || BOTH == channel)
-            {
-                nextLeftWriteRate = rate;
-            }
-            if (RIGHT == channel || BOTH == channel)
-            {
-                nextRightWriteRate = rate;
-            }
+            Send(CommandType::SET_WRITE_RATE, channel, rate);
         }
 
         /**
@@ -383,32 +573,7 @@ namespace wreath
          */
         void SetLoopLength(int channel, float length)
         {
-            if (LEFT == channel || BOTH == channel)
-            {
-                nextLeftLoopLength = std::min(std::max(length, kMinLoopLengthSamples), static_cast<float>(loopers_[LEFT].GetBufferSamples()));
-                noteModeLeft = NoteMode::NO_MODE;
-                if (length <= kMinLoopLengthSamples)
-                {
-                    noteModeLeft = NoteMode::NOTE;
-                }
-                else if (length >= kMinSamplesForTone && length <= kMinSamplesForFlanger)
-                {
-                    noteModeLeft = NoteMode::FLANGER;
-                }
-            }
-            if (RIGHT == channel || BOTH == channel)
-            {
-                nextRightLoopLength = std::min(std::max(length, kMinLoopLengthSamples), static_cast<float>(loopers_[RIGHT].GetBufferSamples()));
-                noteModeRight = NoteMode::NO_MODE;
-                if (length <= kMinLoopLengthSamples)
-                {
-                    noteModeRight = NoteMode::NOTE;
-                }
-                else if (length >= kMinSamplesForTone && length <= kMinSamplesForFlanger)
-                {
-                    noteModeRight = NoteMode::FLANGER;
-                }
-            }
+            Send(CommandType::SET_LOOP_LENGTH, channel, length);
         }
 
         /**
@@ -417,12 +582,38 @@ namespace wreath
          */
         void Start()
         {
-            if (State::READY == state_)
+            Send(CommandType::START);
+        }
+
+        /**
+         * @brief Plays the current loop polyphonically at the pitch of the
+         * given note, the middle C being the recorded pitch. The voices are
+         * mixed with the wet signal, after the feedback.
+         *
+         * @param note the MIDI note
+         * @param velocity the MIDI velocity, zero releasing the note as in
+         * MIDI
+         */
+        void NoteOn(int note, int velocity)
+        {
+            if (velocity <= 0)
             {
-                loopers_[LEFT].StartReading(true);
-                loopers_[RIGHT].StartReading(true);
-                state_ = freeze_ == 1.f ? State::FROZEN : State::RECORDING;
+                NoteOff(note);
+
+                return;
             }
+
+            Send(CommandType::NOTE_ON, BOTH, static_cast<float>(note * 128 + velocity));
+        }
+
+        /**
+         * @brief Releases the voices playing the given note.
+         *
+         * @param note the MIDI note
+         */
+        void NoteOff(int note)
+        {
+            Send(CommandType::NOTE_OFF, BOTH, static_cast<float>(note));
         }
 
         /**
@@ -436,7 +627,15 @@ namespace wreath
          */
         void Process(const float leftIn, const float rightIn, float &leftOut, float &rightOut)
         {
-            // Input gain stage.
+            ExecuteCommands();
+            uint32_t frame = frames_.load(std::memory_order_relaxed) + 1;
+            frames_.store(frame, std::memory_order_relaxed);
+            if (!(frame % kMaxBlockSize))
+            {
+                PublishTelemetry();
+            }
+
+            // Input gain stage.
             float leftDry = SoftClip(leftIn * inputGain);
             float rightDry = SoftClip(rightIn * inputGain);
 
@@ -450,29 +649,19 @@ namespace wreath
             {
             case State::STARTUP:
             {
-                static int32_t fadeIndex{0};
-                if (fadeIndex > sampleRate_)
+                if (startupIndex_ > sampleRate_)
                 {
-                    fadeIndex = 0;
+                    startupIndex_ = 0;
                     state_ = State::BUFFERING;
                 }
-                fadeIndex++;
+                startupIndex_++;
 
                 // Return now, so we don't emit any sound.
                 return;
             }
             case State::BUFFERING:
             {
-                bool doneLeft{loopers_[LEFT].Buffer(leftDry)};
-                bool doneRight{loopers_[RIGHT].Buffer(rightDry)};
-                if ((doneLeft && doneRight) || mustStopBuffering)
-                {
-                    mustStopBuffering = false;
-                    loopers_[LEFT].StopBuffering();
-                    loopers_[RIGHT].StopBuffering();
-
-                    state_ = State::READY;
-                }
+                Buffer(leftDry, rightDry);
 
                 // Pass the audio through.
                 leftWet = leftDry;
@@ -482,167 +671,82 @@ namespace wreath
             }
             case State::READY:
             {
-                nextLeftLoopLength = loopers_[LEFT].GetLoopLength();
-                nextRightLoopLength = loopers_[RIGHT].GetLoopLength();
-                nextLeftLoopStart = loopers_[LEFT].GetLoopStart();
-                nextRightLoopStart = loopers_[RIGHT].GetLoopStart();
-                nextLeftReadRate = 1.f;
-                nextRightReadRate = 1.f;
-                nextLeftWriteRate = 1.f;
-                nextRightWriteRate = 1.f;
-                nextLeftFreeze = 0.f;
-                nextRightFreeze = 0.f;
+                ResetParameters();
 
                 break;
             }
             case State::RECORDING:
             case State::FROZEN:
             {
-                UpdateParameters();
-
-                if (mustClearBuffer)
-                {
-                    mustClearBuffer = false;
-                    loopers_[LEFT].ClearBuffer();
-                    loopers_[RIGHT].ClearBuffer();
-                }
-
-                if (mustResetLooper)
-                {
-                    mustResetLooper = false;
-                    loopers_[LEFT].StopReading(true);
-                    loopers_[RIGHT].StopReading(true);
-                    Reset();
-                    state_ = State::BUFFERING;
-
-                    break;
-                }
-
-                if (mustRetrigger)
-                {
-                    loopers_[LEFT].Trigger(false);
-                    loopers_[RIGHT].Trigger(false);
-                    mustRetrigger = false;
-                }
-
-                if (mustRestart)
-                {
-                    loopers_[LEFT].Trigger(true);
-                    loopers_[RIGHT].Trigger(true);
-                    mustRestart = false;
-                }
-
-                if (mustStartReading)
-                {
-                    loopers_[LEFT].StartReading(true);
-                    loopers_[RIGHT].StartReading(true);
-                    mustStartReading = false;
-                }
-
-                if (mustStopReading)
-                {
-                    loopers_[LEFT].StopReading(true);
-                    loopers_[RIGHT].StopReading(true);
-                    mustStopReading = false;
-                }
-
-                if (mustStartWriting)
-                {
-                    loopers_[LEFT].StartWriting(true);
-                    loopers_[RIGHT].StartWriting(true);
-                    mustStartWriting = false;
-                }
-
-                if (mustStopWriting)
-                {
-                    loopers_[LEFT].StopWriting(true);
-                    loopers_[RIGHT].StopWriting(true);
-                    mustStopWriting = false;
-                }
-
-                if (mustStartWritingLeft)
-                {
-                    loopers_[LEFT].StartWriting(false);
-                    mustStartWritingLeft = false;
-                }
-
-                if (mustStopWritingLeft)
-                {
-                    loopers_[LEFT].StopWriting(false);
-                    mustStopWritingLeft = false;
-                }
+                UpdateParameters(1);
+                UpdateBuffers(1);
 
-                if (mustStartWritingRight)
-                {
-                    loopers_[RIGHT].StartWriting(false);
-                    mustStartWritingRight = false;
-                }
-
-                if (mustStopWritingRight)
-                {
-                    loopers_[RIGHT].StopWriting(false);
-                    mustStopWritingRight = false;
-                }
-
-                leftWet = loopers_[LEFT].Read();
-                rightWet = loopers_[RIGHT].Read();
+                Read(leftWet, rightWet);
 
                 if (feedback > 0.f)
                 {
-                    if (crossedFeedback)
-                    {
-                        leftFeedback = loopers_[LEFT].Degrade(Mix(leftWet * (1.f - leftFeedbackPath), rightWet * (1.f - rightFeedbackPath)) * feedback);
-                        rightFeedback = loopers_[RIGHT].Degrade(Mix(leftWet * leftFeedbackPath, rightWet * rightFeedbackPath) * feedback);
-                    }
-                    else
-                    {
-                        leftFeedback = loopers_[LEFT].Degrade(leftWet * feedback);
-                        rightFeedback = loopers_[RIGHT].Degrade(rightWet * feedback);
-                    }
-                    float leftFiltered = filterLevel * Filter(leftFeedback) * feedback;
-                    float rightFiltered = filterLevel * Filter(rightFeedback) * feedback;
-                    leftFiltered *= (feedbackLevel - filterEnvelope_.GetEnv(leftFiltered));
-                    rightFiltered *= (feedbackLevel - filterEnvelope_.GetEnv(rightFiltered));
-                    leftFeedback = Mix(leftFeedback, leftFiltered);
-                    rightFeedback = Mix(rightFeedback, rightFiltered);
+                    Feedback(leftWet, rightWet, leftFeedback, rightFeedback);
                 }
 
-                loopers_[LEFT].UpdateReadPos();
-                loopers_[RIGHT].UpdateReadPos();
+                ForEachLooper(BOTH, [](auto &looper) { looper.UpdateReadPos(); });
 
-                loopers_[LEFT].Write(Mix(leftDry * dryLevel, leftFeedback));
-                loopers_[RIGHT].Write(Mix(rightDry * dryLevel, rightFeedback));
+                Write(Mix(leftDry * dryLevel, leftFeedback), Mix(rightDry * dryLevel, rightFeedback));
 
-                loopers_[LEFT].UpdateWritePos();
-                loopers_[RIGHT].UpdateWritePos();
+                ForEachLooper(BOTH, [](auto &looper) { looper.UpdateWritePos(); });
 
                 // Mix some of the filtered fed back signal with the wet when frozen.
                 leftWet = Mix(leftWet, filterLevel * Filter(leftFeedback) * freeze_);
                 rightWet = Mix(rightWet, filterLevel * Filter(rightFeedback) * freeze_);
+
+                ReadVoices(&leftWet, &rightWet, 1);
             }
             default:
                 break;
             }
 
-            // Mid-side processing for stereo widening.
-            float mid = (leftWet + rightWet) / fastroot(2, 10);
-            float side = ((leftWet - rightWet) / fastroot(2, 10)) * stereoWidth;
-            float stereoLeft = (mid + side) / fastroot(2, 10);
-            float stereoRight = (mid - side) / fastroot(2, 10);
-
-            // Output gain stage.
-            leftOut = SoftClip(Fader::EqualCrossFade(leftDry, stereoLeft, dryWetMix) * outputGain);
-            rightOut = SoftClip(Fader::EqualCrossFade(rightDry, stereoRight, dryWetMix) * outputGain);
+            Output(leftDry, rightDry, leftWet, rightWet, leftFeedback, rightFeedback, leftOut, rightOut);
+        }
 
-            if (feedbackOnly)
+        /**
+         * @brief Processes a block of planar input signals and outputs
+         * something. This is equivalent to calling Process() for each frame,
+         * but the commands and the parameters are handled once per span of at
+         * most kMaxBlockSize frames and the state transitions split the block
+         * at the right sample, so this is what you want to call from a block
+         * based AudioCallback. A span is read before being written, so it's
+         * also split where a head would reach what the other has just
+         * handled, e.g. in short loops. The telemetry is published at the end
+         * of the block.
+         *
+         * @param leftIn
+         * @param rightIn
+         * @param leftOut
+         * @param rightOut
+         * @param size
+         */
+        void ProcessBlock(const float *leftIn, const float *rightIn, float *leftOut, float *rightOut, size_t size)
+        {
+            size_t done{};
+            while (done < size)
             {
-                leftOut = SoftClip(leftFeedback);
-                rightOut = SoftClip(rightFeedback);
+                size_t span = ProcessSpan(leftIn + done, rightIn + done, leftOut + done, rightOut + done, std::min(size - done, kMaxBlockSize));
+                frames_.store(frames_.load(std::memory_order_relaxed) + span, std::memory_order_relaxed);
+                done += span;
             }
+            PublishTelemetry();
         }
 
     private:
-        Looper loopers_[2];
+        // Only one of the sets lives at a time, as selected by linked_.
+        union
+        {
+            ChannelLooper loopers_[2];
+            LinkedLooper linkedLooper_;
+        };
+        bool linked_{}; // Whether the channels share the linked looper
+        bool mono_{};   // Whether the left looper records the sum of the channels
+        Ramp readRates_[2]{};
+        Ramp writeRates_[2]{};
         State state_{}; // The current state of the looper
         EnvFollow filterEnvelope_{};
         Svf feedbackFilter_;
@@ -651,136 +755,1259 @@ namespace wreath
         float degradation_{};
         float filterValue_{};
         Conf conf_{};
+        int32_t startupIndex_{};
 
-        /**
-         * @brief Resets the loopers to their initial state.
-         */
-        void Reset()
-        {
-            loopers_[LEFT].Reset();
-            loopers_[RIGHT].Reset();
+        bool mustStopBuffering{};
 
-            // SetMode(conf_.mode);
-            SetMovement(BOTH, conf_.movement);
-            SetDirection(BOTH, conf_.direction);
-            SetReadRate(BOTH, conf_.rate);
-            SetWriteRate(BOTH, conf_.rate);
-        }
+        NoteMode noteModeLeft{};
+        NoteMode noteModeRight{};
+
+        float inputGain{1.f};
+        float outputGain{1.f};
+        float dryWetMix{0.5f};
+        float feedback{0.f};
+        float feedbackLevel{1.f};
+        bool feedbackOnly{};
+        bool crossedFeedback{};
+        float leftFeedbackPath{0.f};
+        float rightFeedbackPath{1.f};
+        float filterLevel{0.3f};
+        float rateSlew{0.f}; // Seconds
+        Ramp::Shape rateSlewShape{Ramp::Shape::EXPONENTIAL};
+        float stereoWidth{1.f};
+        float dryLevel{1.f};
+        bool loopSync_{};
+        FilterType filterType{FilterType::BP};
+
+        int32_t nextLeftLoopStart{};
+        int32_t nextRightLoopStart{};
+
+        Direction leftDirection{};
+        Direction rightDirection{};
+
+        int32_t nextLeftLoopLength{};
+        int32_t nextRightLoopLength{};
+
+        float nextLeftReadRate{};
+        float nextRightReadRate{};
+
+        float nextLeftWriteRate{};
+        float nextRightWriteRate{};
+
+        float nextLeftFreeze{};
+        float nextRightFreeze{};
+
+        CommandQueue<Command, kMaxCommands> commands_{};
+        CommandQueue<Command, kMaxCommands> held_{}; // The commands waiting for the looper to be running, in order
+        std::atomic<uint32_t> frames_{};         // Frames processed, written by the audio thread only
+        std::atomic<uint32_t> commandLatency_{}; // Frames between sending and executing the last command
+        TripleBuffer<Telemetry> telemetry_{};
+
+        inline const Telemetry::Channel &ChannelTelemetry(int channel) { return GetTelemetry().channels[channel]; }
 
         /**
-         * @brief Simple mixing and clipping of two signals.
-         *
-         * @param a
-         * @param b
-         * @return float
+         * @brief Constructs the loopers of the set selected by linked_ in the
+         * storage the sets share.
          */
-        float Mix(float a, float b)
+        void ConstructLoopers()
         {
-            return SoftClip(a + b);
+            if (linked_)
+            {
+                new (&linkedLooper_) LinkedLooper{};
+
+                return;
+            }
+            new (&loopers_[LEFT]) ChannelLooper{};
+            new (&loopers_[RIGHT]) ChannelLooper{};
         }
 
         /**
-         * @brief Filters the provided signal and returns the result.
-         *
-         * @param value
-         * @return float
+         * @brief Destroys the loopers of the set selected by linked_.
          */
-        float Filter(float value)
+        void DestroyLoopers()
         {
-            feedbackFilter_.Process(value);
-            switch (filterType)
+            if (linked_)
             {
-            case FilterType::BP:
-                return feedbackFilter_.Band();
-            case FilterType::HP:
-                return feedbackFilter_.High();
-            case FilterType::LP:
-                return feedbackFilter_.Low();
-            default:
-                return feedbackFilter_.Band();
+                linkedLooper_.~LinkedLooper();
+
+                return;
             }
+            loopers_[LEFT].~ChannelLooper();
+            loopers_[RIGHT].~ChannelLooper();
         }
 
         /**
-         * @brief Updates the loopers' parameters. This is called at the
-         * beginning of the Process() method to ensure that the parameters are
-         * changed at the right moment.
+         * @brief Calls the given function with the loopers of the given
+         * channel, that is with the linked or the mono looper, once, unless in
+         * DUAL mode.
+         *
+         * @tparam F a generic callable, taking any looper
+         * @param channel
+         * @param f
          */
-        void UpdateParameters()
+        template <typename F>
+        void ForEachLooper(int channel, F f)
         {
-            if (leftDirection != loopers_[LEFT].GetDirection())
+            if (linked_)
             {
-                loopers_[LEFT].SetDirection(leftDirection);
+                f(linkedLooper_);
+
+                return;
             }
-            if (rightDirection != loopers_[RIGHT].GetDirection())
+            if (mono_)
             {
-                loopers_[RIGHT].SetDirection(rightDirection);
-            }
+                f(loopers_[LEFT]);
 
-            float leftReadRate = loopers_[LEFT].GetReadRate();
-            if (leftReadRate != nextLeftReadRate)
-            {
-                float coeff = rateSlew > 0 ? 1.f / (rateSlew * sampleRate_) : 1.f;
-                fonepole(leftReadRate, nextLeftReadRate, coeff);
-                loopers_[LEFT].SetReadRate(leftReadRate);
+                return;
             }
-            float rightReadRate = loopers_[RIGHT].GetReadRate();
-            if (rightReadRate != nextRightReadRate)
+            if (LEFT == channel || BOTH == channel)
             {
-                float coeff = rateSlew > 0 ? 1.f / (rateSlew * sampleRate_) : 1.f;
-                fonepole(rightReadRate, nextRightReadRate, coeff);
-                loopers_[RIGHT].SetReadRate(rightReadRate);
+                f(loopers_[LEFT]);
             }
-
-            float leftWriteRate = loopers_[LEFT].GetWriteRate();
-            if (leftWriteRate != nextLeftWriteRate)
+            if (RIGHT == channel || BOTH == channel)
             {
-                float coeff = rateSlew > 0 ? 1.f / (rateSlew * sampleRate_) : 1.f;
-                fonepole(leftWriteRate, nextLeftWriteRate, coeff);
-                loopers_[LEFT].SetWriteRate(leftWriteRate);
+                f(loopers_[RIGHT]);
             }
-            float rightWriteRate = loopers_[RIGHT].GetWriteRate();
-            if (rightWriteRate != nextRightWriteRate)
+        }
+
+        /**
+         * @brief Returns what the given function returns for the looper of the
+         * given channel, LEFT or RIGHT.
+         *
+         * @tparam F a generic callable, taking any looper
+         * @param channel
+         * @param f
+         */
+        template <typename F>
+        auto WithLooper(int channel, F f) -> decltype(f(loopers_[LEFT]))
+        {
+            return linked_ ? f(linkedLooper_) : f(loopers_[mono_ ? LEFT : channel]);
+        }
+
+        /**
+         * @brief Publishes the current view of the looper for the UI.
+         */
+        void PublishTelemetry()
+        {
+            Telemetry &telemetry = telemetry_.Back();
+            for (int channel : {LEFT, RIGHT})
             {
-                float coeff = rateSlew > 0 ? 1.f / (rateSlew * sampleRate_) : 1.f;
-                fonepole(rightWriteRate, nextRightWriteRate, coeff);
-                loopers_[RIGHT].SetWriteRate(rightWriteRate);
+                Telemetry::Channel &view = telemetry.channels[channel];
+                WithLooper(channel, [&view](auto &looper) {
+                    view.bufferSamples = looper.GetBufferSamples();
+                    view.loopStart = looper.GetLoopStart();
+                    view.loopEnd = looper.GetLoopEnd();
+                    view.loopLength = looper.GetLoopLength();
+                    view.readPos = looper.GetReadPos();
+                    view.writePos = looper.GetWritePos();
+                    view.readRate = looper.GetReadRate();
+                    view.headsDistance = looper.GetHeadsDistance();
+                    view.crossPoint = looper.GetCrossPoint();
+                    view.movement = looper.GetMovement();
+                    view.goingForward = looper.IsGoingForward();
+                });
+                view.noteMode = LEFT == channel ? noteModeLeft : noteModeRight;
             }
+            telemetry.state = state_;
+            telemetry.mode = conf_.mode;
+            telemetry.loopSync = loopSync_;
+            telemetry.filterValue = filterValue_;
+            telemetry.sampleRate = sampleRate_;
+            telemetry.frame = frames_.load(std::memory_order_relaxed);
+            telemetry_.Publish();
+        }
+
+        /**
+         * @brief Resets the loopers to their initial state.
+         */
+        void Reset()
+        {
+            ForEachLooper(BOTH, [](auto &looper) { looper.Reset(); });
+
+            // SetMode(conf_.mode);
+            ApplyMovement(BOTH, conf_.movement);
+            ApplyDirection(BOTH, conf_.direction);
+            ApplyReadRate(BOTH, conf_.rate);
+            ApplyWriteRate(BOTH, conf_.rate);
+        }
 
-            float leftLoopLength = loopers_[LEFT].GetLoopLength();
-            if (leftLoopLength != nextLeftLoopLength)
+        /**
+         * @brief Sets the looper loopSync parameter. If true, the writing head
+         * loop is kept in sync with that of the reading head (AKA delay mode).
+         *
+         * @param channel
+         * @param loopSync
+         */
+        void ApplyLoopSync(int channel, bool loopSync)
+        {
+            ForEachLooper(channel, [loopSync](auto &looper) { looper.SetLoopSync(loopSync); });
+            if (BOTH == channel)
             {
-                loopers_[LEFT].SetLoopLength(nextLeftLoopLength);
+                loopSync_ = loopSync;
             }
-            float rightLoopLength = loopers_[RIGHT].GetLoopLength();
-            if (rightLoopLength != nextRightLoopLength)
+        }
+
+        /**
+         * @brief Sets the value for the filter, changing a bunch of parameters
+         * at once.
+         *
+         * @param value
+         */
+        void ApplyFilterValue(float value)
+        {
+            filterValue_ = value;
+            feedbackFilter_.SetFreq(filterValue_);
+            feedbackFilter_.SetDrive(0.75f);
+            feedbackFilter_.SetRes(fmap(1.f - feedback, 0.05f, 0.2f + (freeze_ * 0.2f)));
+        }
+
+        /**
+         * @brief Sets the amount of degradation of the feedback.
+         *
+         * @param value
+         */
+        void ApplyDegradation(float value)
+        {
+            degradation_ = value;
+            ForEachLooper(BOTH, [value](auto &looper) { looper.SetDegradation(value); });
+        }
+
+        /**
+         * @brief Sets whether the loopers should stop at the end or continue
+         * looping indefinitely.
+         *
+         * @param active
+         */
+        void ApplyLooping(bool active)
+        {
+            ForEachLooper(BOTH, [active](auto &looper) { looper.SetLooping(active); });
+        }
+
+        /**
+         * @brief Sets how the loopers' reading heads are moving, if either
+         * normally, with a pendulum motion (change of direction when looping)
+         * or randomly. Only the normal mode has been completely implemented.
+         *
+         * @param channel
+         * @param movement
+         */
+        void ApplyMovement(int channel, Movement movement)
+        {
+            ForEachLooper(channel, [movement](auto &looper) { looper.SetMovement(movement); });
+            if (BOTH == channel)
             {
-                loopers_[RIGHT].SetLoopLength(nextRightLoopLength);
+                conf_.movement = movement;
             }
+        }
 
-            float leftLoopStart = loopers_[LEFT].GetLoopStart();
-            if (leftLoopStart != nextLeftLoopStart)
+        /**
+         * @brief Sets the direction of the reading head.
+         *
+         * @param channel
+         * @param direction
+         */
+        void ApplyDirection(int channel, Direction direction)
+        {
+            if (LEFT == channel || BOTH == channel)
             {
-                loopers_[LEFT].SetLoopStart(nextLeftLoopStart);
+                leftDirection = direction;
             }
-            float rightLoopStart = loopers_[RIGHT].GetLoopStart();
-            if (rightLoopStart != nextRightLoopStart)
+            if (RIGHT == channel || BOTH == channel)
             {
-                loopers_[RIGHT].SetLoopStart(nextRightLoopStart);
+                rightDirection = direction;
             }
-
-            float leftFreeze = loopers_[LEFT].GetFreeze();
-            if (leftFreeze != nextLeftFreeze)
+            if (BOTH == channel)
             {
-                loopers_[LEFT].SetFreeze(nextLeftFreeze);
+                conf_.direction = direction;
             }
-
-            float rightFreeze = loopers_[RIGHT].GetFreeze();
-            if (rightFreeze != nextRightFreeze)
+            // Before the looper starts, if the direction is backwards set the
+            // reading head at the end of the loop.
+            if (State::READY == state_ && Direction::BACKWARDS == direction)
             {
-                loopers_[RIGHT].SetFreeze(nextRightFreeze);
+                ForEachLooper(BOTH, [](auto &looper) { looper.SetReadPos(looper.GetLoopEnd()); });
             }
         }
-    };
+
+        /**
+         * @brief Sets the loopers' start position (in samples).
+         *
+         * @param channel
+         * @param value
+         */
+        void ApplyLoopStart(int channel, float value)
+        {
+            if (LEFT == channel || BOTH == channel)
+            {
+                nextLeftLoopStart = std::min(std::max(value, 0.f), BufferSamples(LEFT) - 1.f);
+            }
+            if (RIGHT == channel || BOTH == channel)
+            {
+                nextRightLoopStart = std::min(std::max(value, 0.f), BufferSamples(RIGHT) - 1.f);
+            }
+        }
+
+        /**
+         * @brief Sets the loopers' freeze amount.
+         *
+         * @param channel
+         * @param amount
+         */
+        void ApplyFreeze(int channel, float amount)
+        {
+            if (LEFT == channel || BOTH == channel)
+            {
+                nextLeftFreeze = amount;
+            }
+            if (RIGHT == channel || BOTH == channel)
+            {
+                nextRightFreeze = amount;
+            }
+            freeze_ = amount;
+            if (State::READY != state_)
+            {
+                state_ = amount == 1.f ? State::FROZEN : State::RECORDING;
+            }
+        }
+
+        /**
+         * @brief Sets the speed of the reading head.
+         *
+         * @param channel
+         * @param rate
+         */
+        void ApplyReadRate(int channel, float rate)
+        {
+            if (LEFT == channel || BOTH == channel)
+            {
+                nextLeftReadRate = rate;
+            }
+            if (RIGHT == channel || BOTH == channel)
+            {
+                nextRightReadRate = rate;
+            }
+            conf_.rate = rate;
+        }
+
+        /**
+         * @brief Sets the speed of the writing head.
+         *
+         * @param channel
+         * @param rate
+         */
+        void ApplyWriteRate(int channel, float rate)
+        {
+            if (LEFT == channel || BOTH == channel)
+            {
+                nextLeftWriteRate = rate;
+            }
+            if (RIGHT == channel || BOTH == channel)
+            {
+                nextRightWriteRate = rate;
+            }
+        }
+
+        /**
+         * @brief Sets the loopers' loop length (in samples), also deciding
+         * whether note mode is active or not.
+         *
+         * @param channel
+         * @param length
+         */
+        void ApplyLoopLength(int channel, float length)
+        {
+            if (LEFT == channel || BOTH == channel)
+            {
+                nextLeftLoopLength = std::min(std::max(length, kMinLoopLengthSamples), static_cast<float>(BufferSamples(LEFT)));
+                noteModeLeft = NoteMode::NO_MODE;
+                if (length <= kMinLoopLengthSamples)
+                {
+                    noteModeLeft = NoteMode::NOTE;
+                }
+                else if (length >= kMinSamplesForTone && length <= kMinSamplesForFlanger)
+                {
+                    noteModeLeft = NoteMode::FLANGER;
+                }
+            }
+            if (RIGHT == channel || BOTH == channel)
+            {
+                nextRightLoopLength = std::min(std::max(length, kMinLoopLengthSamples), static_cast<float>(BufferSamples(RIGHT)));
+                noteModeRight = NoteMode::NO_MODE;
+                if (length <= kMinLoopLengthSamples)
+                {
+                    noteModeRight = NoteMode::NOTE;
+                }
+                else if (length >= kMinSamplesForTone && length <= kMinSamplesForFlanger)
+                {
+                    noteModeRight = NoteMode::FLANGER;
+                }
+            }
+        }
+
+        inline int32_t BufferSamples(int channel)
+        {
+            return WithLooper(channel, [](auto &looper) { return looper.GetBufferSamples(); });
+        }
+
+        /**
+         * @brief Simple mixing and clipping of two signals.
+         *
+         * @param a
+         * @param b
+         * @return float
+         */
+        float Mix(float a, float b)
+        {
+            return SoftClip(a + b);
+        }
+
+        /**
+         * @brief Sums the two channels for the mono looper.
+         *
+         * @param left
+         * @param right
+         * @return float
+         */
+        inline float MonoSum(float left, float right)
+        {
+            return (left + right) * 0.5f;
+        }
+
+        /**
+         * @brief Filters the provided signal and returns the result.
+         *
+         * @param value
+         * @return float
+         */
+        float Filter(float value)
+        {
+            feedbackFilter_.Process(value);
+            switch (filterType)
+            {
+            case FilterType::BP:
+                return feedbackFilter_.Band();
+            case FilterType::HP:
+                return feedbackFilter_.High();
+            case FilterType::LP:
+                return feedbackFilter_.Low();
+            default:
+                return feedbackFilter_.Band();
+            }
+        }
+
+        /**
+         * @brief Processes a span of frames in which the state doesn't change,
+         * unless at its last frame.
+         *
+         * @param leftIn
+         * @param rightIn
+         * @param leftOut
+         * @param rightOut
+         * @param size
+         * @return size_t the number of frames processed
+         */
+        size_t ProcessSpan(const float *leftIn, const float *rightIn, float *leftOut, float *rightOut, size_t size)
+        {
+            ExecuteCommands();
+
+            if (State::STARTUP == state_)
+            {
+                // Emit silence for about a second.
+                size = std::min(size, static_cast<size_t>(sampleRate_ + 2 - startupIndex_));
+                std::fill(leftOut, leftOut + size, 0.f);
+                std::fill(rightOut, rightOut + size, 0.f);
+                startupIndex_ += size;
+                if (startupIndex_ > sampleRate_ + 1)
+                {
+                    startupIndex_ = 0;
+                    state_ = State::BUFFERING;
+                }
+
+                return size;
+            }
+
+            // Input gain stage.
+            float leftDry[kMaxBlockSize];
+            float rightDry[kMaxBlockSize];
+            for (size_t i = 0; i < size; i++)
+            {
+                leftDry[i] = SoftClip(leftIn[i] * inputGain);
+                rightDry[i] = SoftClip(rightIn[i] * inputGain);
+            }
+
+            float leftWet[kMaxBlockSize]{};
+            float rightWet[kMaxBlockSize]{};
+
+            float leftFeedback[kMaxBlockSize]{};
+            float rightFeedback[kMaxBlockSize]{};
+
+            switch (state_)
+            {
+            case State::BUFFERING:
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    // Pass the audio through.
+                    leftWet[i] = leftDry[i];
+                    rightWet[i] = rightDry[i];
+
+                    // Split the span when the buffering is done.
+                    if (Buffer(leftDry[i], rightDry[i]))
+                    {
+                        size = i + 1;
+                    }
+                }
+
+                break;
+            }
+            case State::READY:
+            {
+                ResetParameters();
+
+                break;
+            }
+            case State::RECORDING:
+            case State::FROZEN:
+            {
+                // Split the span before a frame is read after being written
+                // within it, where the heads are closer than the span. The
+                // heads move at the average rates of the span, so it's
+                // shortened until they keep it whole, and only then the ramps
+                // are advanced by the frames actually rendered.
+                for (size_t span = 0; span != size;)
+                {
+                    span = size;
+                    UpdateParameters(span, true);
+                    size = GetIndependentSpan(span);
+                }
+                UpdateParameters(size);
+                UpdateBuffers(size);
+
+                ReadBlock(leftWet, rightWet, size);
+
+                if (feedback > 0.f)
+                {
+                    for (size_t i = 0; i < size; i++)
+                    {
+                        FeedbackMix(leftWet[i], rightWet[i], leftFeedback[i], rightFeedback[i]);
+                    }
+                    DegradeBlock(leftFeedback, rightFeedback, size);
+                }
+
+                float leftInput[kMaxBlockSize];
+                float rightInput[kMaxBlockSize];
+                for (size_t i = 0; i < size; i++)
+                {
+                    if (feedback > 0.f)
+                    {
+                        FeedbackFilter(leftFeedback[i], rightFeedback[i]);
+                    }
+
+                    leftInput[i] = Mix(leftDry[i] * dryLevel, leftFeedback[i]);
+                    rightInput[i] = Mix(rightDry[i] * dryLevel, rightFeedback[i]);
+
+                    // Mix some of the filtered fed back signal with the wet when frozen.
+                    leftWet[i] = Mix(leftWet[i], filterLevel * Filter(leftFeedback[i]) * freeze_);
+                    rightWet[i] = Mix(rightWet[i], filterLevel * Filter(rightFeedback[i]) * freeze_);
+                }
+
+                WriteBlock(leftInput, rightInput, size);
+
+                ReadVoices(leftWet, rightWet, size);
+
+                break;
+            }
+            default:
+                break;
+            }
+
+            for (size_t i = 0; i < size; i++)
+            {
+                Output(leftDry[i], rightDry[i], leftWet[i], rightWet[i], leftFeedback[i], rightFeedback[i], leftOut[i], rightOut[i]);
+            }
+
+            return size;
+        }
+
+        /**
+         * @brief Returns how many of the given frames all the loopers can
+         * read before writing them, the same as one at a time.
+         * @see BasicLooper::GetIndependentSpan()
+         *
+         * @param size
+         * @return size_t
+         */
+        size_t GetIndependentSpan(size_t size)
+        {
+            ForEachLooper(BOTH, [&size](auto &looper) { size = looper.GetIndependentSpan(size); });
+
+            return size;
+        }
+
+        /**
+         * @brief Writes the given values during the buffering procedure,
+         * completing it when the buffer is full or when requested.
+         *
+         * @param leftValue
+         * @param rightValue
+         * @return true if the buffering is complete
+         * @return false
+         */
+        bool Buffer(float leftValue, float rightValue)
+        {
+            bool done{};
+            if (linked_)
+            {
+                done = linkedLooper_.Buffer(StereoFrame{{leftValue, rightValue}});
+            }
+            else if (mono_)
+            {
+                done = loopers_[LEFT].Buffer(MonoSum(leftValue, rightValue));
+            }
+            else
+            {
+                bool doneLeft{loopers_[LEFT].Buffer(leftValue)};
+                bool doneRight{loopers_[RIGHT].Buffer(rightValue)};
+                done = doneLeft && doneRight;
+            }
+            if (done || mustStopBuffering)
+            {
+                mustStopBuffering = false;
+                ForEachLooper(BOTH, [](auto &looper) { looper.StopBuffering(); });
+
+                state_ = State::READY;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        /**
+         * @brief Keeps the parameters in line with the loopers' state until
+         * the looper is started.
+         */
+        void ResetParameters()
+        {
+            nextLeftLoopLength = WithLooper(LEFT, [](auto &looper) { return looper.GetLoopLength(); });
+            nextRightLoopLength = WithLooper(RIGHT, [](auto &looper) { return looper.GetLoopLength(); });
+            nextLeftLoopStart = WithLooper(LEFT, [](auto &looper) { return looper.GetLoopStart(); });
+            nextRightLoopStart = WithLooper(RIGHT, [](auto &looper) { return looper.GetLoopStart(); });
+            nextLeftReadRate = 1.f;
+            nextRightReadRate = 1.f;
+            nextLeftWriteRate = 1.f;
+            nextRightWriteRate = 1.f;
+            nextLeftFreeze = 0.f;
+            nextRightFreeze = 0.f;
+        }
+
+        /**
+         * @brief Carries on clearing the buffers and copying the frozen loops,
+         * if needed, within the bytes budget of the given number of frames,
+         * then moves the caches of the short loops. The linked and the mono
+         * loopers get the budget of both channels.
+         *
+         * @param frames
+         */
+        void UpdateBuffers(size_t frames)
+        {
+            size_t channels = linked_ || mono_ ? 2 : 1;
+            ForEachLooper(BOTH, [frames, channels](auto &looper) {
+                looper.UpdateBufferClear(frames * channels * kClearBytesPerFrame);
+                looper.UpdateFreezeSnapshot(frames * channels * kSnapshotBytesPerFrame);
+                looper.UpdateLoopCache();
+            });
+        }
+
+        /**
+         * @brief Executes the commands sent since the last block, in order.
+         * An action that must wait for the looper to be running is held
+         * aside, with all the commands following it, so that the queue keeps
+         * flowing, and they are executed as soon as it runs. START and
+         * STOP_BUFFERING, which make it run, are never held. When the held
+         * commands fill up, the rest waits in the queue.
+         */
+        void ExecuteCommands()
+        {
+            ExecuteHeldCommands();
+            while (const Command *command = commands_.Peek())
+            {
+                bool starting = CommandType::START == command->type || CommandType::STOP_BUFFERING == command->type;
+                if ((starting || held_.IsEmpty()) && Execute(*command))
+                {
+                    commands_.Pop();
+                    ExecuteHeldCommands();
+                    continue;
+                }
+                if (!held_.Push(*command))
+                {
+                    break;
+                }
+                commands_.Pop();
+            }
+        }
+
+        /**
+         * @brief Executes the held commands, in order, until one of them
+         * must wait for the looper to be running again, e.g. after a RESET.
+         */
+        void ExecuteHeldCommands()
+        {
+            while (const Command *command = held_.Peek())
+            {
+                if (!Execute(*command))
+                {
+                    break;
+                }
+                held_.Pop();
+            }
+        }
+
+        /**
+         * @brief Executes the given command, recording its latency.
+         *
+         * @param command
+         * @return true
+         * @return false if the command must wait for the looper to be
+         * running, it's not executed then
+         */
+        bool Execute(const Command &command)
+        {
+            // The linked channels can't diverge.
+            int channel = linked_ || mono_ ? BOTH : command.channel;
+            float value = command.value;
+
+            if (command.type >= CommandType::RESET && command.type <= CommandType::STOP_WRITING)
+            {
+                if (State::RECORDING != state_ && State::FROZEN != state_)
+                {
+                    return false;
+                }
+                // The parameters sent before the action apply first.
+                UpdateParameters(0);
+            }
+
+            switch (command.type)
+            {
+            case CommandType::START:
+                if (State::READY == state_)
+                {
+                    ForEachLooper(BOTH, [](auto &looper) { looper.StartReading(true); });
+                    state_ = freeze_ == 1.f ? State::FROZEN : State::RECORDING;
+                }
+                break;
+            case CommandType::STOP_BUFFERING:
+                mustStopBuffering = true;
+                break;
+            case CommandType::RESET:
+                ForEachLooper(BOTH, [](auto &looper) { looper.StopReading(true); });
+                Reset();
+                state_ = State::BUFFERING;
+                break;
+            case CommandType::CLEAR_BUFFER:
+                ForEachLooper(BOTH, [](auto &looper) { looper.ClearBuffer(); });
+                break;
+            case CommandType::RETRIGGER:
+                ForEachLooper(BOTH, [](auto &looper) { looper.Trigger(false); });
+                break;
+            case CommandType::RESTART:
+                ForEachLooper(BOTH, [](auto &looper) { looper.Trigger(true); });
+                break;
+            case CommandType::START_READING:
+                ForEachLooper(BOTH, [](auto &looper) { looper.StartReading(true); });
+                break;
+            case CommandType::STOP_READING:
+                ForEachLooper(BOTH, [](auto &looper) { looper.StopReading(true); });
+                break;
+            case CommandType::START_WRITING:
+                ForEachLooper(channel, [value](auto &looper) { looper.StartWriting(value); });
+                break;
+            case CommandType::STOP_WRITING:
+                ForEachLooper(channel, [value](auto &looper) { looper.StopWriting(value); });
+                break;
+            case CommandType::SET_LOOP_START:
+                ApplyLoopStart(channel, value);
+                break;
+            case CommandType::SET_LOOP_LENGTH:
+                ApplyLoopLength(channel, value);
+                break;
+            case CommandType::SET_READ_RATE:
+                ApplyReadRate(channel, value);
+                break;
+            case CommandType::SET_WRITE_RATE:
+                ApplyWriteRate(channel, value);
+                break;
+            case CommandType::SET_FREEZE:
+                ApplyFreeze(channel, value);
+                break;
+            case CommandType::SET_DIRECTION:
+                ApplyDirection(channel, static_cast<Direction>(value));
+                break;
+            case CommandType::SET_MOVEMENT:
+                ApplyMovement(channel, static_cast<Movement>(value));
+                break;
+            case CommandType::SET_LOOP_SYNC:
+                ApplyLoopSync(channel, value);
+                break;
+            case CommandType::SET_LOOPING:
+                ApplyLooping(value);
+                break;
+            case CommandType::SET_DEGRADATION:
+                ApplyDegradation(value);
+                break;
+            case CommandType::SET_FILTER_VALUE:
+                ApplyFilterValue(value);
+                break;
+            case CommandType::SET_FILTER_TYPE:
+                filterType = static_cast<FilterType>(value);
+                break;
+            case CommandType::SET_FILTER_LEVEL:
+                filterLevel = value;
+                break;
+            case CommandType::SET_INPUT_GAIN:
+                inputGain = value;
+                break;
+            case CommandType::SET_OUTPUT_GAIN:
+                outputGain = value;
+                break;
+            case CommandType::SET_DRY_WET_MIX:
+                dryWetMix = value;
+                break;
+            case CommandType::SET_DRY_LEVEL:
+                dryLevel = value;
+                break;
+            case CommandType::SET_FEEDBACK:
+                feedback = value;
+                break;
+            case CommandType::SET_FEEDBACK_LEVEL:
+                feedbackLevel = value;
+                break;
+            case CommandType::SET_FEEDBACK_ONLY:
+                feedbackOnly = value;
+                break;
+            case CommandType::SET_CROSSED_FEEDBACK:
+                crossedFeedback = value;
+                break;
+            case CommandType::SET_FEEDBACK_PATH:
+                if (LEFT == channel || BOTH == channel)
+                {
+                    leftFeedbackPath = value;
+                }
+                if (RIGHT == channel || BOTH == channel)
+                {
+                    rightFeedbackPath = value;
+                }
+                break;
+            case CommandType::SET_RATE_SLEW:
+                rateSlew = value;
+                break;
+            case CommandType::SET_RATE_SLEW_SHAPE:
+                rateSlewShape = static_cast<Ramp::Shape>(value);
+                break;
+            case CommandType::SET_STEREO_WIDTH:
+                stereoWidth = value;
+                break;
+            case CommandType::NOTE_ON:
+            {
+                int data = static_cast<int>(value);
+                ForEachLooper(BOTH, [data](auto &looper) { looper.NoteOn(data / 128, (data % 128) / 127.f); });
+                break;
+            }
+            case CommandType::NOTE_OFF:
+                ForEachLooper(BOTH, [value](auto &looper) { looper.NoteOff(static_cast<int32_t>(value)); });
+                break;
+            }
+            commandLatency_.store(frames_.load(std::memory_order_relaxed) - command.frame, std::memory_order_relaxed);
+
+            return true;
+        }
+
+        /**
+         * @brief Calculates the signal to be fed back from the given wet
+         * signal.
+         *
+         * @param leftWet
+         * @param rightWet
+         * @param leftFeedback
+         * @param rightFeedback
+         */
+        void Feedback(float leftWet, float rightWet, float &leftFeedback, float &rightFeedback)
+        {
+            FeedbackMix(leftWet, rightWet, leftFeedback, rightFeedback);
+            if (linked_)
+            {
+                StereoFrame degraded = linkedLooper_.Degrade(StereoFrame{{leftFeedback, rightFeedback}});
+                leftFeedback = degraded[LEFT];
+                rightFeedback = degraded[RIGHT];
+            }
+            else if (mono_)
+            {
+                // The mono looper records the sum anyway.
+                leftFeedback = loopers_[LEFT].Degrade(MonoSum(leftFeedback, rightFeedback));
+                rightFeedback = leftFeedback;
+            }
+            else
+            {
+                leftFeedback = loopers_[LEFT].Degrade(leftFeedback);
+                rightFeedback = loopers_[RIGHT].Degrade(rightFeedback);
+            }
+            FeedbackFilter(leftFeedback, rightFeedback);
+        }
+
+        /**
+         * @brief Reads the current frame from the loopers.
+         *
+         * @param left
+         * @param right
+         */
+        void Read(float &left, float &right)
+        {
+            if (linked_)
+            {
+                StereoFrame frame = linkedLooper_.Read();
+                left = frame[LEFT];
+                right = frame[RIGHT];
+
+                return;
+            }
+            left = loopers_[LEFT].Read();
+            right = mono_ ? left : loopers_[RIGHT].Read();
+        }
+
+        /**
+         * @brief Writes the given frame to the loopers.
+         *
+         * @param left
+         * @param right
+         */
+        void Write(float left, float right)
+        {
+            if (linked_)
+            {
+                linkedLooper_.Write(StereoFrame{{left, right}});
+
+                return;
+            }
+            if (mono_)
+            {
+                loopers_[LEFT].Write(MonoSum(left, right));
+
+                return;
+            }
+            loopers_[LEFT].Write(left);
+            loopers_[RIGHT].Write(right);
+        }
+
+        /**
+         * @brief Reads a block of planar frames from the loopers, the linked
+         * looper's frames are deinterleaved and the mono looper's values go
+         * to both channels.
+         *
+         * @param left
+         * @param right
+         * @param size at most kMaxBlockSize
+         */
+        void ReadBlock(float *left, float *right, size_t size)
+        {
+            if (linked_)
+            {
+                StereoFrame frames[kMaxBlockSize];
+                linkedLooper_.ReadBlock(frames, size);
+                for (size_t i = 0; i < size; i++)
+                {
+                    left[i] = frames[i][LEFT];
+                    right[i] = frames[i][RIGHT];
+                }
+
+                return;
+            }
+            loopers_[LEFT].ReadBlock(left, size);
+            if (mono_)
+            {
+                std::copy(left, left + size, right);
+
+                return;
+            }
+            loopers_[RIGHT].ReadBlock(right, size);
+        }
+
+        /**
+         * @brief Writes a block of planar frames to the loopers, interleaving
+         * them for the linked looper and summing them for the mono one.
+         *
+         * @param left
+         * @param right
+         * @param size at most kMaxBlockSize
+         */
+        void WriteBlock(const float *left, const float *right, size_t size)
+        {
+            if (linked_)
+            {
+                StereoFrame frames[kMaxBlockSize];
+                for (size_t i = 0; i < size; i++)
+                {
+                    frames[i] = StereoFrame{{left[i], right[i]}};
+                }
+                linkedLooper_.WriteBlock(frames, size);
+
+                return;
+            }
+            if (mono_)
+            {
+                float values[kMaxBlockSize];
+                for (size_t i = 0; i < size; i++)
+                {
+                    values[i] = MonoSum(left[i], right[i]);
+                }
+                loopers_[LEFT].WriteBlock(values, size);
+
+                return;
+            }
+            loopers_[LEFT].WriteBlock(left, size);
+            loopers_[RIGHT].WriteBlock(right, size);
+        }
+
+        /**
+         * @brief Adds the loopers' voices to a block of planar frames.
+         *
+         * @param left
+         * @param right
+         * @param size at most kMaxBlockSize
+         */
+        void ReadVoices(float *left, float *right, size_t size)
+        {
+            if (linked_)
+            {
+                if (!linkedLooper_.GetActiveVoices())
+                {
+                    return;
+                }
+                StereoFrame frames[kMaxBlockSize]{};
+                linkedLooper_.ReadVoices(frames, size);
+                for (size_t i = 0; i < size; i++)
+                {
+                    left[i] += frames[i][LEFT];
+                    right[i] += frames[i][RIGHT];
+                }
+
+                return;
+            }
+            if (mono_)
+            {
+                if (!loopers_[LEFT].GetActiveVoices())
+                {
+                    return;
+                }
+                float values[kMaxBlockSize]{};
+                loopers_[LEFT].ReadVoices(values, size);
+                for (size_t i = 0; i < size; i++)
+                {
+                    left[i] += values[i];
+                    right[i] += values[i];
+                }
+
+                return;
+            }
+            loopers_[LEFT].ReadVoices(left, size);
+            loopers_[RIGHT].ReadVoices(right, size);
+        }
+
+        /**
+         * @brief Degrades a block of planar feedback frames. The linked
+         * channels share the same noise, the mono ones are summed and degraded
+         * once.
+         *
+         * @param left
+         * @param right
+         * @param size at most kMaxBlockSize
+         */
+        void DegradeBlock(float *left, float *right, size_t size)
+        {
+            if (linked_)
+            {
+                StereoFrame frames[kMaxBlockSize];
+                for (size_t i = 0; i < size; i++)
+                {
+                    frames[i] = StereoFrame{{left[i], right[i]}};
+                }
+                linkedLooper_.DegradeBlock(frames, size);
+                for (size_t i = 0; i < size; i++)
+                {
+                    left[i] = frames[i][LEFT];
+                    right[i] = frames[i][RIGHT];
+                }
+
+                return;
+            }
+            if (mono_)
+            {
+                for (size_t i = 0; i < size; i++)
+                {
+                    left[i] = MonoSum(left[i], right[i]);
+                }
+                loopers_[LEFT].DegradeBlock(left, size);
+                std::copy(left, left + size, right);
+
+                return;
+            }
+            loopers_[LEFT].DegradeBlock(left, size);
+            loopers_[RIGHT].DegradeBlock(right, size);
+        }
+
+        /**
+         * @brief Mixes the wet signal to be fed back, before degradation.
+         *
+         * @param leftWet
+         * @param rightWet
+         * @param leftFeedback
+         * @param rightFeedback
+         */
+        void FeedbackMix(float leftWet, float rightWet, float &leftFeedback, float &rightFeedback)
+        {
+            if (crossedFeedback)
+            {
+                leftFeedback = Mix(leftWet * (1.f - leftFeedbackPath), rightWet * (1.f - rightFeedbackPath)) * feedback;
+                rightFeedback = Mix(leftWet * leftFeedbackPath, rightWet * rightFeedbackPath) * feedback;
+            }
+            else
+            {
+                leftFeedback = leftWet * feedback;
+                rightFeedback = rightWet * feedback;
+            }
+        }
+
+        /**
+         * @brief Adds the filtered signal to the degraded feedback.
+         *
+         * @param leftFeedback
+         * @param rightFeedback
+         */
+        void FeedbackFilter(float &leftFeedback, float &rightFeedback)
+        {
+            float leftFiltered = filterLevel * Filter(leftFeedback) * feedback;
+            float rightFiltered = filterLevel * Filter(rightFeedback) * feedback;
+            leftFiltered *= (feedbackLevel - filterEnvelope_.GetEnv(leftFiltered));
+            rightFiltered *= (feedbackLevel - filterEnvelope_.GetEnv(rightFiltered));
+            leftFeedback = Mix(leftFeedback, leftFiltered);
+            rightFeedback = Mix(rightFeedback, rightFiltered);
+        }
+
+        /**
+         * @brief Stereo widening and output gain stage.
+         *
+         * @param leftDry
+         * @param rightDry
+         * @param leftWet
+         * @param rightWet
+         * @param leftFeedback
+         * @param rightFeedback
+         * @param leftOut
+         * @param rightOut
+         */
+        void Output(float leftDry, float rightDry, float leftWet, float rightWet, float leftFeedback, float rightFeedback, float &leftOut, float &rightOut)
+        {
+            // Mid-side processing for stereo widening.
+            float mid = (leftWet + rightWet) / fastroot(2, 10);
+            float side = ((leftWet - rightWet) / fastroot(2, 10)) * stereoWidth;
+            float stereoLeft = (mid + side) / fastroot(2, 10);
+            float stereoRight = (mid - side) / fastroot(2, 10);
+
+            // Output gain stage.
+            leftOut = SoftClip(Fader::EqualCrossFade(leftDry, stereoLeft, dryWetMix) * outputGain);
+            rightOut = SoftClip(Fader::EqualCrossFade(rightDry, stereoRight, dryWetMix) * outputGain);
+
+            if (feedbackOnly)
+            {
+                leftOut = SoftClip(leftFeedback);
+                rightOut = SoftClip(rightFeedback);
+            }
+        }
+
+        /**
+         * @brief Updates the loopers' parameters. This is called once per
+         * block, before processing it, to ensure that the parameters are
+         * changed at the right moment.
+         *
+         * @param frames the number of frames in the block
+         * @param preview whether to apply the rates of the block without
+         * advancing the ramps, to find out where the block must be split
+         */
+        void UpdateParameters(size_t frames, bool preview = false)
+        {
+            if (linked_)
+            {
+                UpdateParameters(linkedLooper_, LEFT, frames, preview);
+
+                return;
+            }
+            UpdateParameters(loopers_[LEFT], LEFT, frames, preview);
+            if (!mono_)
+            {
+                UpdateParameters(loopers_[RIGHT], RIGHT, frames, preview);
+            }
+        }
+
+        /**
+         * @brief Updates the parameters of the given looper from those of the
+         * given channel.
+         *
+         * @tparam Looper
+         * @param looper
+         * @param channel
+         * @param frames the number of frames in the block
+         * @param preview
+         */
+        template <typename Looper>
+        void UpdateParameters(Looper &looper, int channel, size_t frames, bool preview)
+        {
+            bool left = LEFT == channel;
+
+            Direction direction = left ? leftDirection : rightDirection;
+            if (direction != looper.GetDirection())
+            {
+                looper.SetDirection(direction);
+            }
+
+            // The rates are slewed once per block, the heads then move at
+            // the average rate of the block.
+            float slewSamples = rateSlew * sampleRate_;
+            Ramp &readRate = readRates_[channel];
+            readRate.SetShape(rateSlewShape);
+            readRate.SetTime(slewSamples);
+            readRate.SetTarget(left ? nextLeftReadRate : nextRightReadRate);
+            if (readRate.IsMoving() || looper.GetReadRate() != readRate.GetValue())
+            {
+                looper.SetReadRate(preview ? Ramp(readRate).Advance(frames) : readRate.Advance(frames));
+            }
+
+            Ramp &writeRate = writeRates_[channel];
+            writeRate.SetShape(rateSlewShape);
+            writeRate.SetTime(slewSamples);
+            writeRate.SetTarget(left ? nextLeftWriteRate : nextRightWriteRate);
+            if (writeRate.IsMoving() || looper.GetWriteRate() != writeRate.GetValue())
+            {
+                looper.SetWriteRate(preview ? Ramp(writeRate).Advance(frames) : writeRate.Advance(frames));
+            }
+
+            int32_t loopLength = left ? nextLeftLoopLength : nextRightLoopLength;
+            if (looper.GetLoopLength() != loopLength)
+            {
+                looper.SetLoopLength(loopLength);
+            }
+
+            int32_t loopStart = left ? nextLeftLoopStart : nextRightLoopStart;
+            if (looper.GetLoopStart() != loopStart)
+            {
+                looper.SetLoopStart(loopStart);
+            }
+
+            float freeze = left ? nextLeftFreeze : nextRightFreeze;
+            if (looper.GetFreeze() != freeze)
+            {
+                looper.SetFreeze(freeze);
+            }
+        }
+    };
+
+    using StereoLooper = BasicStereoLooper<>;
 
 } // namespace wreath
\ No newline at end of file
@@ -0,0 +1,258 @@
+#pragma once
+
+#include "frame.h"
+#include "random.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace wreath
+{
+    /**
+     * The storage policies define how the samples are kept in the buffers.
+     * Each one declares the type of the buffer elements (Sample), the bytes
+     * taken by a sample (kBytes) and the type of the values read and written
+     * by the heads (Value), and converts the samples from and to values in
+     * the reading and writing kernels of the heads.
+     */
+
+    /**
+     * @brief 32-bit float samples, the buffers are read directly.
+     */
+    struct FloatStorage
+    {
+        using Sample = float;
+        using Value = float;
+        static constexpr size_t kBytes{sizeof(float)};
+
+        static inline float Load(const Sample *buffer, int32_t index)
+        {
+            return buffer[index];
+        }
+
+        static inline void Store(Sample *buffer, int32_t index, float value, Random &)
+        {
+            buffer[index] = value;
+        }
+
+        /**
+         * @brief Interpolates the taps starting at the given index.
+         *
+         * @tparam Interpolator
+         * @param buffer
+         * @param first the index of the first tap
+         * @param frac
+         * @return float
+         */
+        template <typename Interpolator>
+        static inline float Interpolate(const Sample *buffer, int32_t first, float frac)
+        {
+            return Interpolator::Interpolate(buffer + first, frac);
+        }
+
+        static inline Sample *At(Sample *buffer, int32_t index)
+        {
+            return buffer + index;
+        }
+    };
+
+    /**
+     * @brief 16-bit integer samples, with TPDF dither on writing. Doubles the
+     * recording time with the same memory.
+     */
+    struct Int16Storage
+    {
+        using Sample = int16_t;
+        using Value = float;
+        static constexpr size_t kBytes{sizeof(int16_t)};
+
+        static inline float Load(const Sample *buffer, int32_t index)
+        {
+            return buffer[index] * (1.f / 32768.f);
+        }
+
+        static inline void Store(Sample *buffer, int32_t index, float value, Random &random)
+        {
+            // Triangular dither of one LSB peak.
+            float dither = random.NextFloat() - random.NextFloat();
+            float scaled = value * 32768.f + dither;
+            scaled = scaled > 32767.f ? 32767.f : (scaled < -32768.f ? -32768.f : scaled);
+            buffer[index] = static_cast<Sample>(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+        }
+
+        template <typename Interpolator>
+        static inline float Interpolate(const Sample *buffer, int32_t first, float frac)
+        {
+            float taps[Interpolator::kTaps];
+            for (int32_t i = 0; i < Interpolator::kTaps; i++)
+            {
+                taps[i] = Load(buffer, first + i);
+            }
+
+            return Interpolator::Interpolate(taps, frac);
+        }
+
+        static inline Sample *At(Sample *buffer, int32_t index)
+        {
+            return buffer + index;
+        }
+    };
+
+    /**
+     * @brief 24-bit integer samples packed in 3 bytes, little endian. Takes
+     * 3/4 of the memory of the floats, with no audible loss.
+     */
+    struct Packed24Storage
+    {
+        using Sample = uint8_t;
+        using Value = float;
+        static constexpr size_t kBytes{3};
+
+        static inline float Load(const Sample *buffer, int32_t index)
+        {
+            const Sample *p = buffer + index * 3;
+            // Sign extend from 24 bits.
+            int32_t value = static_cast<int32_t>(static_cast<uint32_t>(p[0] | (p[1] << 8) | (p[2] << 16)) << 8) >> 8;
+
+            return value * (1.f / 8388608.f);
+        }
+
+        static inline void Store(Sample *buffer, int32_t index, float value, Random &)
+        {
+            // No dither, at 24 bits the quantization noise is inaudible.
+            float scaled = value * 8388608.f;
+            // Clamp after rounding, floats have no room for the half LSB at
+            // full scale.
+            scaled = scaled > 16777215.f ? 16777215.f : (scaled < -16777215.f ? -16777215.f : scaled);
+            int32_t quantized = static_cast<int32_t>(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+            quantized = quantized > 8388607 ? 8388607 : (quantized < -8388608 ? -8388608 : quantized);
+            Sample *p = buffer + index * 3;
+            p[0] = quantized & 0xff;
+            p[1] = (quantized >> 8) & 0xff;
+            p[2] = (quantized >> 16) & 0xff;
+        }
+
+        template <typename Interpolator>
+        static inline float Interpolate(const Sample *buffer, int32_t first, float frac)
+        {
+            float taps[Interpolator::kTaps];
+            for (int32_t i = 0; i < Interpolator::kTaps; i++)
+            {
+                taps[i] = Load(buffer, first + i);
+            }
+
+            return Interpolator::Interpolate(taps, frac);
+        }
+
+        static inline Sample *At(Sample *buffer, int32_t index)
+        {
+            return buffer + index * 3;
+        }
+    };
+
+    /**
+     * @brief Frames of the given number of channels, with their samples side
+     * by side in the given storage. The heads of a linked looper read and
+     * write all the channels at once, and the taps of each interpolated
+     * frame come from the same cache lines. A position of the buffer is a
+     * frame, so the byte-wise helpers (clearing, snapshots, bursts) handle
+     * all the channels together.
+     *
+     * @tparam Storage the storage of each sample
+     * @tparam kChannels
+     */
+    template <typename Storage = FloatStorage, int32_t kChannels = 2>
+    struct InterleavedStorage
+    {
+        using Sample = typename Storage::Sample;
+        using Value = Frame<kChannels>;
+        static constexpr size_t kBytes{Storage::kBytes * kChannels};
+
+        static inline Value Load(const Sample *buffer, int32_t index)
+        {
+            Value frame;
+            for (int32_t channel = 0; channel < kChannels; channel++)
+            {
+                frame[channel] = Storage::Load(buffer, index * kChannels + channel);
+            }
+
+            return frame;
+        }
+
+        static inline void Store(Sample *buffer, int32_t index, const Value &value, Random &random)
+        {
+            for (int32_t channel = 0; channel < kChannels; channel++)
+            {
+                Storage::Store(buffer, index * kChannels + channel, value[channel], random);
+            }
+        }
+
+        template <typename Interpolator>
+        static inline Value Interpolate(const Sample *buffer, int32_t first, float frac)
+        {
+            Value taps[Interpolator::kTaps];
+            for (int32_t i = 0; i < Interpolator::kTaps; i++)
+            {
+                taps[i] = Load(buffer, first + i);
+            }
+
+            return Interpolator::Interpolate(taps, frac);
+        }
+
+        static inline Sample *At(Sample *buffer, int32_t index)
+        {
+            return Storage::At(buffer, index * kChannels);
+        }
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <typename Storage, int32_t kChannels>
+    constexpr size_t InterleavedStorage<Storage, kChannels>::kBytes;
+
+    /**
+     * @brief A buffer carved out of a block of memory: its first sample and
+     * its length in values of the given storage, frames for the interleaved
+     * ones. The loopers take their buffers as spans, so they don't know how
+     * the memory has been partitioned among them.
+     *
+     * @tparam Storage
+     */
+    template <typename Storage = FloatStorage>
+    struct BufferSpan
+    {
+        using Sample = typename Storage::Sample;
+
+        Sample *data{};
+        int32_t length{};
+
+        /**
+         * @brief Returns the span of the given bytes of memory, a trailing
+         * partial value is left out.
+         *
+         * @param memory
+         * @param bytes
+         * @return BufferSpan
+         */
+        static BufferSpan FromBytes(void *memory, size_t bytes)
+        {
+            return BufferSpan{static_cast<Sample *>(memory), static_cast<int32_t>(bytes / Storage::kBytes)};
+        }
+
+        /**
+         * @brief Returns the given part of the span, split in equal parts.
+         *
+         * @param part
+         * @param parts
+         * @return BufferSpan
+         */
+        BufferSpan Part(int32_t part, int32_t parts) const
+        {
+            int32_t partLength = length / parts;
+
+            return BufferSpan{Storage::At(data, part * partLength), partLength};
+        }
+
+        inline size_t GetBytes() const { return length * Storage::kBytes; }
+        inline bool IsEmpty() const { return !length; }
+    };
+} // namespace wreath
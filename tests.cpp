@@ -1,10 +1,30 @@
 #include "head.h"
 #include "looper.h"
+#include "ramp.h"
+#include "command_queue.h"
+#include "triple_buffer.h"
+#include "write_behind.h"
+#include "voice_bank.h"
+#include "thread_pool.h"
+#include "arena.h"
+#include "stereo_looper.h"
+#include "host_dsp.h"
+#include "host_svf.h"
+#include "Utility/dsp.h"
+#if defined(__unix__) || defined(__APPLE__)
+#include "mapped_buffer.h"
+#include "looper_engine.h"
+#include <cstdio>
+#endif
 #include <ctime>
 #include <cstdlib>
 #include <iostream>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <chrono>
 
 using namespace wreath;
 
@@ -443,6 +463,1582 @@ void TestHeadsDistance()
     }
 }
 
+void TestHeadsDistanceTracking()
+{
+    // The distance follows the heads between the horizons, where the one
+    // used for the cross point is updated.
+    static float tape[48000];
+    static float frozen[48000];
+    static Looper tracked{};
+    tracked.Init(48000, tape, frozen, 48000);
+    for (int32_t i = 0; i < 48000; i++)
+    {
+        tracked.Buffer(Sine(1.f / 500, i));
+    }
+    tracked.StopBuffering();
+    tracked.StartReading(true);
+    tracked.SetReadRate(0.5f);
+
+    float block[48];
+    float distances[2]{};
+    for (int32_t i = 0; i < 2; i++)
+    {
+        for (int32_t j = 0; j < 10; j++)
+        {
+            tracked.ReadBlock(block, 48);
+            tracked.WriteBlock(block, 48);
+        }
+        distances[i] = tracked.GetHeadsDistance();
+    }
+    float moved = std::fabs(distances[1] - distances[0]);
+
+    std::cout << "Heads distance moved: " << moved << " (expected 240)\n\n";
+    assert(std::fabs(moved - 240.f) < 2.f);
+}
+
+void TestReadBlock()
+{
+    struct Scenario
+    {
+        std::string desc{};
+        float loopStart{};
+        float loopLength{};
+        float rate{};
+        Direction direction{};
+        int32_t headBufferSamples{bufferSamples};
+    };
+
+    static Scenario scenarios[] =
+    {
+        { "1 - Regular, 1x speed, forward", 1000, 20000, 1.f, FORWARD },
+        { "2 - Regular, 1.37x speed, backwards", 1000, 20000, 1.37f, BACKWARDS },
+        { "3 - Inverted, 0.63x speed, forward", 40000, 10000, 0.63f, FORWARD },
+        { "4 - Inverted, 2.1x speed, backwards", 40000, 10000, 2.1f, BACKWARDS },
+        { "5 - Power of two buffer, 1.37x speed, forward", 0, 32768, 1.37f, FORWARD, 32768 },
+        { "6 - Power of two buffer, 0.71x speed, backwards", 0, 32768, 0.71f, BACKWARDS, 32768 },
+    };
+
+    for (size_t i = 0; i < bufferSamples; i++)
+    {
+        buffer[i] = Sine(1.f / bufferSamples, i);
+    }
+
+    std::cout << "\n";
+
+    for (Scenario scenario : scenarios)
+    {
+        Head heads[2]{{Type::READ}, {Type::READ}};
+        for (Head &head : heads)
+        {
+            head.Init(buffer, bufferSamples);
+            head.InitBuffer(scenario.headBufferSamples);
+            head.SetActive(true);
+            head.SetLooping(true);
+            head.SetRate(scenario.rate);
+            head.SetDirection(scenario.direction);
+            head.SetLoopStartAndLength(scenario.loopStart, scenario.loopLength);
+            head.ResetPosition();
+        }
+
+        std::cout << "Scenario " << scenario.desc << "\n";
+
+        int32_t mismatches{};
+        float block[48];
+        for (int32_t i = 0; i < bufferSamples; i += 48)
+        {
+            size_t done{};
+            while (done < 48)
+            {
+                Head::Action action;
+                done += heads[1].ReadBlock(block + done, 48 - done, action);
+                if (Head::Action::LOOP == action)
+                {
+                    heads[1].ResetPosition();
+                }
+            }
+            for (size_t j = 0; j < 48; j++)
+            {
+                float value = heads[0].Read();
+                if (Head::Action::LOOP == heads[0].UpdatePosition())
+                {
+                    heads[0].ResetPosition();
+                }
+                mismatches += value != block[j];
+            }
+        }
+        std::cout << "Mismatches: " << mismatches << " (expected 0)\n\n";
+        assert(mismatches == 0);
+    }
+}
+
+void TestDegradationGate()
+{
+    // The gate run over a block follows the positions the head takes, as
+    // if it was run for each sample.
+    Head heads[2]{{Type::WRITE}, {Type::WRITE}};
+    for (Head &head : heads)
+    {
+        head.Init(buffer, bufferSamples);
+        head.InitBuffer(bufferSamples);
+        head.SetActive(true);
+        head.SetLooping(true);
+        head.SetRate(1.37f);
+        head.SetLoopStartAndLength(0, bufferSamples);
+        head.ResetPosition();
+    }
+
+    int32_t mismatches{};
+    int32_t changes{};
+    bool onsets[48];
+    for (int32_t i = 0; i < 2 * bufferSamples; i += 48)
+    {
+        heads[1].BresenhamEuclidean(20.f, 0.4f, heads[1].GetPhase(), onsets, 48);
+        for (size_t j = 0; j < 48; j++)
+        {
+            mismatches += heads[0].BresenhamEuclidean(20.f, 0.4f) != onsets[j];
+            changes += j > 0 && onsets[j] != onsets[j - 1];
+            heads[0].UpdatePosition();
+            heads[1].UpdatePosition();
+        }
+    }
+
+    std::cout << "Gate mismatches: " << mismatches << " (expected 0)\n";
+    std::cout << "Gate changes within the blocks: " << changes << " (expected > 0)\n\n";
+    assert(mismatches == 0);
+    assert(changes > 0);
+}
+
+void TestPhase()
+{
+    // Near the end of an 80 seconds buffer a float keeps only a quarter of
+    // sample, while a phase steps exactly.
+    float position = 3839000.f;
+    float rate = 1.f / 1024;
+    Phase phase = Phase::FromFloat(position);
+    Phase step = Phase::FromFloat(rate);
+    float floatPosition = position;
+    for (int32_t i = 0; i < 1024; i++)
+    {
+        phase += step;
+        floatPosition += rate;
+    }
+
+    std::cout << "\nPhase position: " << phase.ToFloat() << " (expected " << position + 1 << ")\n";
+    std::cout << "Float position: " << floatPosition << "\n\n";
+    assert(phase == Phase::FromInt(position + 1));
+    assert(phase.Int() == position + 1 && phase.FracBits() == 0);
+}
+
+void TestRandom()
+{
+    // The same seed yields the same sequence, whether the values are drawn
+    // one by one or a block at a time.
+    Random a{};
+    Random b{};
+    a.Seed(1234);
+    b.Seed(1234);
+    float block[64];
+    b.Fill(block, 64);
+    int32_t mismatches{};
+    for (size_t i = 0; i < 64; i++)
+    {
+        float value = a.NextFloat();
+        mismatches += value != block[i];
+        assert(value >= 0.f && value < 1.f);
+    }
+
+    std::cout << "Random mismatches: " << mismatches << " (expected 0)\n\n";
+    assert(mismatches == 0);
+}
+
+void TestClearBuffer()
+{
+    for (size_t i = 0; i < bufferSamples; i++)
+    {
+        buffer[i] = Sine(1.f / bufferSamples, i);
+    }
+
+    BufferClearer clearer{};
+    clearer.Init(buffer, bufferSamples);
+    Head heads[2]{{Type::READ}, {Type::WRITE}};
+    for (Head &head : heads)
+    {
+        head.Init(buffer, bufferSamples);
+        head.InitBuffer(bufferSamples);
+        head.SetActive(true);
+        head.SetLooping(true);
+        head.SetClearer(&clearer);
+    }
+    heads[0].SetIndex(1000.5f);
+    heads[1].SetIndex(30000.f);
+
+    clearer.Start();
+
+    // Nothing has been cleared yet, but the buffer already reads as silence.
+    float before = heads[0].Read();
+    // The write clears its chunk first.
+    heads[1].Write(0.7f);
+
+    int32_t sweeps{};
+    while (clearer.IsActive())
+    {
+        clearer.Sweep(64 * 256);
+        sweeps++;
+    }
+
+    int32_t leftovers{};
+    for (size_t i = 0; i < bufferSamples; i++)
+    {
+        leftovers += i != 30000 && buffer[i] != 0.f;
+    }
+
+    std::cout << "Read while clearing: " << before << " (expected 0)\n";
+    std::cout << "Written while clearing: " << buffer[30000] << " (expected 0.7)\n";
+    std::cout << "Not cleared: " << leftovers << " (expected 0) after " << sweeps << " sweeps\n\n";
+    assert(before == 0.f);
+    assert(buffer[30000] == 0.7f);
+    assert(leftovers == 0);
+}
+
+void TestFreezeSnapshot()
+{
+    for (size_t i = 0; i < bufferSamples; i++)
+    {
+        buffer[i] = Sine(1.f / bufferSamples, i);
+    }
+
+    // Snapshot an inverted loop, crossing the end of the buffer.
+    int32_t start{40000};
+    int32_t length{20000};
+    FreezeSnapshot snapshot{};
+    snapshot.Init(buffer, buffer2, length, nullptr);
+    snapshot.Start(start, length, bufferSamples, 45000, true);
+
+    // Overwrite the main buffer, copying the chunks first.
+    for (int32_t i = 0; i < 3000; i++)
+    {
+        snapshot.Touch(i);
+        buffer[i] = 0.f;
+    }
+
+    // The frozen loop stays the same while it's being copied, and once
+    // done it's read entirely from the freeze buffer.
+    int32_t mismatches{};
+    int32_t pending{};
+    for (int32_t sweep = 0; sweep <= 4; sweep++)
+    {
+        pending = 0;
+        for (int32_t i = 0; i < length; i++)
+        {
+            int32_t index = (start + i) % bufferSamples;
+            int32_t offset = snapshot.Find(index);
+            mismatches += (offset >= 0 ? snapshot.Load(offset) : buffer[index]) != Sine(1.f / bufferSamples, index);
+            pending += offset < 0;
+        }
+        snapshot.Sweep(64 * 512);
+    }
+
+    std::cout << "Snapshot mismatches: " << mismatches << " (expected 0)\n";
+    std::cout << "Snapshot pending: " << pending << " (expected 0)\n\n";
+    assert(mismatches == 0);
+    assert(pending == 0);
+}
+
+void TestFader()
+{
+    // The tables follow the curves they sample.
+    float maxError{};
+    for (int32_t i = 0; i <= 1000; i++)
+    {
+        float pos = i / 1000.f;
+        maxError = std::max(maxError, std::fabs(Fader::CrossFade<FadeCurve::EQUAL_POWER>(1.f, 0.f, pos) - static_cast<float>(std::cos(pos * pi() / 2))));
+        maxError = std::max(maxError, std::fabs(Fader::CrossFade<FadeCurve::LINEAR>(0.f, 1.f, pos) - pos));
+        maxError = std::max(maxError, std::fabs(Fader::CrossFade<FadeCurve::S_CURVE>(0.f, 1.f, pos) - static_cast<float>(0.5 - 0.5 * std::cos(pos * pi()))));
+    }
+
+    // Processing a block is the same as processing its samples one by one.
+    Fader single{};
+    Fader block{};
+    single.Init(Fader::FadeType::FADE_OUT_IN, 100.f, 1.5f);
+    block.Init(Fader::FadeType::FADE_OUT_IN, 100.f, 1.5f);
+    float from[128];
+    float to[128];
+    float out[128];
+    for (int32_t i = 0; i < 128; i++)
+    {
+        from[i] = Sine(1.f / 128, i);
+        to[i] = Sine(3.f / 128, i);
+    }
+    size_t faded = block.ProcessBlock(from, to, out, 128);
+    size_t count{};
+    float blockError{};
+    while (single.IsActive())
+    {
+        single.Process(from[count], to[count]);
+        blockError = std::max(blockError, std::fabs(single.GetOutput() - out[count]));
+        count++;
+    }
+
+    std::cout << "Fade tables max error: " << maxError << " (expected < 1e-5)\n";
+    std::cout << "Fade block samples: " << faded << " (expected " << count << ")\n";
+    std::cout << "Fade block max error: " << blockError << " (expected < 1e-5)\n\n";
+    assert(maxError < 1e-5f);
+    assert(faded == count);
+    assert(blockError < 1e-5f);
+}
+
+void TestRamp()
+{
+    // A block covers the same distance as the one-pole stepped sample by
+    // sample, and as the linear ramp.
+    float maxError{};
+    for (size_t block : {1, 7, 64})
+    {
+        Ramp exponential{};
+        Ramp linear{};
+        exponential.Reset(1.f);
+        linear.Reset(1.f);
+        linear.SetShape(Ramp::Shape::LINEAR);
+        exponential.SetTime(480.f);
+        linear.SetTime(480.f);
+        exponential.SetTarget(-2.f);
+        linear.SetTarget(-2.f);
+        float value{1.f};
+        float distance{};
+        float linearDistance{};
+        float blockDistance{};
+        float linearBlockDistance{};
+        for (size_t i = 0; i < 64 * 20; i++)
+        {
+            value += (-2.f - value) / 480.f;
+            distance += value;
+            linearDistance += std::max(1.f - 3.f * (i + 1) / 480.f, -2.f);
+            if ((i + 1) % block == 0)
+            {
+                blockDistance += exponential.Advance(block) * block;
+                linearBlockDistance += linear.Advance(block) * block;
+                maxError = std::max(maxError, std::fabs(blockDistance - distance));
+                maxError = std::max(maxError, std::fabs(linearBlockDistance - linearDistance));
+            }
+        }
+    }
+
+    std::cout << "Ramp max distance error: " << maxError << " (expected < 0.05)\n\n";
+    assert(maxError < 0.05f);
+}
+
+void TestCommandQueue()
+{
+    CommandQueue<uint32_t, 64> queue{};
+
+    // A full queue refuses the items instead of overwriting them.
+    uint32_t pushed{};
+    while (queue.Push(pushed))
+    {
+        pushed++;
+    }
+    uint32_t item{};
+    bool ordered{true};
+    for (uint32_t i = 0; queue.Pop(item); i++)
+    {
+        ordered &= item == i;
+    }
+
+    // A producer and a consumer running concurrently, nothing is lost nor
+    // reordered.
+    constexpr uint32_t count{1000000};
+    std::thread producer([&queue]() {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            while (!queue.Push(i))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected{};
+    uint32_t mismatches{};
+    while (expected < count)
+    {
+        if (queue.Pop(item))
+        {
+            mismatches += item != expected;
+            expected++;
+        }
+    }
+    producer.join();
+
+    std::cout << "Queue capacity: " << pushed << " (expected 64)\n";
+    std::cout << "Queue mismatches: " << mismatches << " (expected 0)\n\n";
+    assert(64 == pushed);
+    assert(ordered);
+    assert(0 == mismatches);
+    assert(queue.IsEmpty());
+}
+
+void TestTripleBuffer()
+{
+    struct State
+    {
+        uint32_t version;
+        float values[15];
+    };
+    TripleBuffer<State> buffer{};
+
+    // The reader never sees a half written state, and the versions it sees
+    // only go forward.
+    constexpr uint32_t count{200000};
+    std::thread writer([&buffer]() {
+        for (uint32_t version = 1; version <= count; version++)
+        {
+            State &state = buffer.Back();
+            state.version = version;
+            for (float &value : state.values)
+            {
+                value = static_cast<float>(version);
+            }
+            buffer.Publish();
+        }
+    });
+    uint32_t torn{};
+    uint32_t backwards{};
+    uint32_t fetched{};
+    uint32_t last{};
+    while (last < count)
+    {
+        if (!buffer.Fetch())
+        {
+            continue;
+        }
+        const State &state = buffer.Front();
+        for (float value : state.values)
+        {
+            torn += value != static_cast<float>(state.version);
+        }
+        backwards += state.version <= last;
+        last = state.version;
+        fetched++;
+    }
+    writer.join();
+
+    std::cout << "Triple buffer fetches: " << fetched << "\n";
+    std::cout << "Triple buffer torn reads: " << torn << " (expected 0)\n";
+    std::cout << "Triple buffer stale reads: " << backwards << " (expected 0)\n\n";
+    assert(0 == torn);
+    assert(0 == backwards);
+    assert(!buffer.Fetch());
+}
+
+void TestLoopCache()
+{
+    // The cache reads as the buffer, while the window moves and the buffer
+    // is written.
+    static float samples[8192];
+    for (int32_t i = 0; i < 8192; i++)
+    {
+        samples[i] = Sine(1.f / 300, i);
+    }
+    BasicLoopCache<HermiteInterpolator> cache{};
+    cache.Init(samples);
+    float maxError{};
+    int32_t start{1000};
+    for (int32_t move = 0; move < 200; move++)
+    {
+        start += move % 2 ? 37 : -11;
+        int32_t end = start + 1721;
+        cache.Follow(start, end);
+        samples[start + move] = -samples[start + move];
+        cache.Update(start + move);
+        for (int32_t i = start + 1; i < end - 2; i += 7)
+        {
+            maxError = std::max(maxError, std::fabs(cache.Load(i) - samples[i]));
+            maxError = std::max(maxError, std::fabs(cache.Interpolate(i - 1, 0.3f) - HermiteInterpolator::Interpolate(samples + i - 1, 0.3f)));
+        }
+    }
+
+    std::cout << "Loop cache max error: " << maxError << " (expected 0)\n\n";
+    assert(cache.Covers(start, start + 1721));
+    assert(!cache.Contains(start + 1722));
+    assert(0.f == maxError);
+}
+
+void TestReadAhead()
+{
+    // The reads staged in the read-ahead ring match the direct ones, in both
+    // directions and across the loop boundaries, whatever the build.
+    using StagedHead = BasicHead<SincInterpolator<>, Packed24Storage, true>;
+    using DirectHead = BasicHead<SincInterpolator<>, Packed24Storage, false>;
+    constexpr int32_t samples = 1 << 22;
+    static std::vector<uint8_t> tape(samples * Packed24Storage::kBytes);
+    Random dither{};
+    for (int32_t i = 0; i < samples; i++)
+    {
+        Packed24Storage::Store(tape.data(), i, Sine(1.f / 1000, i) * 0.9f, dither);
+    }
+
+    auto setUp = [](auto &head, float rate, Direction direction, float loopStart, float loopLength)
+    {
+        head.Init(tape.data(), samples);
+        head.InitBuffer(samples);
+        head.SetActive(true);
+        head.SetLooping(true);
+        head.SetRate(rate);
+        head.SetDirection(direction);
+        head.SetLoopStartAndLength(loopStart, loopLength);
+        head.ResetPosition();
+    };
+
+    auto readBlocks = [](auto &head, float *out, int32_t size)
+    {
+        using Action = typename std::decay<decltype(head)>::type::Action;
+        for (int32_t i = 0; i < size; i += 48)
+        {
+            size_t done{};
+            while (done < 48)
+            {
+                Action action;
+                done += head.ReadBlock(out + i + done, 48 - done, action);
+                if (Action::LOOP == action)
+                {
+                    head.ResetPosition();
+                }
+            }
+        }
+    };
+
+    static float block[48000];
+    int32_t mismatches{};
+    for (float rate : {2.3f, 3.7f, 7.9f})
+    {
+        for (Direction direction : {FORWARD, BACKWARDS})
+        {
+            StagedHead staged{Type::READ};
+            DirectHead direct{Type::READ};
+            setUp(staged, rate, direction, 50000, 30000);
+            setUp(direct, rate, direction, 50000, 30000);
+            readBlocks(staged, block, 48000);
+            for (int32_t i = 0; i < 48000; i++)
+            {
+                mismatches += direct.Read() != block[i];
+                if (DirectHead::Action::LOOP == direct.UpdatePosition())
+                {
+                    direct.ResetPosition();
+                }
+            }
+        }
+    }
+
+    // The same spans read with and without staging, over a tape larger than
+    // the caches. This times them, the cache misses themselves can't be
+    // counted here.
+    auto benchmark = [&](auto &head, float rate)
+    {
+        setUp(head, rate, BACKWARDS, 0, samples);
+        auto start = std::chrono::steady_clock::now();
+        for (int32_t i = 0; i < 20; i++)
+        {
+            readBlocks(head, block, 48000);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+        return elapsed.count() / (20 * 48000);
+    };
+    std::cout << "Read-ahead mismatches: " << mismatches << " (expected 0)\n";
+    for (float rate : {2.3f, 7.9f})
+    {
+        StagedHead staged{Type::READ};
+        DirectHead direct{Type::READ};
+        double stagedCost = benchmark(staged, rate);
+        double directCost = benchmark(direct, rate);
+        std::cout << "Read-ahead cost at " << rate << "x: " << stagedCost << " ns/sample staged, " << directCost << " ns/sample direct\n";
+    }
+    std::cout << "\n";
+    assert(mismatches == 0);
+}
+
+void TestWriteBehind()
+{
+    // The runs stored in bursts leave the buffer as the direct stores do,
+    // whichever way and at whatever rate the writes move.
+    static uint8_t burst[4096 * 3];
+    static uint8_t direct[4096 * 3];
+    BasicWriteBehind<Packed24Storage> writeBehind{};
+    writeBehind.Init(burst);
+    Random dither{};
+    static float in[3000];
+    for (int32_t i = 0; i < 3000; i++)
+    {
+        in[i] = Sine(1.f / 100, i) * 0.9f;
+    }
+    int32_t mismatches{};
+    for (float rate : {1.f, 0.37f, -0.61f, -1.f, 0.f})
+    {
+        int64_t step = Phase::FromFloat(rate).Raw();
+        int64_t index = Phase::FromFloat(rate < 0 ? 3500.3f : 500.3f).Raw();
+        for (int32_t i = 0; i < 3000; i++)
+        {
+            Packed24Storage::Store(direct, (index + step * i) >> Phase::kFracBits, in[i], dither);
+        }
+        size_t done{};
+        while (done < 3000)
+        {
+            done += writeBehind.Gather(in + done, 3000 - done, index, step, dither);
+            mismatches += writeBehind.GetHi() - writeBehind.GetLo() >= kWriteBehindSamples;
+            writeBehind.Flush();
+        }
+        mismatches += std::memcmp(burst, direct, sizeof(burst)) != 0;
+    }
+
+    // The heads' block writing, coalescing the slow heads' runs when built
+    // with kWriteBehind, leaves the buffer as the per-sample writing does.
+    for (float rate : {1.f, 0.7f})
+    {
+        for (Direction direction : {FORWARD, BACKWARDS})
+        {
+            static float buffers[2][20000];
+            Head heads[2]{{Type::WRITE}, {Type::WRITE}};
+            for (int32_t h = 0; h < 2; h++)
+            {
+                std::fill(buffers[h], buffers[h] + 20000, 0.f);
+                heads[h].Init(buffers[h], 20000);
+                heads[h].InitBuffer(20000);
+                heads[h].SetActive(true);
+                heads[h].SetLooping(true);
+                heads[h].SetRate(rate);
+                heads[h].SetDirection(direction);
+                heads[h].SetLoopStartAndLength(3000, 10000);
+                heads[h].ResetPosition();
+            }
+            float block[48];
+            for (int32_t i = 0; i < 20000; i += 48)
+            {
+                for (int32_t j = 0; j < 48; j++)
+                {
+                    block[j] = Sine(1.f / 300, i + j);
+                    heads[0].Write(block[j]);
+                    if (Head::Action::LOOP == heads[0].UpdatePosition())
+                    {
+                        heads[0].ResetPosition();
+                    }
+                }
+                size_t done{};
+                while (done < 48)
+                {
+                    Head::Action action;
+                    done += heads[1].WriteBlock(block + done, 48 - done, action);
+                    if (Head::Action::LOOP == action)
+                    {
+                        heads[1].ResetPosition();
+                    }
+                }
+            }
+            mismatches += std::memcmp(buffers[0], buffers[1], sizeof(buffers[0])) != 0;
+        }
+    }
+
+    std::cout << "Write-behind mismatches: " << mismatches << " (expected 0)\n\n";
+    assert(mismatches == 0);
+}
+
+void TestLinkedLooper()
+{
+    // The linked looper moves its frames as two loopers with the same
+    // settings move their samples, fades and degradation-free feedback
+    // included.
+    using LinkedLooper = BasicLooper<HermiteInterpolator, InterleavedStorage<>>;
+    using MonoLooper = BasicLooper<HermiteInterpolator>;
+    static float frames[2 * 20000];
+    static float frozenFrames[2 * 20000];
+    static float channels[2][20000];
+    static float frozenChannels[2][20000];
+    static LinkedLooper linked{};
+    static MonoLooper mono[2]{};
+    linked.Init(48000, frames, frozenFrames, 20000);
+    for (int32_t channel = 0; channel < 2; channel++)
+    {
+        mono[channel].Init(48000, channels[channel], frozenChannels[channel], 20000);
+    }
+    for (int32_t i = 0; i < 20000; i++)
+    {
+        float left = Sine(1.f / 500, i);
+        float right = Sine(1.f / 130, i) * 0.5f;
+        linked.Buffer(StereoFrame{{left, right}});
+        mono[0].Buffer(left);
+        mono[1].Buffer(right);
+    }
+
+    auto apply = [&](auto f) {
+        f(linked);
+        f(mono[0]);
+        f(mono[1]);
+    };
+    apply([](auto &looper) { looper.StopBuffering(); });
+    apply([](auto &looper) { looper.StartReading(true); });
+
+    int32_t mismatches{};
+    StereoFrame linkedBlock[48];
+    float monoBlock[2][48];
+    for (int32_t block = 0; block < 1000; block++)
+    {
+        if (200 == block)
+        {
+            apply([](auto &looper) {
+                looper.SetReadRate(1.37f);
+                looper.SetLoopStart(3000);
+                looper.SetLoopLength(5000);
+            });
+        }
+        else if (500 == block)
+        {
+            apply([](auto &looper) {
+                looper.SetDirection(BACKWARDS);
+                looper.SetWriteRate(0.7f);
+                looper.SetFreeze(0.5f);
+            });
+        }
+        linked.ReadBlock(linkedBlock, 48);
+        mono[0].ReadBlock(monoBlock[0], 48);
+        mono[1].ReadBlock(monoBlock[1], 48);
+        for (int32_t i = 0; i < 48; i++)
+        {
+            for (int32_t channel = 0; channel < 2; channel++)
+            {
+                mismatches += linkedBlock[i][channel] != monoBlock[channel][i];
+                monoBlock[channel][i] = monoBlock[channel][i] * 0.5f + Sine(1.f / 300, block * 48 + i) * 0.3f;
+            }
+            linkedBlock[i] = StereoFrame{{monoBlock[0][i], monoBlock[1][i]}};
+        }
+        linked.WriteBlock(linkedBlock, 48);
+        mono[0].WriteBlock(monoBlock[0], 48);
+        mono[1].WriteBlock(monoBlock[1], 48);
+    }
+
+    std::cout << "Linked mismatches: " << mismatches << " (expected 0)\n\n";
+    assert(mismatches == 0);
+}
+
+void TestVoiceBank()
+{
+    // The voices play their loops as a plain reader does, wrapping the taps
+    // around the loop, at any rate and in both directions.
+    static float tape[10000];
+    for (int32_t i = 0; i < 10000; i++)
+    {
+        tape[i] = Sine(1.f / 700, i);
+    }
+    int32_t mismatches{};
+    for (float rate : {1.f, 1.4983f, -0.7491f, 2.f})
+    {
+        VoiceBank bank{};
+        bank.Init(tape);
+        bank.SetAttack(1);
+        bank.NoteOn(60, rate, 1.f, 2000, 3001);
+        static float out[10000];
+        std::fill(out, out + 10000, 0.f);
+        bank.Process(out, 10000);
+        int64_t start = Phase::FromInt(2000).Raw();
+        int64_t end = Phase::FromInt(5001).Raw();
+        int64_t phase = rate < 0 ? end - 1 : start;
+        for (int32_t i = 0; i < 10000; i++)
+        {
+            float taps[2];
+            for (int32_t tap = 0; tap < 2; tap++)
+            {
+                int32_t index = Phase::FromRaw(phase).Int() + tap;
+                taps[tap] = tape[index >= 5001 ? index - 3001 : index];
+            }
+            mismatches += out[i] != LinearInterpolator::Interpolate(taps, Phase::FromRaw(phase).Frac());
+            phase += Phase::FromFloat(rate).Raw();
+            phase = phase >= end ? phase - (end - start) : phase < start ? phase + (end - start) : phase;
+        }
+    }
+
+    // With all the voices busy, the oldest one is stolen.
+    VoiceBank bank{};
+    bank.Init(tape);
+    for (int32_t note = 0; note <= kVoices; note++)
+    {
+        bank.NoteOn(note, 1.f, 1.f, 0, 10000);
+    }
+    bool oldestStolen = !bank.IsPlaying(0) && bank.IsPlaying(kVoices) && kVoices == bank.GetActiveVoices();
+
+    // A released voice is stolen before the oldest one.
+    bank.NoteOff(3);
+    bank.NoteOn(100, 1.f, 1.f, 0, 10000);
+    bool releasedStolen = !bank.IsPlaying(3) && bank.IsPlaying(1) && bank.IsPlaying(100);
+
+    // The released voices are freed once silent.
+    for (int32_t note = 0; note <= 100; note++)
+    {
+        bank.NoteOff(note);
+    }
+    static float out[static_cast<int32_t>(kVoiceReleaseSamples) + 16];
+    bank.Process(out, static_cast<int32_t>(kVoiceReleaseSamples) + 16);
+    int32_t active = bank.GetActiveVoices();
+
+    // A zero velocity releases the note instead of starting a silent voice.
+    bank.NoteOn(20, 1.f, 1.f, 0, 10000);
+    bool silentStarted = bank.NoteOn(20, 1.f, 0.f, 0, 10000) >= 0 || bank.NoteOn(21, 1.f, 0.f, 0, 10000) >= 0;
+    bank.Process(out, static_cast<int32_t>(kVoiceReleaseSamples) + 16);
+    silentStarted |= bank.IsActive();
+
+    // A sounding voice that is stolen fades out before playing the new note,
+    // rather than jumping to silence.
+    static float flat[1000];
+    std::fill(flat, flat + 1000, 1.f);
+    BasicVoiceBank<LinearInterpolator, FloatStorage, 1> single{};
+    single.Init(flat);
+    single.NoteOn(1, 1.f, 1.f, 0, 1000);
+    float steal[400]{};
+    single.Process(steal, 200);
+    single.NoteOn(2, 1.f, 1.f, 0, 1000);
+    single.Process(steal + 200, 200);
+    float maxJump{};
+    for (int32_t i = 1; i < 400; i++)
+    {
+        maxJump = std::max(maxJump, std::fabs(steal[i] - steal[i - 1]));
+    }
+    bool stolenPlays = single.IsPlaying(2) && steal[399] == 1.f;
+
+    std::cout << "Voice mismatches: " << mismatches << " (expected 0)\n";
+    std::cout << "Voices stolen: " << oldestStolen << " " << releasedStolen << " (expected 1 1)\n";
+    std::cout << "Voices active after release: " << active << " (expected 0)\n";
+    std::cout << "Silent voices started: " << silentStarted << " (expected 0)\n";
+    std::cout << "Stolen voice largest step: " << maxJump << " (expected <= " << 1.f / kVoiceStealSamples << "), playing: " << stolenPlays << " (expected 1)\n\n";
+    assert(mismatches == 0);
+    assert(oldestStolen && releasedStolen);
+    assert(active == 0);
+    assert(!silentStarted);
+    assert(maxJump <= 1.f / kVoiceStealSamples + 1e-6f && stolenPlays);
+}
+
+/**
+ * @brief Feeds a sine to each channel of the given looper, each one at its
+ * own frequency.
+ */
+void StereoInput(uint32_t frame, float &left, float &right)
+{
+    left = Sine(1.f / 500, frame);
+    right = 0.7f * Sine(1.f / 730, frame);
+}
+
+/**
+ * @brief Runs the given looper on blocks of the stereo input, fetching its
+ * view after each one.
+ *
+ * @param stereo
+ * @param blocks
+ * @param left where to copy the left output, if given
+ * @param right where to copy the right output, if given
+ */
+void RunStereoLooper(StereoLooper &stereo, size_t blocks, float *left = nullptr, float *right = nullptr)
+{
+    float in[2][48];
+    float out[2][48];
+    for (size_t block = 0; block < blocks; block++)
+    {
+        uint32_t frame = stereo.GetTelemetry().frame;
+        for (size_t i = 0; i < 48; i++)
+        {
+            StereoInput(frame + i, in[0][i], in[1][i]);
+        }
+        stereo.ProcessBlock(in[0], in[1], out[0], out[1], 48);
+        stereo.ReadTelemetry();
+        if (left && right)
+        {
+            std::copy(out[0], out[0] + 48, left + block * 48);
+            std::copy(out[1], out[1] + 48, right + block * 48);
+        }
+    }
+}
+
+/**
+ * @brief Inits the given looper on the given memory and runs it until it's
+ * buffering.
+ */
+void StartUpStereoLooper(StereoLooper &stereo, StereoLooper::Conf conf, uint8_t *memory, size_t bytes)
+{
+    stereo.Init(48000, conf, memory, bytes);
+    while (!stereo.IsBuffering())
+    {
+        RunStereoLooper(stereo, 1);
+    }
+}
+
+void TestStereoLooperStates()
+{
+    // The looper is silent for about a second, then passes the input through
+    // while buffering until it's full or told to stop, and waits to be
+    // started.
+    static uint8_t memory[4 * 48000 * sizeof(float)];
+    static StereoLooper stereo{};
+    stereo.Init(48000, StereoLooper::Conf{StereoLooper::Mode::DUAL, Movement::NORMAL, Direction::FORWARD, 1.f}, memory, sizeof(memory));
+    int32_t startupBlocks{};
+    float startupPeak{};
+    float out[2][48];
+    while (!stereo.IsBuffering())
+    {
+        RunStereoLooper(stereo, 1, out[0], out[1]);
+        // The last block starts buffering.
+        if (stereo.IsStartingUp())
+        {
+            startupPeak = std::max(startupPeak, *std::max_element(out[0], out[0] + 48));
+        }
+        startupBlocks++;
+    }
+    float bufferingPeak{};
+    for (int32_t i = 0; i < 10; i++)
+    {
+        RunStereoLooper(stereo, 1, out[0], out[1]);
+        bufferingPeak = std::max(bufferingPeak, *std::max_element(out[0], out[0] + 48));
+    }
+    bool buffering = stereo.IsBuffering();
+    stereo.Send(StereoLooper::CommandType::STOP_BUFFERING);
+    RunStereoLooper(stereo, 1);
+    bool ready = stereo.IsReady();
+    int32_t bufferSamples = stereo.GetBufferSamples(StereoLooper::LEFT);
+    stereo.Start();
+    RunStereoLooper(stereo, 1);
+    bool recording = stereo.IsRecording();
+    stereo.SetFreeze(StereoLooper::BOTH, 1.f);
+    RunStereoLooper(stereo, 1);
+    bool frozen = stereo.IsFrozen();
+
+    // The commands are executed in order, in the block after being sent.
+    stereo.SetReadRate(StereoLooper::LEFT, 1.5f);
+    stereo.SetReadRate(StereoLooper::LEFT, 0.5f);
+    stereo.SetFreeze(StereoLooper::BOTH, 0.f);
+    RunStereoLooper(stereo, 1);
+    float readRate = stereo.GetReadRate(StereoLooper::LEFT);
+    bool unfrozen = stereo.IsRecording();
+
+    std::cout << "Startup blocks: " << startupBlocks << " (expected " << (48002 + 47) / 48 << "), peak: " << startupPeak << " (expected 0)\n";
+    std::cout << "Buffering peak: " << bufferingPeak << " (expected > 0.5)\n";
+    std::cout << "States: " << buffering << " " << ready << " " << recording << " " << frozen << " " << unfrozen << " (expected 1 1 1 1 1)\n";
+    // The frames after the startup, ten blocks and the one stopping it.
+    std::cout << "Buffered: " << bufferSamples << " (expected " << 46 + 480 + 1 << ")\n";
+    std::cout << "Read rate: " << readRate << " (expected 0.5)\n\n";
+    assert(startupBlocks == (48002 + 47) / 48 && startupPeak == 0.f);
+    assert(bufferingPeak > 0.5f);
+    assert(buffering && ready && recording && frozen && unfrozen);
+    assert(bufferSamples == 46 + 480 + 1);
+    assert(readRate == 0.5f);
+}
+
+void TestStereoLooperProcess()
+{
+    // Process() and ProcessBlock() render the same, when the commands are
+    // sent between the blocks, also feeding back short loops whose heads
+    // pass each other within a block and degrading the mono feedback. When
+    // the rates are slewed, the heads move at the average rate of each span
+    // instead, so only their rates and positions are the same.
+    static uint8_t memories[2][4 * 48000 * sizeof(float)];
+    static StereoLooper loopers[2]{};
+    static float outs[2][2][3000 * 48];
+    static float rates[2][3000];
+    static float positions[2][3000];
+    struct Scenario
+    {
+        std::string desc;
+        StereoLooper::Mode mode;
+        float degradation;
+        float loopLength;
+        float rate;
+        bool loopSync;
+        float slew;
+        float nextRate;
+    };
+    Scenario scenarios[]{
+        {"DUAL", StereoLooper::Mode::DUAL, 0.f, 0.f, 1.f, false, 0.f, 1.f},
+        {"MONO degraded", StereoLooper::Mode::MONO, 0.3f, 0.f, 1.f, false, 0.f, 1.f},
+        {"DUAL short loop", StereoLooper::Mode::DUAL, 0.f, 40.f, 1.3f, true, 0.f, 1.3f},
+        {"DUAL short loop slower", StereoLooper::Mode::DUAL, 0.f, 100.f, 0.7f, true, 0.f, 0.7f},
+        {"DUAL short loop backwards", StereoLooper::Mode::DUAL, 0.f, 300.f, -0.6f, false, 0.f, -0.6f},
+        {"DUAL slewed", StereoLooper::Mode::DUAL, 0.f, 0.f, 1.f, false, 0.05f, 0.7f},
+    };
+    for (const Scenario &scenario : scenarios)
+    {
+        StereoLooper::Conf conf{scenario.mode, Movement::NORMAL, Direction::FORWARD, 1.f};
+        for (int32_t l = 0; l < 2; l++)
+        {
+            StereoLooper &stereo = loopers[l];
+            stereo.Init(48000, conf, memories[l], sizeof(memories[l]));
+            uint32_t frame{};
+            for (int32_t block = 0; block < 3000; block++)
+            {
+                if (1500 == block)
+                {
+                    stereo.Send(StereoLooper::CommandType::STOP_BUFFERING);
+                }
+                if (1510 == block)
+                {
+                    stereo.Start();
+                    stereo.Send(StereoLooper::CommandType::SET_FEEDBACK, StereoLooper::BOTH, 0.5f);
+                    stereo.SetDegradation(scenario.degradation);
+                    stereo.Send(StereoLooper::CommandType::SET_RATE_SLEW, StereoLooper::BOTH, scenario.slew);
+                    if (scenario.loopLength > 0.f)
+                    {
+                        // Moving the heads at once, they pass each other
+                        // at the same frames.
+                        for (int32_t channel = 0; channel < 2; channel++)
+                        {
+                            stereo.SetLoopLength(channel, scenario.loopLength);
+                            stereo.SetLoopSync(channel, scenario.loopSync);
+                            stereo.SetReadRate(channel, scenario.rate);
+                        }
+                    }
+                }
+                if (1600 == block && scenario.nextRate != scenario.rate)
+                {
+                    for (int32_t channel = 0; channel < 2; channel++)
+                    {
+                        stereo.SetReadRate(channel, scenario.nextRate);
+                    }
+                }
+                float in[2][48];
+                for (size_t i = 0; i < 48; i++)
+                {
+                    StereoInput(frame + i, in[0][i], in[1][i]);
+                }
+                float *left = outs[l][0] + block * 48;
+                float *right = outs[l][1] + block * 48;
+                if (l)
+                {
+                    stereo.ProcessBlock(in[0], in[1], left, right, 48);
+                }
+                else
+                {
+                    for (size_t i = 0; i < 48; i++)
+                    {
+                        // The startup leaves the outputs untouched.
+                        left[i] = right[i] = 0.f;
+                        stereo.Process(in[0][i], in[1][i], left[i], right[i]);
+                    }
+                }
+                frame += 48;
+                const StereoLooper::Telemetry::Channel &telemetry = stereo.ReadTelemetry().channels[StereoLooper::LEFT];
+                rates[l][block] = telemetry.readRate;
+                positions[l][block] = telemetry.readPos;
+            }
+        }
+        if (scenario.slew > 0.f)
+        {
+            // Process() publishes every 64 frames, before processing the
+            // last one, so the heads are compared there, a frame apart.
+            float rateError{};
+            float positionError{};
+            int32_t bufferSamples = loopers[0].GetTelemetry().channels[StereoLooper::LEFT].bufferSamples;
+            for (int32_t block = 3; block < 3000; block += 4)
+            {
+                float distance = std::fabs(positions[0][block] - positions[1][block]);
+                positionError = std::max(positionError, std::min(distance, bufferSamples - distance) - std::fabs(rates[0][block]));
+                rateError = std::max(rateError, std::fabs(rates[0][block] - rates[1][block]));
+            }
+
+            std::cout << scenario.desc << " Process rate error: " << rateError << " (expected < 0.001), position error: " << positionError << " (expected < 0.01)\n";
+            assert(rateError < 0.001f);
+            assert(positionError < 0.01f);
+
+            continue;
+        }
+        int32_t mismatches{};
+        for (int32_t channel = 0; channel < 2; channel++)
+        {
+            for (int32_t i = 0; i < 3000 * 48; i++)
+            {
+                mismatches += outs[0][channel][i] != outs[1][channel][i];
+            }
+        }
+
+        std::cout << scenario.desc << " Process mismatches: " << mismatches << " (expected 0)\n";
+        assert(mismatches == 0);
+    }
+    std::cout << "\n";
+}
+
+void TestStereoLooperPartitions()
+{
+    // The memory is split in two buffers and two freeze buffers, unless in
+    // MONO mode, where the buffer takes both channels' memory, or all of it
+    // without freezing.
+    static uint8_t memory[4 * 48000 * sizeof(float)];
+    static StereoLooper stereo{};
+    struct Partition
+    {
+        std::string desc;
+        StereoLooper::Mode mode;
+        bool linked;
+        bool monoFreeze;
+        int32_t samples;
+    };
+    Partition partitions[] =
+    {
+        { "DUAL", StereoLooper::Mode::DUAL, false, true, 48000 },
+        { "CROSS", StereoLooper::Mode::CROSS, false, true, 48000 },
+        { "CROSS, linked", StereoLooper::Mode::CROSS, true, true, 48000 },
+        { "MONO", StereoLooper::Mode::MONO, false, true, 96000 },
+        { "MONO, without freezing", StereoLooper::Mode::MONO, false, false, 192000 },
+    };
+    int32_t mismatches{};
+    for (const Partition &partition : partitions)
+    {
+        StereoLooper::Conf conf{partition.mode, Movement::NORMAL, Direction::FORWARD, 1.f};
+        conf.linked = partition.linked;
+        conf.monoFreeze = partition.monoFreeze;
+        StartUpStereoLooper(stereo, conf, memory, sizeof(memory));
+        // Buffer until full.
+        while (!stereo.IsReady())
+        {
+            RunStereoLooper(stereo, 1);
+        }
+        int32_t samples[2]{stereo.GetBufferSamples(StereoLooper::LEFT), stereo.GetBufferSamples(StereoLooper::RIGHT)};
+        std::cout << partition.desc << " buffer: " << samples[0] << " " << samples[1] << " (expected " << partition.samples << ")\n";
+        mismatches += samples[0] != partition.samples || samples[1] != partition.samples;
+    }
+
+    std::cout << "Partition mismatches: " << mismatches << " (expected 0)\n\n";
+    assert(mismatches == 0);
+}
+
+void TestStereoLooperLinkedRender()
+{
+    // With float samples and no degradation, the linked looper renders what
+    // the two loopers render.
+    static uint8_t memories[2][4 * 48000 * sizeof(float)];
+    static StereoLooper loopers[2]{};
+    static float outs[2][2][1000 * 48];
+    for (int32_t l = 0; l < 2; l++)
+    {
+        StereoLooper::Conf conf{StereoLooper::Mode::DUAL, Movement::NORMAL, Direction::FORWARD, 1.f};
+        conf.linked = l;
+        StartUpStereoLooper(loopers[l], conf, memories[l], sizeof(memories[l]));
+        RunStereoLooper(loopers[l], 500);
+        loopers[l].Send(StereoLooper::CommandType::STOP_BUFFERING);
+        RunStereoLooper(loopers[l], 1);
+        loopers[l].Start();
+        loopers[l].Send(StereoLooper::CommandType::SET_FEEDBACK, StereoLooper::BOTH, 0.5f);
+        loopers[l].SetReadRate(StereoLooper::BOTH, 1.37f);
+        loopers[l].SetWriteRate(StereoLooper::BOTH, 0.8f);
+        RunStereoLooper(loopers[l], 1000, outs[l][0], outs[l][1]);
+    }
+    int32_t mismatches{};
+    for (int32_t channel = 0; channel < 2; channel++)
+    {
+        for (int32_t i = 0; i < 1000 * 48; i++)
+        {
+            mismatches += outs[0][channel][i] != outs[1][channel][i];
+        }
+    }
+
+    std::cout << "Linked render mismatches: " << mismatches << " (expected 0)\n\n";
+    assert(mismatches == 0);
+}
+
+void TestStereoLooperCommands()
+{
+    static uint8_t memory[4 * 48000 * sizeof(float)];
+    static StereoLooper stereo{};
+    StereoLooper::Conf conf{StereoLooper::Mode::DUAL, Movement::NORMAL, Direction::FORWARD, 1.f};
+
+    // The actions sent before the looper runs are held aside, with the
+    // commands behind them, so they don't fill the queue nor hold back
+    // START and STOP_BUFFERING.
+    StartUpStereoLooper(stereo, conf, memory, sizeof(memory));
+    bool sent{true};
+    for (int32_t block = 0; block < 10; block++)
+    {
+        for (int32_t i = 0; i < 5; i++)
+        {
+            sent &= stereo.Send(StereoLooper::CommandType::CLEAR_BUFFER);
+        }
+        RunStereoLooper(stereo, 1);
+    }
+    stereo.Send(StereoLooper::CommandType::STOP_BUFFERING);
+    RunStereoLooper(stereo, 1);
+    bool ready = stereo.IsReady();
+
+    // They are executed in order once running, none merged into another,
+    // and the parameters sent after them follow them.
+    stereo.Send(StereoLooper::CommandType::SET_DRY_WET_MIX, StereoLooper::BOTH, 1.f);
+    stereo.Send(StereoLooper::CommandType::STOP_READING);
+    stereo.Send(StereoLooper::CommandType::START_READING);
+    stereo.Send(StereoLooper::CommandType::STOP_READING);
+    stereo.SetReadRate(StereoLooper::LEFT, 0.5f);
+    stereo.Start();
+    float out[2][48];
+    RunStereoLooper(stereo, 10, nullptr, nullptr);
+    RunStereoLooper(stereo, 1, out[0], out[1]);
+    bool running = stereo.IsRunning();
+    float peak = std::max(*std::max_element(out[0], out[0] + 48), *std::max_element(out[1], out[1] + 48));
+    float readRate = stereo.GetReadRate(StereoLooper::LEFT);
+
+    // The latency of a held action runs until it's executed.
+    StartUpStereoLooper(stereo, conf, memory, sizeof(memory));
+    stereo.Send(StereoLooper::CommandType::STOP_BUFFERING);
+    RunStereoLooper(stereo, 1);
+    stereo.Send(StereoLooper::CommandType::RETRIGGER);
+    RunStereoLooper(stereo, 10);
+    stereo.Start();
+    RunStereoLooper(stereo, 1);
+    uint32_t latency = stereo.GetCommandLatency();
+
+    // A held RESET stops the looper again, the following actions then wait
+    // for it to run again.
+    StartUpStereoLooper(stereo, conf, memory, sizeof(memory));
+    stereo.Send(StereoLooper::CommandType::RESET);
+    stereo.Send(StereoLooper::CommandType::STOP_BUFFERING);
+    RunStereoLooper(stereo, 1);
+    stereo.Start();
+    RunStereoLooper(stereo, 1);
+    bool reset = stereo.IsBuffering();
+
+    std::cout << "Commands sent: " << sent << ", ready: " << ready << ", running: " << running << " (expected 1 1 1)\n";
+    std::cout << "Output after stopping reading: " << peak << " (expected 0), read rate: " << readRate << " (expected 0.5)\n";
+    std::cout << "Held action latency: " << latency << " (expected >= 480)\n";
+    std::cout << "Held reset executed: " << reset << " (expected 1)\n\n";
+    assert(sent && ready && running);
+    assert(peak == 0.f && readRate == 0.5f);
+    assert(latency >= 480);
+    assert(reset);
+}
+
+void TestStereoLooperLinking()
+{
+    // The channels of CROSS mode keep their own loopers, unless linked.
+    static uint8_t memory[4 * 48000 * sizeof(float)];
+    static StereoLooper stereo{};
+    float rates[2][2]{};
+    for (bool linked : {false, true})
+    {
+        StereoLooper::Conf conf{StereoLooper::Mode::CROSS, Movement::NORMAL, Direction::FORWARD, 1.f};
+        conf.linked = linked;
+        stereo.Init(48000, conf, memory, sizeof(memory));
+        while (!stereo.IsBuffering())
+        {
+            RunStereoLooper(stereo, 1);
+        }
+        stereo.Send(StereoLooper::CommandType::STOP_BUFFERING);
+        RunStereoLooper(stereo, 1);
+        stereo.Start();
+        stereo.SetReadRate(StereoLooper::LEFT, 2.f);
+        RunStereoLooper(stereo, 10);
+        rates[linked][StereoLooper::LEFT] = stereo.GetReadRate(StereoLooper::LEFT);
+        rates[linked][StereoLooper::RIGHT] = stereo.GetReadRate(StereoLooper::RIGHT);
+    }
+
+    std::cout << "Unlinked rates: " << rates[0][0] << " " << rates[0][1] << " (expected 2 1)\n";
+    std::cout << "Linked rates: " << rates[1][0] << " " << rates[1][1] << " (expected 2 2)\n\n";
+    assert(rates[0][0] == 2.f && rates[0][1] == 1.f);
+    assert(rates[1][0] == 2.f && rates[1][1] == 2.f);
+}
+
+void TestThreadPool()
+{
+    // Each task of each batch runs exactly once, whatever the number of
+    // threads, even when the tasks take very different times.
+    ThreadPool pool{};
+    static int32_t runs[1000];
+    int32_t mismatches{};
+    for (size_t threads : {1, 3, 4})
+    {
+        pool.Start(threads);
+        for (int32_t batch = 0; batch < 50; batch++)
+        {
+            std::fill(runs, runs + 1000, 0);
+            size_t tasks = 1000 - batch * 7;
+            pool.Run(tasks, [](size_t index) {
+                volatile float spin{};
+                for (size_t i = 0; i < (index % 10) * 200; i++)
+                {
+                    spin = spin + 1.f;
+                }
+                runs[index]++;
+            });
+            for (size_t i = 0; i < 1000; i++)
+            {
+                mismatches += runs[i] != (i < tasks ? 1 : 0);
+            }
+        }
+    }
+    pool.Stop();
+
+    // Once stopped, the calling thread runs the whole batch.
+    std::fill(runs, runs + 1000, 0);
+    pool.Run(1000, [](size_t index) { runs[index]++; });
+    mismatches += 1 != pool.GetThreads() || 1000 != std::count(runs, runs + 1000, 1);
+
+    std::cout << "Thread pool mismatches: " << mismatches << " (expected 0)\n\n";
+    assert(mismatches == 0);
+}
+
+void TestBufferSpan()
+{
+    // The parts of a span follow each other in the memory, whatever the
+    // size of the samples.
+    static uint8_t memory[4 * 1000 * Packed24Storage::kBytes + 2];
+    BufferSpan<Packed24Storage> pool = BufferSpan<Packed24Storage>::FromBytes(memory, sizeof(memory));
+    bool contiguous = 4000 == pool.length;
+    for (int32_t part = 0; part < 4; part++)
+    {
+        BufferSpan<Packed24Storage> span = pool.Part(part, 4);
+        contiguous = contiguous && 1000 == span.length && memory + part * span.GetBytes() == span.data;
+    }
+
+    // A looper takes the whole pool as a single buffer, with nothing to
+    // freeze the loop in.
+    static float pool2[4 * 2000];
+    static BasicLooper<> single{};
+    single.Init(48000, BufferSpan<>::FromBytes(pool2, sizeof(pool2)), BufferSpan<>{});
+    for (int32_t i = 0; i < 4 * 2000; i++)
+    {
+        single.Buffer(Sine(1.f / 500, i));
+    }
+    single.StopBuffering();
+    single.StartReading(true);
+    single.SetFreeze(1.f);
+    float block[48];
+    float error{};
+    for (int32_t i = 0; i < 8000; i += 48)
+    {
+        single.ReadBlock(block, 48);
+        for (int32_t j = 0; j < 48; j++)
+        {
+            error = std::max(error, std::abs(block[j] - Sine(1.f / 500, i + j)));
+        }
+        single.WriteBlock(block, 48);
+    }
+
+    std::cout << "Buffer span contiguous: " << contiguous << ", samples: " << single.GetBufferSamples() << " (expected 1 8000)\n";
+    std::cout << "Buffer span frozen error: " << error << " (expected < 0.0001)\n\n";
+    assert(contiguous && 8000 == single.GetBufferSamples());
+    assert(error < 0.0001f);
+}
+
+void TestHostDsp()
+{
+    // The host equivalents give the same output as DaisySP.
+    int32_t mismatches{};
+    float daisyPole{};
+    float hostPole{};
+    for (int32_t i = -4000; i <= 4000; i++)
+    {
+        float x = i / 1000.f;
+        mismatches += daisysp::SoftClip(x) != wreath::SoftClip(x);
+        mismatches += daisysp::fmap(x, 0.05f, 0.4f) != wreath::fmap(x, 0.05f, 0.4f);
+        daisysp::fonepole(daisyPole, x, 0.01f);
+        wreath::fonepole(hostPole, x, 0.01f);
+        mismatches += daisyPole != hostPole;
+    }
+    // DaisySP's fastroot shifts the bits of a 32-bit long on the Daisy.
+    uint32_t root = 0x3F800000 + ((0x40000000 - 0x3F800000) >> 9);
+    float expectedRoot;
+    std::memcpy(&expectedRoot, &root, sizeof(root));
+    mismatches += wreath::fastroot(2, 10) != expectedRoot;
+
+    // The filter passes the DC to its lowpass output only.
+    wreath::Svf svf;
+    svf.Init(48000);
+    svf.SetFreq(1000.f);
+    svf.SetDrive(0.75f);
+    svf.SetRes(0.1f);
+    for (int32_t i = 0; i < 48000; i++)
+    {
+        svf.Process(0.5f);
+    }
+
+    std::cout << "Host DSP mismatches: " << mismatches << " (expected 0)\n";
+    std::cout << "Host SVF DC low: " << svf.Low() << ", high: " << svf.High() << " (expected 0.5 0)\n\n";
+    assert(mismatches == 0);
+    assert(std::fabs(svf.Low() - 0.5f) < 0.001f && std::fabs(svf.High()) < 0.001f);
+}
+
+void TestArena()
+{
+    // The loopers share the budget, each buffer aligned to a cache line,
+    // until it runs out.
+    static uint8_t memory[4096 + 64];
+    Arena arena{memory + 1, 4096};
+    uint8_t *first = static_cast<uint8_t *>(arena.Allocate(800));
+    uint8_t *second = static_cast<uint8_t *>(arena.Allocate(800, alignof(float)));
+    uint8_t *third = static_cast<uint8_t *>(arena.Allocate(1600));
+    uint8_t *exhausted = static_cast<uint8_t *>(arena.Allocate(2000));
+    bool aligned = !(reinterpret_cast<uintptr_t>(first) % kCacheLineBytes) && !(reinterpret_cast<uintptr_t>(second) % alignof(float)) && !(reinterpret_cast<uintptr_t>(third) % kCacheLineBytes);
+    bool disjoint = first + 800 <= second && second + 800 <= third && third + 1600 <= memory + 1 + 4096;
+    arena.Reset();
+    bool reset = arena.Allocate(4000, 1) == memory + 1;
+
+    std::cout << "Arena aligned: " << aligned << ", disjoint: " << disjoint << ", exhausted: " << !exhausted << ", reset: " << reset << " (expected 1 1 1 1)\n\n";
+    assert(aligned && disjoint && !exhausted && reset);
+}
+
+template <typename Storage>
+float StorageError(typename Storage::Sample *samples, int32_t size)
+{
+    Random dither{};
+    float error{};
+    for (int32_t i = 0; i < size; i++)
+    {
+        float value = Sine(1.f / size, i) * 0.9f;
+        Storage::Store(samples, i, value, dither);
+        error = std::max(error, std::fabs(Storage::Load(samples, i) - value));
+    }
+
+    return error;
+}
+
+void TestStorage()
+{
+    // The compact storages keep the samples within their quantization step,
+    // dither included.
+    int16_t int16Samples[1024];
+    uint8_t packed24Samples[1024 * 3];
+    float int16Error = StorageError<Int16Storage>(int16Samples, 1024);
+    float packed24Error = StorageError<Packed24Storage>(packed24Samples, 1024);
+
+    // Full scale values are clamped instead of wrapping around.
+    Random dither{};
+    Int16Storage::Store(int16Samples, 0, 1.5f, dither);
+    Packed24Storage::Store(packed24Samples, 0, -1.5f, dither);
+    Packed24Storage::Store(packed24Samples, 1, 1.f, dither);
+
+    std::cout << "Int16 max error: " << int16Error * 32768 << " LSB (expected <= 1.5)\n";
+    std::cout << "Packed24 max error: " << packed24Error * 8388608 << " LSB (expected <= 1)\n";
+    std::cout << "Clamped: " << Int16Storage::Load(int16Samples, 0) << " " << Packed24Storage::Load(packed24Samples, 0) << " " << Packed24Storage::Load(packed24Samples, 1) << " (expected ~1 -1 ~1)\n\n";
+    assert(int16Error * 32768 <= 1.5f);
+    assert(packed24Error * 8388608 <= 1.f);
+    assert(Int16Storage::Load(int16Samples, 0) > 0.99f);
+    assert(Packed24Storage::Load(packed24Samples, 0) < -0.99f);
+    assert(Packed24Storage::Load(packed24Samples, 1) > 0.99f);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+void TestLooperEngine()
+{
+    // The instances don't share anything, so the output is the same whatever
+    // the number of threads.
+    constexpr size_t kInstances{6};
+    std::vector<LooperEngine::Conf> confs;
+    for (size_t i = 0; i < kInstances; i++)
+    {
+        confs.push_back(LooperEngine::Conf{static_cast<StereoLooper::Mode>(i % 3), Movement::NORMAL, Direction::FORWARD, 1.f, static_cast<uint32_t>(i)});
+    }
+    static float ins[2 * kInstances][48];
+    static float outs[2 * kInstances][48];
+    const float *in[2 * kInstances];
+    float *out[2 * kInstances];
+    for (size_t c = 0; c < 2 * kInstances; c++)
+    {
+        in[c] = ins[c];
+        out[c] = outs[c];
+    }
+
+    static LooperEngine engine{};
+    double sums[4]{};
+    size_t threads[4]{1, 2, 4, 8};
+    for (size_t t = 0; t < 4; t++)
+    {
+        engine.Init(48000, confs, 1.f, threads[t]);
+        for (uint32_t block = 0; block < 1600; block++)
+        {
+            for (size_t i = 0; i < kInstances; i++)
+            {
+                StereoLooper &stereo = engine.GetLooper(i);
+                if (1100 == block)
+                {
+                    stereo.Send(StereoLooper::CommandType::STOP_BUFFERING);
+                }
+                if (1110 == block)
+                {
+                    stereo.Start();
+                    stereo.Send(StereoLooper::CommandType::SET_FEEDBACK, StereoLooper::BOTH, 0.5f);
+                    stereo.SetReadRate(StereoLooper::BOTH, 0.5f + i * 0.2f);
+                    stereo.SetDegradation(0.3f);
+                }
+                for (size_t j = 0; j < 48; j++)
+                {
+                    StereoInput(block * 48 + j + i, ins[2 * i][j], ins[2 * i + 1][j]);
+                }
+            }
+            engine.ProcessBlock(in, out, 48);
+            for (size_t c = 0; c < 2 * kInstances; c++)
+            {
+                for (size_t j = 0; j < 48; j++)
+                {
+                    sums[t] += outs[c][j] * (c + 1);
+                }
+            }
+        }
+    }
+
+    std::cout << "Engine sums with 1, 2, 4 and 8 threads: " << sums[0] << " " << sums[1] << " " << sums[2] << " " << sums[3] << " (expected the same)\n\n";
+    assert(sums[0] != 0 && sums[0] == sums[1] && sums[0] == sums[2] && sums[0] == sums[3]);
+}
+
+void TestMappedBuffer()
+{
+    // A 10 minutes tape, the prefetcher keeps only the windows around the
+    // cursor resident.
+    const char *path = "wreath_tape.raw";
+    constexpr int32_t samples = 48000 * 600;
+    MappedBuffer tape{};
+    bool opened = tape.Open(path, samples);
+    assert(opened);
+    tape.SetWindow(48000, 4800);
+
+    int32_t index{};
+    for (int32_t block = 0; block < 100; block++)
+    {
+        tape.Follow(0, index, true);
+        tape.Prefetch();
+        for (int32_t i = 0; i < 4800; i++, index++)
+        {
+            tape.Data()[index] = Sine(1.f / 48000, index);
+        }
+    }
+    size_t resident = tape.GetResidentBytes();
+    tape.Close();
+
+    // The recording survives in the file.
+    tape.Open(path, samples);
+    int32_t mismatches{};
+    for (int32_t i = 0; i < index; i++)
+    {
+        mismatches += tape.Data()[i] != Sine(1.f / 48000, i);
+    }
+    tape.Close();
+    std::remove(path);
+
+    std::cout << "Tape resident: " << resident << " bytes (expected <= " << (48000 + 4800) * 4 + 4 * 65536 << ")\n";
+    std::cout << "Tape mismatches: " << mismatches << " (expected 0)\n";
+    assert(resident <= (48000 + 4800) * 4 + 4 * 65536);
+    assert(mismatches == 0);
+
+    // Following a looper going backwards, the window ahead of the writing
+    // head stays in front of it, as it always moves forward.
+    static Looper tapeLooper{};
+    opened = tape.Open(path, samples);
+    assert(opened);
+    tape.SetWindow(48000, 4800);
+    tapeLooper.Init(48000, BufferSpan<>{tape.Data(), tape.Samples()}, BufferSpan<>{});
+    for (int32_t i = 0; i < 48000 * 10; i++)
+    {
+        tapeLooper.Buffer(Sine(1.f / 48000, i));
+    }
+    tapeLooper.StopBuffering();
+    tapeLooper.SetDirection(Direction::BACKWARDS);
+    tape.Follow(tapeLooper);
+    tape.Prefetch();
+    int32_t writePos = static_cast<int32_t>(tapeLooper.GetWritePos());
+    int32_t loopLength = static_cast<int32_t>(tapeLooper.GetLoopLength()) + 1;
+    bool aheadResident = tape.IsResident((writePos + 40000) % loopLength);
+    tape.Close();
+    std::remove(path);
+
+    std::cout << "Tape ahead of the writing head resident: " << aheadResident << " (expected 1)\n\n";
+    assert(aheadResident);
+}
+#endif
+
 int main()
 {
     looper.Init(48000, buffer, buffer2, 48000);
@@ -452,6 +2048,37 @@ int main()
     //TestLeds();
     //TestCrossPoint();
     TestHeadsDistance();
+    TestHeadsDistanceTracking();
+    TestReadBlock();
+    TestDegradationGate();
+    TestPhase();
+    TestRandom();
+    TestClearBuffer();
+    TestFreezeSnapshot();
+    TestStorage();
+    TestFader();
+    TestRamp();
+    TestCommandQueue();
+    TestTripleBuffer();
+    TestLoopCache();
+    TestReadAhead();
+    TestWriteBehind();
+    TestLinkedLooper();
+    TestVoiceBank();
+    TestStereoLooperStates();
+    TestStereoLooperProcess();
+    TestStereoLooperCommands();
+    TestStereoLooperPartitions();
+    TestStereoLooperLinkedRender();
+    TestStereoLooperLinking();
+    TestThreadPool();
+    TestArena();
+    TestBufferSpan();
+    TestHostDsp();
+#if defined(__unix__) || defined(__APPLE__)
+    TestMappedBuffer();
+    TestLooperEngine();
+#endif
 
     return 0;
 }
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "prefetch.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wreath
+{
+    /**
+     * @brief A fixed pool of threads running batches of independent tasks,
+     * for host builds.
+     *
+     * The tasks of a batch are dealt in contiguous ranges, one per thread,
+     * always the same for the same number of tasks and threads. A thread that
+     * runs out of its own range steals the remaining tasks of the others, one
+     * at a time, so a slow task doesn't hold the whole batch back. Which
+     * thread runs a task changes from batch to batch, but each task runs
+     * exactly once and the batch ends when all of them are done, so tasks
+     * that don't share state give the same results however they're spread.
+     *
+     * Nothing is allocated while running.
+     */
+    class ThreadPool
+    {
+    public:
+        ThreadPool() {}
+        ~ThreadPool() { Stop(); }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        /**
+         * @brief Starts the pool.
+         *
+         * @param threads the number of threads running the tasks, the calling
+         * one included
+         */
+        void Start(size_t threads)
+        {
+            Stop();
+            threads_ = threads > 0 ? threads : 1;
+            ranges_.reset(new Range[threads_]);
+            stopping_ = false;
+            for (size_t thread = 1; thread < threads_; thread++)
+            {
+                workers_.emplace_back(&ThreadPool::Work, this, thread, batch_);
+            }
+        }
+
+        /**
+         * @brief Stops the pool, waiting for the threads to end. The calling
+         * thread then runs the batches alone, until the pool is started again.
+         */
+        void Stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            for (std::thread &worker : workers_)
+            {
+                worker.join();
+            }
+            workers_.clear();
+            threads_ = 1;
+        }
+
+        inline size_t GetThreads() const { return threads_; }
+
+        /**
+         * @brief Runs the given task for each index in [0, tasks), returning
+         * when all of them are done. The calling thread runs its share.
+         *
+         * @tparam F a callable taking the index of the task
+         * @param tasks
+         * @param task
+         */
+        template <typename F>
+        void Run(size_t tasks, F task)
+        {
+            for (size_t thread = 0; thread < threads_; thread++)
+            {
+                ranges_[thread].next.store(tasks * thread / threads_, std::memory_order_relaxed);
+                ranges_[thread].end = tasks * (thread + 1) / threads_;
+            }
+            call_ = [](void *context, size_t index) { (*static_cast<F *>(context))(index); };
+            context_ = &task;
+            pending_.store(threads_ - 1, std::memory_order_relaxed);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                batch_++;
+            }
+            wake_.notify_all();
+
+            Drain(0);
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this] { return !pending_.load(std::memory_order_acquire); });
+        }
+
+    private:
+        // Each thread's range fills a cache line, as all the threads take
+        // from it.
+        struct Range
+        {
+            std::atomic<size_t> next{};
+            size_t end{};
+            uint8_t padding[kCacheLineBytes - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+        };
+
+        size_t threads_{1};
+        std::unique_ptr<Range[]> ranges_{new Range[1]};
+        std::vector<std::thread> workers_{};
+        std::mutex mutex_{};
+        std::condition_variable wake_{};
+        std::condition_variable done_{};
+        uint32_t batch_{};                  // The batches run so far, guarded by the mutex
+        bool stopping_{};                   // Guarded by the mutex
+        std::atomic<size_t> pending_{};     // The workers still running the batch
+        void (*call_)(void *, size_t){};
+        void *context_{};
+
+        /**
+         * @brief Runs the tasks of the given thread's range, then steals
+         * those left in the others.
+         *
+         * @param thread
+         */
+        void Drain(size_t thread)
+        {
+            for (size_t i = 0; i < threads_; i++)
+            {
+                Range &range = ranges_[(thread + i) % threads_];
+                size_t index;
+                while ((index = range.next.fetch_add(1, std::memory_order_relaxed)) < range.end)
+                {
+                    call_(context_, index);
+                }
+            }
+        }
+
+        /**
+         * @brief The loop of a worker thread, waiting for the batches after
+         * the given one.
+         *
+         * @param thread
+         * @param batch
+         */
+        void Work(size_t thread, uint32_t batch)
+        {
+            while (true)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wake_.wait(lock, [this, batch] { return stopping_ || batch_ != batch; });
+                    if (stopping_)
+                    {
+                        return;
+                    }
+                    batch = batch_;
+                }
+
+                Drain(thread);
+
+                if (1 == pending_.fetch_sub(1, std::memory_order_acq_rel))
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    done_.notify_one();
+                }
+            }
+        }
+    };
+} // namespace wreath
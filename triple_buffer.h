@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace wreath
+{
+    /**
+     * @brief Passes the latest value of a state from one writer thread to one
+     * reader thread, without locks and without tearing. The writer fills the
+     * back copy and publishes it, the reader fetches the most recent published
+     * copy and keeps reading it until it fetches again. Neither of them ever
+     * waits, and the values published in between are skipped.
+     *
+     * @tparam T the state, trivially copyable
+     */
+    template <typename T>
+    class TripleBuffer
+    {
+    public:
+        TripleBuffer() {}
+        ~TripleBuffer() {}
+
+        /**
+         * @brief The copy being filled by the writer. Writer only.
+         *
+         * @return T&
+         */
+        inline T &Back() { return buffers_[back_]; }
+
+        /**
+         * @brief Makes the back copy the most recent one. The new back copy
+         * holds an older value, fill it completely before publishing it.
+         * Writer only.
+         */
+        void Publish()
+        {
+            back_ = middle_.exchange(static_cast<uint8_t>(back_ | kFresh), std::memory_order_acq_rel) & kIndex;
+        }
+
+        /**
+         * @brief Takes the most recent published copy, if the reader doesn't
+         * have it yet. Reader only.
+         *
+         * @return true if the front copy has changed
+         * @return false
+         */
+        bool Fetch()
+        {
+            if (!(middle_.load(std::memory_order_relaxed) & kFresh))
+            {
+                return false;
+            }
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndex;
+
+            return true;
+        }
+
+        /**
+         * @brief The copy taken by the last Fetch(). Reader only.
+         *
+         * @return const T&
+         */
+        inline const T &Front() const { return buffers_[front_]; }
+
+    private:
+        static constexpr uint8_t kIndex{0x3};
+        static constexpr uint8_t kFresh{0x4}; // The middle copy hasn't been fetched yet
+
+        T buffers_[3]{};
+        uint8_t front_{0};               // Owned by the reader
+        uint8_t back_{2};                // Owned by the writer
+        std::atomic<uint8_t> middle_{1}; // Exchanged by both
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <typename T>
+    constexpr uint8_t TripleBuffer<T>::kIndex;
+    template <typename T>
+    constexpr uint8_t TripleBuffer<T>::kFresh;
+} // namespace wreath
@@ -0,0 +1,456 @@
+#pragma once
+
+#include "interpolator.h"
+#include "phase.h"
+#include "storage.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace wreath
+{
+    constexpr int32_t kVoices{8};            // Voices of a bank, a multiple of the SIMD width
+    constexpr int32_t kVoiceRootNote{60};    // The note played at the recorded pitch
+    constexpr float kVoiceAttackSamples{48}; // ~1ms @ 48KHz
+    constexpr float kVoiceReleaseSamples{2400}; // ~50ms @ 48KHz
+    constexpr float kVoiceStealSamples{48};     // ~1ms @ 48KHz
+
+    /**
+     * @brief A bank of read-only voices, each one playing a loop of the same
+     * buffer at its own rate, so that the recording can be played
+     * polyphonically.
+     *
+     * The state of the voices is kept as a structure of arrays and all the
+     * voices, playing or not, are advanced and enveloped together in loops
+     * over the voices, which the compiler turns into SIMD instructions where
+     * the target has them. Only the taps are fetched and interpolated one
+     * voice at a time, skipping the free ones.
+     *
+     * The capacity is fixed and nothing is allocated. When all the voices are
+     * busy, a new note steals the quietest released voice or, failing that,
+     * the oldest one. A voice that is still sounding when it's reused fades
+     * out quickly before playing the new note from silence.
+     *
+     * @tparam Interpolator
+     * @tparam Storage
+     * @tparam kSize the number of voices
+     */
+    template <typename Interpolator = LinearInterpolator, typename Storage = FloatStorage, int32_t kSize = kVoices>
+    class BasicVoiceBank
+    {
+    public:
+        BasicVoiceBank() {}
+        ~BasicVoiceBank() {}
+
+        using Sample = typename Storage::Sample;
+        using Value = typename Storage::Value;
+
+        void Init(const Sample *buffer)
+        {
+            buffer_ = buffer;
+            Stop();
+        }
+
+        /**
+         * @brief Silences all the voices at once.
+         */
+        void Stop()
+        {
+            for (int32_t voice = 0; voice < kSize; voice++)
+            {
+                Free(voice);
+                phase_[voice] = 0;
+                start_[voice] = 0;
+                end_[voice] = Phase::kOne;
+            }
+        }
+
+        inline void SetAttack(float samples) { attackSamples_ = std::max(samples, 1.f); }
+        inline void SetRelease(float samples) { releaseSamples_ = std::max(samples, 1.f); }
+
+        /**
+         * @brief Starts a voice playing the given loop of the buffer.
+         *
+         * @param note the note the voice is tied to
+         * @param rate the playback rate, negative to play backwards
+         * @param velocity the peak level, in the [0, 1] range
+         * @param loopStart the first sample of the loop
+         * @param loopLength the length of the loop, which must not cross the
+         * end of the buffer
+         * @return int32_t the voice playing the note, -1 if the loop is too
+         * short to be interpolated or if the velocity is zero, which releases
+         * the note instead
+         */
+        int32_t NoteOn(int32_t note, float rate, float velocity, int32_t loopStart, int32_t loopLength)
+        {
+            if (velocity <= 0.f)
+            {
+                NoteOff(note);
+
+                return -1;
+            }
+            if (loopLength < Interpolator::kTaps)
+            {
+                return -1;
+            }
+
+            int32_t voice = FindVoice(note);
+            // The heads can't move by more than a loop per sample.
+            rate = std::min(std::max(rate, -static_cast<float>(loopLength)), static_cast<float>(loopLength));
+            note_[voice] = note;
+            stamp_[voice] = ++stamps_;
+            next_[voice] = Next{Phase::FromInt(loopStart).Raw(), Phase::FromInt(loopStart + loopLength).Raw(), Phase::FromFloat(rate).Raw(), velocity};
+            if (level_[voice] > 0.f)
+            {
+                // Jumping to the new loop would click, the note starts once
+                // the voice has faded out.
+                pending_[voice] = true;
+                delta_[voice] = -level_[voice] / kVoiceStealSamples;
+            }
+            else
+            {
+                Play(voice);
+            }
+
+            return voice;
+        }
+
+        /**
+         * @brief Releases the voices playing the given note.
+         *
+         * @param note
+         */
+        void NoteOff(int32_t note)
+        {
+            for (int32_t voice = 0; voice < kSize; voice++)
+            {
+                if (note != note_[voice])
+                {
+                    continue;
+                }
+                // A note waiting for its voice to fade out is dropped.
+                if (pending_[voice])
+                {
+                    pending_[voice] = false;
+                }
+                else
+                {
+                    delta_[voice] = -peak_[voice] / releaseSamples_;
+                }
+            }
+        }
+
+        /**
+         * @brief Returns whether a voice is playing the given note, release
+         * included.
+         *
+         * @param note
+         * @return true
+         * @return false
+         */
+        bool IsPlaying(int32_t note)
+        {
+            return std::find(note_, note_ + kSize, note) != note_ + kSize;
+        }
+
+        int32_t GetActiveVoices()
+        {
+            return static_cast<int32_t>(std::count_if(note_, note_ + kSize, [](int32_t note) { return note != kNoNote; }));
+        }
+
+        inline bool IsActive() { return GetActiveVoices() > 0; }
+
+        /**
+         * @brief Adds the voices to the given values.
+         *
+         * @param out
+         * @param size
+         */
+        void Process(Value *out, size_t size)
+        {
+            if (!IsActive())
+            {
+                return;
+            }
+
+            size_t done{};
+            while (done < size)
+            {
+                size_t span = std::min(size - done, kChunkSize);
+                ProcessChunk(out + done, span);
+                done += span;
+            }
+        }
+
+        /**
+         * @brief Returns the first of the next frames, up to the given size,
+         * at which the writing head overwrites a sample that a voice reads at
+         * an earlier frame, so that the voices of a block read after it's
+         * written play the same as one frame at a time.
+         *
+         * @tparam Position
+         * @param size
+         * @param write returns the writing head's position at a given frame,
+         * moving in a straight line
+         * @return size_t
+         */
+        template <typename Position>
+        size_t SamplesToOverwrite(size_t size, Position write)
+        {
+            if (!IsActive())
+            {
+                return size;
+            }
+
+            for (int32_t voice = 0; voice < kSize; voice++)
+            {
+                if (kNoNote != note_[voice])
+                {
+                    size = SamplesToOverwrite(voice, size, write);
+                }
+            }
+
+            return size;
+        }
+
+    private:
+        static constexpr int32_t kNoNote{-1};
+        static constexpr size_t kChunkSize{16}; // Frames advanced at once before fetching
+
+        /**
+         * @brief The note a voice plays once it has faded out.
+         */
+        struct Next
+        {
+            int64_t start;
+            int64_t end;
+            int64_t step;
+            float peak;
+        };
+
+        const Sample *buffer_{};
+        float attackSamples_{kVoiceAttackSamples};
+        float releaseSamples_{kVoiceReleaseSamples};
+        uint32_t stamps_{}; // The note ons so far, to find the oldest voice
+
+        // The voices' state, the phases and the loop boundaries are raw
+        // 32.32 fixed point values.
+        int64_t phase_[kSize]{};
+        int64_t step_[kSize]{};
+        int64_t start_[kSize]{};
+        int64_t end_[kSize]{};
+        float level_[kSize]{};
+        float delta_[kSize]{}; // The envelope's slope, negative when releasing
+        float peak_[kSize]{};
+        int32_t note_[kSize]{};
+        uint32_t stamp_[kSize]{};
+        Next next_[kSize]{};
+        bool pending_[kSize]{};
+
+        void Free(int32_t voice)
+        {
+            note_[voice] = kNoNote;
+            step_[voice] = 0;
+            level_[voice] = 0.f;
+            delta_[voice] = 0.f;
+            peak_[voice] = 0.f;
+            pending_[voice] = false;
+        }
+
+        /**
+         * @brief Starts the voice's next note from silence.
+         *
+         * @param voice
+         */
+        void Play(int32_t voice)
+        {
+            const Next &next = next_[voice];
+            start_[voice] = next.start;
+            end_[voice] = next.end;
+            step_[voice] = next.step;
+            phase_[voice] = next.step < 0 ? next.end - 1 : next.start;
+            peak_[voice] = next.peak;
+            level_[voice] = 0.f;
+            delta_[voice] = next.peak / attackSamples_;
+            pending_[voice] = false;
+        }
+
+        /**
+         * @brief Finds the voice for a new note: the one already playing it,
+         * a free one or the one to steal.
+         *
+         * @param note
+         * @return int32_t
+         */
+        int32_t FindVoice(int32_t note)
+        {
+            int32_t free{-1};
+            int32_t released{-1};
+            int32_t oldest{0};
+            for (int32_t voice = 0; voice < kSize; voice++)
+            {
+                if (note == note_[voice])
+                {
+                    return voice;
+                }
+                if (kNoNote == note_[voice])
+                {
+                    free = free < 0 ? voice : free;
+                    continue;
+                }
+                if (delta_[voice] < 0 && (released < 0 || level_[voice] < level_[released]))
+                {
+                    released = voice;
+                }
+                // The ages survive the stamps wrapping around.
+                if (stamps_ - stamp_[voice] > stamps_ - stamp_[oldest])
+                {
+                    oldest = voice;
+                }
+            }
+
+            return free >= 0 ? free : released >= 0 ? released : oldest;
+        }
+
+        /**
+         * @brief Adds a chunk of frames of the voices to the given values.
+         * The positions and the gains of all the voices are computed first,
+         * frame by frame, then the playing voices are fetched one at a time.
+         *
+         * @param out
+         * @param size at most kChunkSize
+         */
+        void ProcessChunk(Value *out, size_t size)
+        {
+            int64_t phases[kChunkSize][kSize];
+            float gains[kChunkSize][kSize];
+            for (size_t frame = 0; frame < size; frame++)
+            {
+                for (int32_t voice = 0; voice < kSize; voice++)
+                {
+                    phases[frame][voice] = phase_[voice];
+                    int64_t phase = phase_[voice] + step_[voice];
+                    phase = phase >= end_[voice] ? phase - (end_[voice] - start_[voice]) : phase;
+                    phase = phase < start_[voice] ? phase + (end_[voice] - start_[voice]) : phase;
+                    phase_[voice] = phase;
+                    float level = std::min(std::max(level_[voice] + delta_[voice], 0.f), peak_[voice]);
+                    level_[voice] = level;
+                    gains[frame][voice] = level;
+                }
+            }
+
+            for (int32_t voice = 0; voice < kSize; voice++)
+            {
+                if (kNoNote == note_[voice])
+                {
+                    continue;
+                }
+                int32_t start = Phase::FromRaw(start_[voice]).Int();
+                int32_t end = Phase::FromRaw(end_[voice]).Int();
+                for (size_t frame = 0; frame < size; frame++)
+                {
+                    out[frame] += Fetch(Phase::FromRaw(phases[frame][voice]), start, end) * gains[frame][voice];
+                }
+                // The released voices are freed once silent, the reused ones
+                // start their next note.
+                if (delta_[voice] < 0 && level_[voice] <= 0.f)
+                {
+                    if (pending_[voice])
+                    {
+                        Play(voice);
+                    }
+                    else
+                    {
+                        Free(voice);
+                    }
+                }
+            }
+        }
+
+        /**
+         * @see SamplesToOverwrite()
+         *
+         * @tparam Position
+         * @param voice a playing voice
+         * @param size
+         * @param write
+         * @return size_t
+         */
+        template <typename Position>
+        size_t SamplesToOverwrite(int32_t voice, size_t size, Position write)
+        {
+            int32_t start = Phase::FromRaw(start_[voice]).Int();
+            int32_t end = Phase::FromRaw(end_[voice]).Int();
+            // A voice waiting for its next note may start it at any frame.
+            int32_t nextStart = pending_[voice] ? Phase::FromRaw(next_[voice].start).Int() : end;
+            int32_t nextEnd = pending_[voice] ? Phase::FromRaw(next_[voice].end).Int() : end;
+            int32_t first = write(0);
+            int32_t last = write(size - 1);
+            if (std::max(first, last) < std::min(start, nextStart) || std::min(first, last) >= std::max(end, nextEnd))
+            {
+                return size;
+            }
+
+            // The samples read before the current frame, all of the loop
+            // once the voice has wrapped around it.
+            int32_t lo{end};
+            int32_t hi{start - 1};
+            bool wrapped{};
+            int64_t phase = phase_[voice];
+            for (size_t frame = 1; frame < size; frame++)
+            {
+                int32_t tap = Phase::FromRaw(phase).Int() - Interpolator::kBefore;
+                lo = std::min(lo, tap);
+                hi = std::max(hi, tap + Interpolator::kTaps - 1);
+                phase += step_[voice];
+                wrapped = wrapped || lo < start || hi >= end || phase >= end_[voice] || phase < start_[voice];
+                int32_t position = write(frame);
+                bool read = wrapped ? position >= start && position < end : position >= lo && position <= hi;
+                if (read || (position >= nextStart && position < nextEnd))
+                {
+                    return frame;
+                }
+                phase = phase >= end_[voice] ? phase - (end_[voice] - start_[voice]) : phase;
+                phase = phase < start_[voice] ? phase + (end_[voice] - start_[voice]) : phase;
+            }
+
+            return size;
+        }
+
+        /**
+         * @brief Interpolates the buffer at the given position, wrapping the
+         * taps around the loop.
+         *
+         * @param position
+         * @param start
+         * @param end
+         * @return Value
+         */
+        inline Value Fetch(Phase position, int32_t start, int32_t end)
+        {
+            int32_t first = position.Int() - Interpolator::kBefore;
+            if (first >= start && first + Interpolator::kTaps <= end)
+            {
+                return Storage::template Interpolate<Interpolator>(buffer_, first, position.Frac());
+            }
+
+            Value taps[Interpolator::kTaps];
+            for (int32_t i = 0; i < Interpolator::kTaps; i++)
+            {
+                int32_t index = first + i;
+                index = index >= end ? index - (end - start) : index;
+                index = index < start ? index + (end - start) : index;
+                taps[i] = Storage::Load(buffer_, index);
+            }
+
+            return Interpolator::Interpolate(taps, position.Frac());
+        }
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <typename Interpolator, typename Storage, int32_t kSize>
+    constexpr int32_t BasicVoiceBank<Interpolator, Storage, kSize>::kNoNote;
+    template <typename Interpolator, typename Storage, int32_t kSize>
+    constexpr size_t BasicVoiceBank<Interpolator, Storage, kSize>::kChunkSize;
+
+    using VoiceBank = BasicVoiceBank<>;
+} // namespace wreath
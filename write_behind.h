@@ -0,0 +1,126 @@
+#pragma once
+
+#include "phase.h"
+#include "random.h"
+#include "storage.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace wreath
+{
+    constexpr int32_t kWriteBehindSamples{32}; // The span of a burst, one or more cache lines
+
+    // Whether the heads store their runs in bursts. On the host the direct
+    // stores are faster with every storage, so it stays off until measured
+    // on the target, where building with WREATH_WRITE_BEHIND turns it on.
+#if defined(WREATH_WRITE_BEHIND)
+    constexpr bool kWriteBehind{true};
+#else
+    constexpr bool kWriteBehind{false};
+#endif
+
+    /**
+     * @brief Gathers the samples written by a head and stores them in the
+     * buffer in bursts, instead of one scattered access per sample.
+     *
+     * The samples are encoded in a run, contiguous since the head moves by at
+     * most one sample at a time, until the head leaves the current window
+     * aligned to its size. Flushing copies the run to the buffer at once.
+     * Until then the buffer still holds the old samples, so flush before
+     * anything reads the written region.
+     *
+     * @tparam Storage the storage policy of the buffer
+     * @tparam kSamples the size of the window, a power of two
+     */
+    template <typename Storage = FloatStorage, int32_t kSamples = kWriteBehindSamples>
+    class BasicWriteBehind
+    {
+    public:
+        BasicWriteBehind() {}
+        ~BasicWriteBehind() {}
+
+        using Sample = typename Storage::Sample;
+        using Value = typename Storage::Value;
+
+        static_assert(kSamples && !(kSamples & (kSamples - 1)), "The window size must be a power of two");
+
+        void Init(Sample *buffer)
+        {
+            buffer_ = buffer;
+            lo_ = 0;
+            hi_ = -1;
+        }
+
+        inline bool IsEmpty() const { return hi_ < lo_; }
+
+        /**
+         * @brief Encodes in an empty run the samples written by a head moving
+         * by at most one sample at a time, until the head leaves the window.
+         *
+         * @param in the samples to write
+         * @param size
+         * @param index the raw position of the first write, moved past the
+         * last one
+         * @param step the raw increment, at most one sample either way
+         * @param dither
+         * @return size_t the number of samples encoded
+         */
+        size_t Gather(const Value *in, size_t size, int64_t &index, int64_t step, Random &dither)
+        {
+            int32_t first = static_cast<int32_t>(index >> Phase::kFracBits);
+            size_t count = size;
+            if (step > 0)
+            {
+                int64_t edge = static_cast<int64_t>((first | kMask) + 1) << Phase::kFracBits;
+                count = std::min(count, static_cast<size_t>((edge - index + step - 1) / step));
+            }
+            else if (step < 0)
+            {
+                int64_t edge = static_cast<int64_t>(first & ~kMask) << Phase::kFracBits;
+                count = std::min(count, static_cast<size_t>((index - edge) / -step + 1));
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                Storage::Store(samples_, static_cast<int32_t>(index >> Phase::kFracBits) & kMask, in[i], dither);
+                index += step;
+            }
+            int32_t last = static_cast<int32_t>((index - step) >> Phase::kFracBits);
+            lo_ = std::min(first, last);
+            hi_ = std::max(first, last);
+
+            return count;
+        }
+
+        inline int32_t GetLo() const { return lo_; }
+        inline int32_t GetHi() const { return hi_; }
+
+        /**
+         * @brief Copies the run to the buffer and empties it.
+         */
+        void Flush()
+        {
+            if (IsEmpty())
+            {
+                return;
+            }
+            std::memcpy(Storage::At(buffer_, lo_), Storage::At(samples_, lo_ & kMask), (hi_ - lo_ + 1) * Storage::kBytes);
+            lo_ = 0;
+            hi_ = -1;
+        }
+
+    private:
+        static constexpr int32_t kMask{kSamples - 1};
+
+        Sample *buffer_{};
+        int32_t lo_{};
+        int32_t hi_{-1};
+        Sample samples_[kSamples * Storage::kBytes / sizeof(Sample)]{};
+    };
+
+    // Needed until C++17, where static constexpr members are implicitly inline.
+    template <typename Storage, int32_t kSamples>
+    constexpr int32_t BasicWriteBehind<Storage, kSamples>::kMask;
+
+    using WriteBehind = BasicWriteBehind<>;
+} // namespace wreath